@@ -0,0 +1,116 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADAZIMUTHALINTEGRATOR_H
+#define XPADAZIMUTHALINTEGRATOR_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+#include "ThreadUtils.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class AzimuthalIntegrator
+	* \brief online 1-D azimuthal integration I(2theta) of the frames.
+	*        Flat detector perpendicular to the beam: the CSR matrix (radial
+	*        bin -> pixels, weights) is built once, each pixel being split
+	*        over the bins its 2theta range (from its corners) covers, then
+	*        applied to each frame (SpMV) by a pool of threads (and the calling
+	*        one), each one taking blocks of bins.
+	*        The profile is the mean intensity of the bin (weighted sum / sum of weights).
+	*******************************************************************/
+	class AzimuthalIntegrator
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "AzimuthalIntegrator", "Xpad");
+
+	public:
+		struct Geometry {
+			double	distance;			//- sample - detector (mm)
+			double	center_x;			//- beam center (pixels, from the first column)
+			double	center_y;			//- beam center (pixels, from the first row)
+			double	pixel_size_x;		//- um
+			double	pixel_size_y;		//- um
+			int		nb_bins;
+			double	tth_min;			//- deg, tth_min >= tth_max -> range of the detector
+			double	tth_max;
+		};
+
+		AzimuthalIntegrator();
+		~AzimuthalIntegrator();
+
+		//! Build the matrix for width x height frames (nb_threads = 0 -> nb of online cpus)
+		void init(const Geometry& geometry, int width, int height, int nb_threads = 0);
+
+		//! Profile of a frame (16 or 32 bits counters)
+		void integrate(const void* frame, bool is_32_bits);
+
+		int getNbBins() const					{return m_nb_bins;}
+		const float* getProfile() const			{return &m_profile[0];}
+		//! 2theta (deg) of the bin centers
+		const float* getRadialAxis() const		{return &m_axis[0];}
+		//! Non zero elements of the matrix
+		int getNbEntries() const				{return m_pixels.size();}
+		//! Time (s) spent in integrate since init
+		double getIntegrationDuration() const	{return m_integration_duration;}
+
+	private:
+		AzimuthalIntegrator(const AzimuthalIntegrator&);
+		AzimuthalIntegrator& operator=(const AzimuthalIntegrator&);
+
+		class Worker;
+		friend class Worker;
+
+		void _stopWorkers();
+		void _integrateBins();
+		template <class T>
+		void _integrateBins(const T* frame, int begin, int end);
+
+		int						m_nb_bins;
+		std::vector<int32_t>	m_bin_ptr;			//- CSR rows: entries of bin b in [m_bin_ptr[b], m_bin_ptr[b + 1])
+		std::vector<int32_t>	m_pixels;
+		std::vector<float>		m_weights;
+		std::vector<float>		m_norm;				//- 1 / sum of the weights of the bin (0 if empty)
+		std::vector<float>		m_profile;
+		std::vector<float>		m_axis;
+		std::vector<Worker*>	m_workers;
+		double					m_integration_duration;
+
+		//- frame being integrated
+		Cond					m_cond;
+		bool					m_quit;
+		unsigned long			m_generation;
+		const void*				m_frame;
+		bool					m_is_32_bits;
+		volatile int			m_next_block;
+		int						m_nb_blocks;
+		int						m_nb_done;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADAZIMUTHALINTEGRATOR_H
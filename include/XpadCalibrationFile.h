@@ -0,0 +1,127 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADCALIBRATIONFILE_H
+#define XPADCALIBRATIONFILE_H
+
+#include <string>
+
+#include "XpadDetectorState.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class CalibrationFile
+	* \brief access to the calibrations (DACL + config G) stored in a directory
+	*
+	* Text layout of this plugin (written by writeText: host calibration,
+	* binaryToText), one pair of files per module (modNum starts at 1):
+	*   <path>/xpad_calibration.txt    : index, written last, 3 lines:
+	*                                    "XPADCALIB-TEXT 1", "modules_mask 0x<hex>",
+	*                                    "nb_chips <n>"
+	*   <path>/dacl_mod<modNum>.txt    : 120 lines of 80 * nb chips DACL values
+	*                                    (whitespace separated, chip after chip)
+	*   <path>/configg_mod<modNum>.txt : one line per chip of the 11 config G
+	*                                    values (order of Camera::loadAllConfigG)
+	* It is not the layout of the calibrations saved by the xpix OTN calibrations:
+	* a directory without the index is left to imxpad_uploadCalibration.
+	*
+	* Binary layout (one file, see CalibrationMap): header, config G
+	* (uint32, [module][chip][register]) and DACL (uint16, image layout),
+	* each block aligned on 64 bytes, FNV-1a checksum of the blocks.
+	*******************************************************************/
+	class CalibrationFile
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "CalibrationFile", "Xpad");
+
+	public:
+		//! Read the calibration of all the modules of calib, false if path is not a calibration of
+		//! this layout and of this geometry (no index), or if a file is missing or invalid
+		static bool readText(const std::string& path, DetectorState& calib);
+		static void writeText(const std::string& path, const DetectorState& calib);
+
+		//! Write the calibration in a binary file (written in a temporary file then renamed)
+		static void writeBinary(const std::string& file_name, const DetectorState& calib,
+								const std::string& description = "");
+		//! Converters between the text layout of this plugin (directory with xpad_calibration.txt)
+		//! and the binary file. The calibrations saved by the xpix OTN calibrations are not read
+		//! nor written: their layout is private to xpix, they can only be uploaded by it
+		static void textToBinary(const std::string& path, const std::string& file_name,
+								 unsigned int modules_mask, int nb_chips);
+		static void binaryToText(const std::string& file_name, const std::string& path);
+
+	private:
+		static std::string _fileName(const std::string& path, const char* prefix, int mod_num);
+	};
+
+	/*******************************************************************
+	* \class CalibrationMap
+	* \brief binary calibration file mapped in memory (read only): the DACL
+	*        and config G are read in place, without parse nor copy.
+	*******************************************************************/
+	class CalibrationMap
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "CalibrationMap", "Xpad");
+
+	public:
+		//! Map file_name, verify: check the checksum of the whole file
+		CalibrationMap(const std::string& file_name, bool verify = true);
+		~CalibrationMap();
+
+		//! true if file_name is a binary calibration file
+		static bool isCalibrationMap(const std::string& file_name);
+
+		unsigned int getModulesMask() const	{return m_modules_mask;}
+		int getNbModules() const			{return m_nb_modules;}
+		int getNbChips() const				{return m_nb_chips;}
+		int getModuleBit(int mod_idx) const;
+		const std::string& getDescription() const	{return m_description;}
+		//! Creation time of the file (s since the Epoch)
+		double getCreationTime() const		{return m_creation_time;}
+
+		uint32_t getConfigG(int mod_idx, int chip, int index) const;
+		const uint16_t* getDacl() const		{return m_dacl;}
+		const uint16_t* getDaclRow(int mod_idx, int chip, int row) const;
+
+		//! Copy the calibration in a detector state of the same geometry
+		void copyTo(DetectorState& calib) const;
+
+	private:
+		CalibrationMap(const CalibrationMap&);
+		CalibrationMap& operator=(const CalibrationMap&);
+
+		void*				m_base;
+		size_t				m_size;
+		unsigned int		m_modules_mask;
+		int					m_nb_modules;
+		int					m_nb_chips;
+		std::string			m_description;
+		double				m_creation_time;
+		const uint32_t*		m_config_g;
+		const uint16_t*		m_dacl;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADCALIBRATIONFILE_H
@@ -32,10 +32,8 @@
 
 #define kPOST_MSG_TMO       2
 
-const size_t  XPAD_DLL_START_SYNC_MSG		=	(yat::FIRST_USER_MSG + 100);
+//- SYNC and live acquisitions and calibrations are run by the acquisition thread (see Camera::AcqThread)
 const size_t  XPAD_DLL_START_ASYNC_MSG		=	(yat::FIRST_USER_MSG + 101);
-const size_t  XPAD_DLL_START_LIVE_ACQ_MSG	=	(yat::FIRST_USER_MSG + 102);
-const size_t  XPAD_DLL_CALIBRATE		    =	(yat::FIRST_USER_MSG + 103);
 
 
 
@@ -50,9 +48,21 @@ const size_t  XPAD_DLL_CALIBRATE		    =	(yat::FIRST_USER_MSG + 103);
 
 #include <stdlib.h>
 #include <limits>
+#include <deque>
 
 #include "HwMaxImageSizeCallback.h"
 #include "HwBufferMgr.h"
+#include "ThreadUtils.h"
+#include "XpadDetectorState.h"
+#include "XpadSCurve.h"
+#include "XpadFrameRing.h"
+#include "XpadFrameStreamer.h"
+#include "XpadFrameCompressor.h"
+#include "XpadSparseFrame.h"
+#include "XpadPhaseBinning.h"
+#include "XpadAzimuthalIntegrator.h"
+#include "XpadDeadTimeCorrection.h"
+#include <map>
 
 using namespace std;
 
@@ -93,14 +103,113 @@ namespace Xpad
 	                OTN_MEDIUM,
 			OTN_HIGH,
 			BEAM,
-			UPLOAD
+			UPLOAD,
+			OTN_HOST
 		};
 
-		Camera(string xpad_type);
+		//- Steps of the in place recovery after a driver error
+		enum RecoveryStep {
+			RECOVERY_IDLE = 0,
+			RECOVERY_ASK_READY,		//- re-query the modules readiness
+			RECOVERY_RELOAD,		//- reprogram the mirrored config G, DACL and exposure parameters
+			RECOVERY_RESUME,		//- resume from the last published image
+			RECOVERY_FAILED
+		};
+
+		//- Policy of the frame streaming for a client that is too slow
+		enum StreamPolicy {
+			STREAM_BLOCK = FrameStreamer::BLOCK,					//- the publication thread waits for it
+			STREAM_DROP_OLDEST = FrameStreamer::DROP_OLDEST,		//- its oldest queued frame is dropped
+			STREAM_SKIP_TO_LATEST = FrameStreamer::SKIP_TO_LATEST	//- its queue is dropped
+		};
+
+		//- Progress of the running calibration
+		struct CalibrationProgress {
+			Camera::CalibrationType	type;
+			int		module;			//- module being calibrated (starts at 1), 0 when done or all modules at once
+			int		step;			//- nb of steps (modules) done
+			int		nb_steps;
+			double	eta;			//- s, -1 if not known yet
+		};
+
+		//- Parameters of the host calibration over the noise (see calibrateOTNHost)
+		struct HostCalibrationParams {
+			unsigned	exp_time_usec;		//- exposure of each scan image
+			int			nb_images;			//- nb of images summed at each scan step
+			int			ithl_min;			//- ITHL scan range
+			int			ithl_max;
+			int			dacl_flat;			//- DACL (0-63) of all the pixels during the ITHL scan
+			int			dacl_margin;		//- DACL steps kept below the noise edge of each pixel
+			unsigned	noise_counts;		//- summed counts of a pixel reaching its noise edge
+			int			nb_threads;			//- threads of the S-curve analysis (0 -> nb of cpus)
+		};
+
+		//- Timings of the last host calibration
+		struct HostCalibrationStats {
+			double	total_time;			//- s
+			double	acquisition_time;	//- s
+			double	analysis_time;		//- s
+			int		nb_frames;
+			int		nb_threads;
+		};
+
+		//- Statistics of the last configuration upload
+		struct UploadStats {
+			int		nb_driver_calls;
+			int		nb_skipped_calls;
+			long	nb_bytes;
+			long	nb_skipped_bytes;
+			double	duration;			//- s
+		};
+
+		//- Readout/throughput model of the detector and of the host data path
+		struct ReadoutModel {
+			double chip_readout_usec;			//- fixed readout dead time of the chips
+			double ovf_readout_usec;			//- dead time of each overflow refresh (32 bits mode)
+			double link_mbytes_per_sec;			//- PCIe link throughput
+			double host_copy_usec_per_mbyte;	//- copy cost into the lima buffer
+			double host_reorder_usec_per_mbyte;	//- line reordering cost (none with xpci_getImgSeq)
+		};
+
+		//- Consumers of the host stages, called by the publication thread (off the readout)
+
+		//- Consumer (saving, streaming) of the compressed frames (see setCompression)
+		class CompressedFrameListener {
+		public:
+			virtual ~CompressedFrameListener() {}
+			//! The chunks (one per module) of frame_nb are in compressor until the next frame
+			virtual void compressedFrameReady(Camera& cam, int frame_nb, const FrameCompressor& compressor) = 0;
+		};
+
+		//- Consumer of the 1-D profiles (see setIntegration)
+		class ProfileListener {
+		public:
+			virtual ~ProfileListener() {}
+			//! The profile of frame_nb is in integrator until the next frame (called under the lock of getLastProfile)
+			virtual void profileReady(Camera& cam, int frame_nb, const AzimuthalIntegrator& integrator) = 0;
+		};
+
+		//- Consumer of the sparse frames (see setSparseOutput)
+		class SparseFrameListener {
+		public:
+			virtual ~SparseFrameListener() {}
+			//! The pairs of frame_nb are in encoder until the next frame (not called for the dense frames)
+			virtual void sparseFrameReady(Camera& cam, int frame_nb, const SparseEncoder& encoder) = 0;
+		};
+
+		//! snapshot_path: state snapshot used for the warm start and kept up to date ("" -> none)
+		//! board_num: PCIe board driven by this camera. Only one board per process: most xpix
+		//! calls take no board argument and the library keeps a single global context, so two
+		//! boards can not be driven from the same process
+		Camera(string xpad_type, string snapshot_path = "", int board_num = 0);
 		~Camera();
 
 		void start();
+		//! Abort the acquisition (Fault if it is still running after 5 s), or cancel the running
+		//! calibration (see cancelCalibration)
 		void stop();
+		//! Get the time (s) the last stop took to publish the acquired images and go back to idle
+		void getLastStopDuration(double& duration);
 
 		//- Det info
 		void getImageSize(Size& size);
@@ -112,6 +221,75 @@ namespace Xpad
 
 		//- Buffer
 		BufferCtrlMgr& getBufferMgr();
+		//! Mirror each published frame in the POSIX shared memory ring "/name" of nb_slots frames ("" -> none)
+		void setFrameRing(const std::string& name, int nb_slots);
+		void getFrameRing(std::string& name, int& nb_slots);
+		//! Frames written in the ring, overruns and lag of the acknowledging reader
+		void getFrameRingStats(unsigned long& nb_written, unsigned long& nb_overruns, unsigned long& lag);
+		//! Stream each published frame to the clients of "unix:<path>" or "tcp:<port>" ("" -> none)
+		//! The sparse encoding, integration, compression, ring and streaming of the frames run on the
+		//! publication thread after the lima buffers got them, on the lima buffer itself (or on the
+		//! driver image when the lima buffer holds corrected counts or floats), never on a copy: the
+		//! readout waits when this thread is 16 frames (or a whole lima buffer ring) behind
+		//! policy: for the clients that do not ask for one, queue_depth: frames queued per client
+		void setFrameStreaming(const std::string& address, Camera::StreamPolicy policy, int queue_depth);
+		void getFrameStreamingStats(int& nb_clients, unsigned long& nb_sent, unsigned long& nb_dropped);
+		//! Compress each published frame (bitshuffle + LZ4 per module) on nb_threads threads (0 -> nb of cpus)
+		//! in chunks of the HDF5 bitshuffle/LZ4 filter (see FrameCompressor); the streaming then sends
+		//! these chunks (BSLZ4_UINT16/32) instead of the dense image, the lima buffers keep the image
+		void setCompression(bool enable, int nb_threads = 0);
+		void getCompression(bool& enable, int& nb_threads);
+		void setCompressedFrameListener(Camera::CompressedFrameListener* listener);
+		//! Compression of the current (or last) acquisition
+		void getCompressionStats(unsigned long& nb_frames, double& ratio, double& mbytes_per_sec);
+		//! Online azimuthal integration of each published frame in nb_bins bins of 2theta, the
+		//! beam center (pixels) and the distance (mm) with getPixelSize giving the geometry
+		//! (tth_min >= tth_max -> whole detector). stream_profile_only: the streaming sends the
+		//! profile instead of the image (else after it), the lima buffers always get the image.
+		//! nb_threads = 0 -> nb of cpus.
+		void setIntegration(bool enable, double distance, double center_x, double center_y, int nb_bins,
+							double tth_min, double tth_max, bool stream_profile_only, int nb_threads = 0);
+		void getIntegration(bool& enable, int& nb_bins, bool& stream_profile_only);
+		void setProfileListener(Camera::ProfileListener* listener);
+		//! Last profile and its 2theta (deg) axis
+		void getLastProfile(std::vector<float>& tth, std::vector<float>& intensity);
+		//! Pre-trigger circular mode: the detector runs into a ring of nb_pre_frames frames (nothing
+		//! published) until triggerEvent, then nb_post_frames more frames are acquired and all are
+		//! published in order (nb frames has to be nb_pre_frames + nb_post_frames, an event before
+		//! the ring is full publishes only the pre event frames read so far). Each frame is read by
+		//! its own one image sequence (xpci_getImgSeq only returns once its whole sequence is read):
+		//! the frames are separated by the sequence start dead time, not a continuous series
+		void setCircularMode(bool enable, int nb_pre_frames, int nb_post_frames);
+		void getCircularMode(bool& enable, int& nb_pre_frames, int& nb_post_frames);
+		//! Freeze the ring of the running circular acquisition
+		void triggerEvent();
+		//! Frames read in the ring and whether the event froze it
+		void getCircularStatus(long& nb_ring_frames, bool& frozen);
+		//! Pump-probe phase binning: the frames of each cycle of nb_phases phases are summed by phase
+		//! and the nb_phases sums published every nb_cycles cycles (nb frames, the published ones,
+		//! has to be a multiple of nb_phases; 16 bits sums saturate, 32 bits pixels are advised).
+		//! The wait times of uploadExpWaitTimes are those of the images of one block
+		void setPhaseBinning(bool enable, int nb_phases, int nb_cycles);
+		void getPhaseBinning(bool& enable, int& nb_phases, int& nb_cycles);
+		//! Raw mode: publish the images as the driver delivers them (already in image order), acquired
+		//! in place in the lima buffers when they hold the whole sequence, without any host stage
+		//! (no dead-time correction, float conversion, sparse encoding, integration nor streaming)
+		void setRawMode(bool enable);
+		void getRawMode(bool& enable);
+		//! Encode the frames with at most max_occupancy of hit pixels as (pixel index, count) pairs,
+		//! for the sparse frame listener and the frame streaming
+		void setSparseOutput(bool enable, double max_occupancy);
+		void getSparseOutput(bool& enable, double& max_occupancy);
+		void setSparseFrameListener(Camera::SparseFrameListener* listener);
+		//! Frames, sparse frames and size reduction of these ones in the current (or last) acquisition
+		void getSparseStats(unsigned long& nb_frames, unsigned long& nb_sparse, double& reduction);
+		//! Paralyzable dead-time correction of the frames copied in the lima buffers (or slices):
+		//! n = N exp(-N tau / t), tau_ns: dead time (ns) of each module in image order (one value ->
+		//! all of them). Integers of the pixel depth (rounded, saturated), floats with Bpp32F.
+		//! Not available in raw mode, phase binning sums are corrected over their nb_cycles exposures.
+		//! During a live acquisition, new dead times (enable unchanged) are applied at the next frame.
+		void setDeadTimeCorrection(bool enable, const std::vector<double>& tau_ns);
+		void getDeadTimeCorrection(bool& enable, std::vector<double>& tau_ns);
 		void setNbFrames(int  nb_frames);
 		void getNbFrames(int& nb_frames);
         int getNbHwAcquiredFrames();
@@ -121,13 +299,56 @@ namespace Xpad
 		void getTrigMode(TrigMode& mode);
 		void setExpTime(double  exp_time);
 		void getExpTime(double& exp_time);
-		
+		//! Latency: readout dead time of the detector + wait time between two images
+		void setLatTime(double  lat_time);
+		void getLatTime(double& lat_time);
+		void getValidRanges(double& min_exp_time, double& max_exp_time,
+							double& min_lat_time, double& max_lat_time);
+
+		//- Readout model
+		//! Get the max frame rate (Hz) sustainable with the current exposure time, latency, pixel depth,
+		//! modules and acquisition mode (live: the readout and the copy of each image add up)
+		void getMaxFrameRate(double& max_frame_rate);
+		//! Get the readout model currently used
+		void getReadoutModel(Camera::ReadoutModel& model);
+		//! Measure the detector readout time, the link throughput (sequences in 16 and 32 bits) and
+		//! the host copy/reorder costs to calibrate the readout model. Run by the acquisition thread,
+		//! returns when done (the programmed exposure parameters are restored)
+		void calibrateReadoutModel();
+
 		//- Status
 		void getStatus(Camera::Status& status);
+
+		//- Acquisition thread
+		//! Set the cpus on which the acquisition thread runs (bit mask, 0 -> no affinity)
+		void setAcqThreadAffinity(unsigned long cpu_mask);
+		void getAcqThreadAffinity(unsigned long& cpu_mask);
+		void getBoardNumber(int& board_num);
+		//! Run the acquisition thread in SCHED_FIFO with this priority (0 -> normal scheduling)
+		void setAcqThreadRealTimePriority(int rt_priority);
+		void getAcqThreadRealTimePriority(int& rt_priority);
+		//! Get the time (s) the last start, calibration or scan waited for the acquisition thread to pick it up
+		void getControlLatency(double& latency);
+
+		//- Recovery after driver errors
+		//! Set the max nb of in place recoveries per acquisition (0 -> no recovery)
+		void setMaxRecoveryAttempts(int nb_attempts);
+		void getMaxRecoveryAttempts(int& nb_attempts);
+		//! Get the last recovery step, the nb of recoveries and the last time to recovery (s)
+		void getRecoveryStatus(Camera::RecoveryStep& step, int& nb_recoveries, double& last_recovery_time);
+
+		//- Detector state snapshot (module mask, config G, DACL, exposure parameters)
+		//! Set the snapshot file, written each time the programmed state changes ("" -> none)
+		void setSnapshotPath(string path);
+		void getSnapshotPath(string& path);
+		void saveSnapshot();
+		//! Restore the snapshot, skipping what the detector already holds
+		void restoreSnapshot();
 	
 		//---------------------------------------------------------------
 		//- XPAD Stuff
-		//! Set all the config G
+		//! Set all the config G: 11 values per chip of each module ([module][chip][register]) or 11 values
+		//! for all the chips, programmed with masked calls (see getLastUploadStats)
 		void setAllConfigG(const vector<long>& allConfigG);
 		//!	Set the Acquisition type between fast and slow
 		void setAcquisitionType(short acq_type);
@@ -141,11 +362,18 @@ namespace Xpad
 		void loadAutoTest(unsigned known_value);
         //! Save the config L (DACL) to XPAD RAM
         void saveConfigL(unsigned long modMask, unsigned long calibId, unsigned long chipId, unsigned long curRow,unsigned long* values);
+        //! Save the DACL of all the modules of modMask (contiguous, image order) to XPAD RAM and load it
+        void saveAndLoadConfigL(unsigned long modMask, unsigned long calibId, const unsigned short* dacl, int nb_values);
+        void saveAndLoadConfigL(unsigned long modMask, unsigned long calibId, const vector<unsigned short>& dacl);
+        //! Get the statistics of the last bulk configuration upload
+        void getLastUploadStats(Camera::UploadStats& stats);
         //! Save the config G to XPAD RAM
         void saveConfigG(unsigned long modMask, unsigned long calibId, unsigned long reg,unsigned long* values);
 	    //! Load the config to detector chips
         void loadConfig(unsigned long modMask, unsigned long calibId);
-        //! Get the modules config (Local aka DACL)
+        //! Get the modules config (Local aka DACL) read back from the modules, in image layout:
+        //! the buffer is owned by the camera, it is read again only after the DACL is written (only the
+        //! cached DACL while an acquisition or a calibration runs, an error if there is none)
         unsigned short*& getModConfig();
         //! Reset the detector
         void reset();
@@ -160,14 +388,49 @@ namespace Xpad
         void calibrateOTNMedium (string path);
         //! Calibrate over the noise High and save dacl and configg files in path
         void calibrateOTNHigh (string path);
-        //! upload the calibration (dacl + config) that is stored in path
+        //! Calibrate over the noise with ITHL/DACL scans analysed on the host and save dacl and configg files in path
+        void calibrateOTNHost (string path);
+        //! OTN calibrations (Slow/Medium/High) in one xpix call for all the modules (default), or
+        //! one call per module for a progress and a cancel per module (a few times slower): the
+        //! files of module n are then saved in path/module_n
+        void setCalibrationPerModule(bool per_module);
+        void getCalibrationPerModule(bool& per_module);
+        void setHostCalibrationParams(const Camera::HostCalibrationParams& params);
+        void getHostCalibrationParams(Camera::HostCalibrationParams& params);
+        void getHostCalibrationStats(Camera::HostCalibrationStats& stats);
+        //! cancel the running calibration: returns when the calibration job has ended, after the xpix
+        //! OTN call in progress (all the modules, or one with setCalibrationPerModule), the detector is
+        //! then Ready (not a stop, no timeout)
+        void cancelCalibration();
+        //! get the progress of the running (or last) calibration
+        void getCalibrationProgress(Camera::CalibrationProgress& progress);
+        //! upload the calibration (dacl + config) that is stored in path: only what differs
+        //! from the modules is rewritten when path holds a calibration written by this plugin (text
+        //! layout or binary file, see CalibrationFile), the others (xpix OTN) are uploaded in full by xpix
         void uploadCalibration(string path);
+        //! convert between the text calibration of this plugin (host calibration or convertCalibrationToText,
+        //! see CalibrationFile) and the binary calibration file; not the calibrations saved by the xpix OTN
+        //! calibrations, whose layout is private to xpix
+        void convertCalibrationToBinary(string path, string file_name);
+        void convertCalibrationToText(string file_name, string path);
         //! upload the wait times between each images in case of a sequence of images (Twait from setExposureParameters should be 0)
+        //! one per image of the sequence: nb frames, or nb_phases * nb_cycles (one block) in phase binning
         void uploadExpWaitTimes(unsigned long *pWaitTime, unsigned size);
-        //! increment the ITHL
+        //! increment the ITHL (during a live acquisition setExpTime, increment/decrementITHL and
+        //! loadConfigG are queued and applied between two frames, without stopping)
         void incrementITHL();
         //! decrement the ITHL
         void decrementITHL();
+        //! Threshold scan: acquire nb_images at each of the nb_steps ITHL from ithl_min, in one operation,
+        //! only the counts are kept (getThresholdScanCounts); the ITHL of each chip is restored at the end
+        void startThresholdScan(int ithl_min, int nb_steps, int nb_images);
+        //! Threshold scan mode: the next Lima acquisitions run the scan and publish each image
+        //! (nb frames must be nb_steps * nb_images)
+        void setThresholdScanMode(bool enable, int ithl_min, int nb_steps, int nb_images);
+        void getThresholdScanMode(bool& enable);
+        void getThresholdScanStatus(int& ithl_min, int& nb_steps, int& nb_steps_done);
+        //! Summed counts of each pixel (image order) at one step of the last scan
+        const uint32_t* getThresholdScanCounts(int step);
         //! set the specific parameters (deadTime,init time, shutter ...
         void setSpecificParameters( unsigned deadtime, unsigned init,
 								    unsigned shutter, unsigned ovf,
@@ -181,7 +444,193 @@ namespace Xpad
 	protected: 
 		virtual void handle_message( yat::Message& msg )throw (yat::Exception);
 	private:
+		class AcqThread;
+		friend class AcqThread;
+		class ScanThread;
+		friend class ScanThread;
+		class PublishThread;
+		friend class PublishThread;
+		class HostFramesRelease;
+		friend class HostFramesRelease;
+
+		//- Published frame for the host stages of the publication thread: the image is not
+		//- copied, its owner keeps it until the stages are done (see _releaseHostFrames)
+		struct HostFrame {
+			int				frame_nb;
+			double			timestamp;		//- s since the Epoch
+			const void*		image;
+		};
+
+		enum Job {
+			ACQUISITION_JOB, CALIBRATION_JOB, SCAN_JOB, READOUT_CALIBRATION_JOB
+		};
+
+		//- Parameter update queued during a live acquisition
+		enum LiveCommandType {
+			LIVE_SET_EXP_TIME, LIVE_STEP_ITHL, LIVE_LOAD_CONFIG_G, LIVE_SET_DEAD_TIMES
+		};
+		struct LiveCommand {
+			Camera::LiveCommandType	type;
+			unsigned long			reg;
+			long					value;
+			vector<double>			values;		//- dead times (ns) of LIVE_SET_DEAD_TIMES
+		};
+
+		void _acquire(int nb_frames);
+		void _acquireLive();
+		void _acquireCircular();
+		void _acquirePhaseBinning();
+		void _acquireWithRecovery(int nb_frames, int first_frame_nb);
+		void _acquireImages(int nb_frames, int first_frame_nb);
+		void _recover(int nb_remaining_frames);
+		void _setExposureParameters(unsigned nb_images);
+		void _publishFrame(int frame_nb, void* image, double capture_time = 0.);
+		bool _hostStagesEnabled() const;
+		void _queueHostFrame(int frame_nb, const void* image, double timestamp);
+		bool _hostStagesReadLimaBuffer() const;
+		void _waitHostFrameSlot();
+		void _releaseHostFrames();
+		bool _waitHostFrames();
+		void _processHostFrame(Camera::HostFrame& frame);
+		void _streamCompressedFrame(int frame_nb, double timestamp);
+		void _initDeadTimeCorrector();
+		void _applyAcqThreadScheduling();
+		void _startCalibration(Camera::CalibrationType type, const string& path);
+		void _calibrate();
+		bool _calibrationCancelled() const	{return m_stop_asked || m_cancel_asked;}
+		void _setCalibrationProgress(int module, int step, int nb_steps, double eta);
+		void _calibrateHost();
+		void _stepITHL(int step);
+		//- chip argument of the xpci config loads (a mask, like the modules one) for all the chips
+		unsigned int _getAllChipsMask() const	{return (1U << m_chip_number) - 1;}
+		void _loadConfigG(unsigned long reg, unsigned long value);
+		void _loadAllConfigG(unsigned long modNum, unsigned long chipId, unsigned long* config_values);
+		void _loadFlatConfig(unsigned flat_value);
+		bool _queueLiveCommand(Camera::LiveCommandType type, unsigned long reg, long value,
+							   const vector<double>& values = vector<double>());
+		void _applyLiveCommands(bool reprogram_exposure);
+		void _endLive();
+		void _thresholdScan();
+		void _startScanJob(bool publish_frames);
+		void _endThresholdScan(ScanThread& scan_thread, const DetectorState& saved_state);
+		bool _acquireScanStep(SCurveAnalyzer& analyzer, int step, vector<void*>& image_array,
+							  Camera::HostCalibrationStats& stats, const Timestamp& t0, int nb_steps);
+
+		//- board
+		int				m_board_num;
+
+		//- acquisition thread
+		AcqThread*		m_acq_thread;
+		Camera::Job		m_job;
+		Camera::CalibrationProgress	m_calibration_progress;
+		Cond			m_cond;
+		bool			m_wait_flag;
+		bool			m_quit;
+		bool			m_thread_running;
+		unsigned long	m_acq_thread_cpu_mask;
+		int				m_acq_thread_rt_priority;
+
+		//- parameter updates between live frames
+		Mutex				m_live_lock;
+		bool				m_live_running;
+		deque<LiveCommand>	m_live_commands;
+		bool				m_live_snapshot_dirty;	//- acquisition thread only
+
+		//- pre-trigger circular acquisition
+		bool				m_circular;
+		int					m_circular_nb_pre_frames;
+		int					m_circular_nb_post_frames;
+		Mutex				m_circular_lock;
+		bool				m_circular_event;
+		long				m_circular_nb_ring_frames;
+
+		//- pump-probe phase binning
+		bool				m_phase_binning;
+		int					m_phase_nb_phases;
+		int					m_phase_nb_cycles;
+
+		//- threshold scan
+		Cond			m_scan_cond;
+		int				m_scan_ithl_min;
+		int				m_scan_nb_steps;
+		int				m_scan_nb_images;
+		int				m_scan_nb_steps_done;
+		bool			m_scan_mode;
+		int				m_scan_mode_ithl_min;
+		int				m_scan_mode_nb_steps;
+		int				m_scan_mode_nb_images;
+		bool			m_scan_publish_frames;
+		bool			m_scan_end;
+		bool			m_scan_failed;
+		int				m_scan_filled_step[2];		//- step held by each buffer, -1 if free
+		vector<char>	m_scan_buffers[2];
+		vector<void*>	m_scan_images[2];
+		SCurveAnalyzer	m_scan_counts;
+
+		//- control task
+		Timestamp			m_job_post_ts;			//- when the job was handed to the acquisition thread
+		double				m_control_latency;
+		double				m_last_stop_duration;
+
+		//- recovery
+		int						m_max_recovery_attempts;
+		Camera::RecoveryStep	m_recovery_step;
+		int						m_nb_recoveries;
+		double					m_last_recovery_time;
+
+		//- mirror of the programmed state
+		void _saveSnapshot();
+		void _exposureChanged();
+		bool _updateExposureState();
+		void _calibrationLoaded();
+		void _readBackDacl();
+		void _programState(const DetectorState& state);
+		bool _uploadCalibrationDiff(const string& path);
+		template <class Calib>
+		void _uploadCalibrationDiff(const Calib& calib, const string& path);
+		DetectorState& _getConfigSlot(unsigned long calibId);
+
+		Mutex								m_state_lock;
+		DetectorState						m_state;
+		map<unsigned long, DetectorState>	m_config_slots;		//- RAM slots (calibId) of the modules
+		string								m_snapshot_path;
+		Camera::UploadStats					m_upload_stats;
+		Camera::HostCalibrationParams		m_host_calibration_params;
+		Camera::HostCalibrationStats		m_host_calibration_stats;
+
+		//- host stages (sparse, integration, compression, ring, streaming) of the published frames
+		PublishThread*				m_publish_thread;
+		Cond						m_publish_cond;
+		vector<Camera::HostFrame>	m_host_frames;			//- queued frames, at most one lima ring
+		unsigned long				m_host_frames_queued;
+		unsigned long				m_host_frames_done;
+		bool						m_host_frames_failed;
+		bool						m_publish_quit;
+		vector<float>				m_host_profile;			//- profile streamed after the lock
+
 		//- lima stuff
+		FrameRing*			m_frame_ring;
+		string				m_frame_ring_name;
+		int					m_frame_ring_nb_slots;
+		FrameStreamer*		m_frame_streamer;
+		FrameCompressor		m_frame_compressor;
+		bool				m_compression;
+		int					m_compression_nb_threads;
+		Camera::CompressedFrameListener*	m_compressed_frame_listener;
+		SparseEncoder		m_sparse_encoder;
+		bool				m_sparse_output;
+		double				m_sparse_max_occupancy;
+		Camera::SparseFrameListener*		m_sparse_frame_listener;
+		bool				m_raw_mode;
+		AzimuthalIntegrator	m_integrator;
+		bool				m_integration;
+		bool				m_integration_stream_profile_only;
+		Mutex				m_integration_lock;
+		Camera::ProfileListener*	m_profile_listener;
+		DeadTimeCorrector	m_dead_time_corrector;
+		bool				m_dead_time_correction;
+		vector<double>		m_dead_time_tau_ns;
+		bool				m_float_output;
 		SoftBufferAllocMgr 	m_buffer_alloc_mgr;
 		StdBufferCbMgr 		m_buffer_cb_mgr;
 		BufferCtrlMgr 		m_buffer_ctrl_mgr;
@@ -196,12 +645,14 @@ namespace Xpad
         unsigned int    m_exp_time_usec;
 		int         	m_timeout_ms;
         bool            m_stop_asked;
+        bool            m_cancel_asked;
 
 
 		//---------------------------------
 		//- xpad stuff 
         Camera::XpadAcqType		m_acquisition_type;
         Camera::CalibrationType m_calibration_type;
+        bool                    m_calibration_per_module;
         unsigned int	        m_modules_mask;
         int				        m_module_number;
         unsigned int	        m_chip_number;
@@ -209,7 +660,8 @@ namespace Xpad
         vector<long>	        m_all_config_g;
         unsigned short 			m_xpad_model;
         string                  m_calibration_path;
-        //unsigned short*         m_dacl;
+        unsigned short*         m_dacl;             //- DACL read back from the modules (image layout)
+        bool                    m_dacl_cached;      //- false once the DACL is written (m_state_lock)
         //- Specific xpad stuff
         unsigned int m_time_between_images_usec; //- Temps entre chaque image
         unsigned int m_time_before_start_usec;     //- Temps initial
@@ -222,6 +674,17 @@ namespace Xpad
 	    unsigned int m_specific_param_GP3;
 	    unsigned int m_specific_param_GP4;
 
+        //- Readout model
+        Camera::ReadoutModel m_readout_model;
+        //- arguments of the last setExposureParameters (restored after a readout calibration)
+        unsigned int m_programmed_exposure[16];
+        bool    m_exposure_programmed;
+        void    _calibrateReadoutModel();
+        double  _measureReadoutUsec(IMG_TYPE pixel_depth, unsigned format, vector<void*>& image_array);
+        int     _getFrameSizeInBytes();
+        double  _getFrameDeadTimeUsec();
+        double  _getHostFrameTimeUsec();
+
         //---------------------------------
         Camera::Status	m_status;
 	};
@@ -0,0 +1,91 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADDEADTIMECORRECTION_H
+#define XPADDEADTIMECORRECTION_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class DeadTimeCorrector
+	* \brief paralyzable count-rate correction of the frames: the measured
+	*        counts n of a pixel are those of N true counts with n = N exp(-N tau / t)
+	*        (tau: dead time of its module, t: exposure time). The N of the counts
+	*        below LUT_SIZE are tabulated once per module, the others are solved
+	*        on the fly (Newton, a fixed number of iterations over all of them).
+	*        The correction is done while copying the frame (integers of its depth
+	*        rounded and saturated, or floats).
+	*******************************************************************/
+	class DeadTimeCorrector
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "DeadTimeCorrector", "Xpad");
+
+	public:
+		//- Counts tabulated (all of them for 16 bits pixels)
+		static const int LUT_SIZE = 65536;
+
+		DeadTimeCorrector();
+
+		//! Frames of nb_modules modules of module_nb_pixels pixels of depth bytes (2 or 4), counted
+		//! during exp_time (s). tau: dead time (s) of each module (0 -> counts as is), float_output:
+		//! floats instead of integers of depth bytes. The tables are only rebuilt on a change.
+		void init(int nb_modules, int module_nb_pixels, int depth, double exp_time,
+				  const std::vector<double>& tau, bool float_output);
+
+		//! Corrected copy of nb_pixels pixels, the first one being first_pixel of the frame
+		//! (src and dst point to it)
+		void correct(const void* src, void* dst, int first_pixel, int nb_pixels);
+
+		//! True counts of the counts of a module (measured counts beyond the maximum of
+		//! the model -> the true counts of this maximum)
+		void solve(int mod_idx, const double* counts, double* true_counts, int nb) const;
+
+	private:
+		template <class S, class D, class L>
+		void _correct(const S* src, D* dst, const L* lut, int mod_idx, int nb_pixels);
+
+		int						m_nb_modules;
+		int						m_module_nb_pixels;
+		int						m_depth;
+		double					m_exp_time;
+		bool					m_float_output;
+		std::vector<double>		m_tau;
+		std::vector<double>		m_rate_factor;		//- tau / t of each module
+		std::vector<float>		m_float_lut;		//- LUT_SIZE per module
+		std::vector<uint32_t>	m_int_lut;
+		//- counts beyond the tables
+		std::vector<int>		m_overflow_pos;
+		std::vector<double>		m_overflow_counts;
+		std::vector<double>		m_overflow_true_counts;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADDEADTIMECORRECTION_H
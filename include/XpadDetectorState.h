@@ -0,0 +1,131 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADDETECTORSTATE_H
+#define XPADDETECTORSTATE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	//- Geometry of a module
+	const int XPAD_NB_ROWS		= 120;		//- rows of a chip (and of a module)
+	const int XPAD_NB_COLUMNS	= 80;		//- columns of a chip
+
+	/*******************************************************************
+	* \class DetectorState
+	* \brief host mirror of what is programmed in the detector:
+	*        config G of each chip, DACL of each pixel, exposure parameters.
+	*        Modules are indexed in image order (index of the ready module).
+	*******************************************************************/
+	class DetectorState
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "DetectorState", "Xpad");
+
+	public:
+		//- Config G registers, in the order of Camera::loadAllConfigG values
+		enum ConfigGIndex {
+			CMOS_TP_IDX = 0, AMP_TP_IDX, ITHH_IDX, VADJ_IDX, VREF_IDX, IMFP_IDX,
+			IOTA_IDX, IPRE_IDX, ITHL_IDX, ITUNE_IDX, IBUFFER_IDX,
+			NB_CONFIG_G
+		};
+
+		//- Exposure and specific parameters (host side, programmed at each start)
+		struct ExposureParams {
+			uint32_t exp_time_usec;
+			uint32_t trigger_mode;
+			uint32_t format;
+			uint32_t deadtime_usec;
+			uint32_t init_usec;
+			uint32_t shutter_usec;
+			uint32_t ovf_usec;
+			uint32_t n;
+			uint32_t p;
+			uint32_t gp[4];
+		};
+
+		DetectorState();
+		void init(unsigned int modules_mask, int nb_modules, int nb_chips);
+
+		unsigned int getModulesMask() const	{return m_modules_mask;}
+		int getNbModules() const			{return m_nb_modules;}
+		int getNbChips() const				{return m_nb_chips;}
+		//! Index (in image order) of the module with this bit in the modules mask, -1 if not ready
+		int getModuleIndex(int module_bit) const;
+		//! Bit in the modules mask of the module at this index
+		int getModuleBit(int mod_idx) const;
+
+		//- Config G
+		//! Index of an xpix config G register, -1 if not mirrored
+		static int getConfigGIndex(unsigned long reg);
+		static unsigned long getConfigGReg(int index);
+		void setConfigG(int mod_idx, int chip, int index, unsigned long value);
+		void stepConfigG(int index, int step);
+		void invalidateConfigG();
+		bool isConfigGValid(int mod_idx, int chip, int index) const;
+		uint32_t getConfigG(int mod_idx, int chip, int index) const;
+
+		//- DACL (image layout, one value per pixel)
+		uint16_t* getDacl()					{return &m_dacl[0];}
+		const uint16_t* getDacl() const		{return &m_dacl[0];}
+		int getDaclSize() const				{return m_dacl.size();}
+		uint16_t* getDaclRow(int mod_idx, int chip, int row);
+		const uint16_t* getDaclRow(int mod_idx, int chip, int row) const;
+		void setDaclRowValid(int mod_idx, int chip, int row, bool valid);
+		bool isDaclRowValid(int mod_idx, int chip, int row) const;
+		void setDaclValid(bool valid);
+		bool isDaclValid(int mod_idx) const;
+
+		//! Copy the config G and DACL of a module from another state
+		void copyModule(const DetectorState& from, int mod_idx);
+
+		ExposureParams exposure;
+
+		//- Persistence (binary snapshot)
+		void save(const std::string& path) const;
+		//! false if missing, corrupted or not of this geometry
+		bool load(const std::string& path, unsigned int modules_mask, int nb_modules, int nb_chips);
+		static uint32_t checksum(const void* data, size_t size);
+
+	private:
+		int _configGPos(int mod_idx, int chip, int index) const;
+		int _rowPos(int mod_idx, int chip, int row) const;
+
+		unsigned int			m_modules_mask;
+		int						m_nb_modules;
+		int						m_nb_chips;
+		std::vector<uint32_t>	m_config_g;
+		std::vector<uint8_t>	m_config_g_valid;
+		std::vector<uint16_t>	m_dacl;
+		std::vector<uint8_t>	m_dacl_row_valid;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADDETECTORSTATE_H
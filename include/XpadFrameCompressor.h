@@ -0,0 +1,120 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADFRAMECOMPRESSOR_H
+#define XPADFRAMECOMPRESSOR_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+#include "ThreadUtils.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class FrameCompressor
+	* \brief bitshuffle + LZ4 compression of the frames, one chunk per module,
+	*        the chunks of a frame being compressed in parallel by a pool of
+	*        threads (and the calling one).
+	*        A chunk has the layout of the HDF5 bitshuffle filter (id 32008) with
+	*        LZ4: it can be written as is (H5Dwrite_chunk) in a dataset of one
+	*        module per chunk, or decoded by any bitshuffle/LZ4 reader:
+	*          uint64 module size (bytes), uint32 block size (8192 bytes), big endian,
+	*          then for each block: uint32 compressed size (big endian) and the
+	*          LZ4 block of the bitshuffled pixels (bit b of byte j of each group
+	*          of 8 pixels is plane 8 * j + b); the last block is cut to a
+	*          multiple of 8 pixels, the pixels left are copied as is at the end.
+	*******************************************************************/
+	class FrameCompressor
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "FrameCompressor", "Xpad");
+
+	public:
+		struct Stats {
+			unsigned long	nb_frames;
+			double			raw_mbytes;
+			double			compressed_mbytes;
+			double			duration;			//- s spent in compress
+		};
+
+		FrameCompressor();
+		~FrameCompressor();
+
+		//! Frames of nb_chunks chunks of chunk_size bytes (pixels of elem_size bytes),
+		//! nb_threads = 0 -> nb of online cpus. Resets the stats.
+		void init(int nb_chunks, int chunk_size, int elem_size, int nb_threads = 0);
+
+		//! Compress all the chunks of the image
+		void compress(const void* image);
+
+		int getNbChunks() const		{return m_nb_chunks;}
+		int getChunkSize() const	{return m_chunk_size;}
+		int getElemSize() const		{return m_elem_size;}
+		//! Compressed chunk of the last frame
+		const char* getChunk(int chunk, int& size) const;
+		int getCompressedSize() const;
+
+		void resetStats();
+		void getStats(Stats& stats) const;
+
+		//! Decompress a chunk in out (chunk_size bytes), false if the chunk is invalid
+		static bool decompress(const char* chunk, int size, void* out, int chunk_size, int elem_size);
+
+	private:
+		FrameCompressor(const FrameCompressor&);
+		FrameCompressor& operator=(const FrameCompressor&);
+
+		class Worker;
+		friend class Worker;
+
+		void _stopWorkers();
+		void _compressChunks(std::vector<char>& scratch);
+		int _compressChunk(const char* in, char* out, std::vector<char>& scratch);
+		static void _bitshuffle(const char* in, char* out, int size, int elem_size);
+		static void _bitunshuffle(const char* in, char* out, int size, int elem_size);
+
+		int						m_nb_chunks;
+		int						m_chunk_size;
+		int						m_elem_size;
+		int						m_chunk_capacity;
+		std::vector<char>		m_chunks;			//- [chunk][capacity]
+		std::vector<int>		m_chunk_sizes;
+		std::vector<char>		m_scratch;
+		std::vector<Worker*>	m_workers;
+		Stats					m_stats;
+
+		//- frame being compressed
+		Cond					m_cond;
+		bool					m_quit;
+		unsigned long			m_generation;
+		const char*				m_image;
+		volatile int			m_next_chunk;
+		int						m_nb_done;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADFRAMECOMPRESSOR_H
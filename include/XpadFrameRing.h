@@ -0,0 +1,135 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADFRAMERING_H
+#define XPADFRAMERING_H
+
+#include <stdint.h>
+#include <string>
+
+#include "Debug.h"
+#include "Exceptions.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* Layout of the ring (POSIX shared memory "/<name>"):
+	*   FrameRingHeader, then nb_slots slots of slot_size bytes, each one
+	*   starting with a FrameRingSlot followed by the image (64 bytes aligned).
+	* The writer never waits: slot.seq is odd while the slot is written and
+	* 2 * (n + 1) once frame n is in it, write_seq is the nb of frames written.
+	* A reader checks slot.seq before and after using a frame (seqlock).
+	*******************************************************************/
+	struct FrameRingHeader {
+		char				magic[8];
+		uint32_t			version;
+		uint32_t			header_size;
+		uint32_t			nb_slots;
+		uint32_t			slot_size;
+		uint32_t			frame_size;		//- bytes
+		uint32_t			width;
+		uint32_t			height;
+		uint32_t			depth;			//- bytes per pixel
+		volatile uint64_t	write_seq;		//- nb of frames written
+		volatile uint64_t	reader_seq;		//- nb of frames used by the acknowledging reader
+		volatile uint64_t	nb_overruns;	//- frames overwritten before the acknowledging reader used them
+	};
+
+	struct FrameRingSlot {
+		volatile uint64_t	seq;
+		int64_t				frame_nb;
+		double				timestamp;		//- s since the Epoch
+	};
+
+	/*******************************************************************
+	* \class FrameRing
+	* \brief writer of the shared memory ring (created and removed by the camera)
+	*******************************************************************/
+	class FrameRing
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "FrameRing", "Xpad");
+
+	public:
+		FrameRing(const std::string& name, int nb_slots, int width, int height, int depth);
+		~FrameRing();
+
+		const std::string& getName() const	{return m_name;}
+		int getFrameSize() const			{return m_header->frame_size;}
+		int getNbSlots() const				{return m_header->nb_slots;}
+
+		//! Copy the image of frame_nb in the next slot
+		void write(int frame_nb, double timestamp, const void* image);
+		//! Frames written, overruns and lag of the acknowledging reader
+		void getStats(uint64_t& nb_written, uint64_t& nb_overruns, uint64_t& lag) const;
+
+	private:
+		FrameRing(const FrameRing&);
+		FrameRing& operator=(const FrameRing&);
+
+		std::string			m_name;
+		size_t				m_size;
+		FrameRingHeader*	m_header;
+	};
+
+	/*******************************************************************
+	* \class FrameRingReader
+	* \brief reader of the shared memory ring, for the external processes:
+	*        frames are used in place, without copy.
+	*        acknowledge: map the ring read-write to publish the reader position
+	*        (reader_seq) so that the camera counts the overruns and the lag.
+	*******************************************************************/
+	class FrameRingReader
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "FrameRingReader", "Xpad");
+
+	public:
+		FrameRingReader(const std::string& name, bool acknowledge = false);
+		~FrameRingReader();
+
+		const FrameRingHeader& getHeader() const	{return *m_header;}
+
+		//! Next frame (NULL if none yet): valid until releaseFrame
+		const void* getNextFrame(int& frame_nb, double& timestamp);
+		//! false if the frame was overwritten while it was used
+		bool releaseFrame();
+
+		uint64_t getNbOverruns() const	{return m_nb_overruns;}
+		uint64_t getLag() const			{return m_header->write_seq - m_seq;}
+
+	private:
+		FrameRingReader(const FrameRingReader&);
+		FrameRingReader& operator=(const FrameRingReader&);
+
+		const FrameRingSlot* _getSlot(uint64_t seq) const;
+
+		size_t				m_size;
+		FrameRingHeader*	m_header;
+		bool				m_acknowledge;
+		uint64_t			m_seq;			//- next frame to read
+		uint64_t			m_nb_overruns;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADFRAMERING_H
@@ -0,0 +1,143 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADFRAMESTREAMER_H
+#define XPADFRAMESTREAMER_H
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <deque>
+
+#include "Debug.h"
+#include "Exceptions.h"
+#include "ThreadUtils.h"
+
+struct iovec;
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class FrameStreamer
+	* \brief streaming of the published frames to local clients.
+	*        address: "unix:<path>" (or a path) or "tcp:<port>" (loopback only).
+	*        Each frame is sent as a FrameHeader followed by its data (the image,
+	*        the sparse pairs, the compressed chunks or the profile), with one
+	*        sendmsg of all the parts.
+	*        A client may send one policy byte right after connecting ('B' block,
+	*        'D' drop oldest, 'S' skip to latest), else it gets the default policy.
+	*        block: the data is sent from the publication path (publication waits,
+	*        a client reading nothing for 2 s or when the acquisition is stopped is disconnected)
+	*        drop oldest / skip to latest: the data is kept (one copy shared by
+	*        these clients) in the queue of each client, sent by its own thread.
+	*******************************************************************/
+	class FrameStreamer
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "FrameStreamer", "Xpad");
+
+	public:
+		enum Policy {
+			BLOCK, DROP_OLDEST, SKIP_TO_LATEST
+		};
+
+		//- Sent before the data of each frame (little endian, 40 bytes)
+		enum DataType {
+			UINT16 = 0, UINT32,
+			SPARSE_UINT32,		//- nb hits uint32 pixel indices then nb hits uint32 counts
+			FLOAT32,			//- 1-D profile (width bins, height 1)
+			BSLZ4_UINT16,		//- uint32 nb chunks, the uint32 size of each chunk, then the chunks:
+			BSLZ4_UINT32		//- modules top to bottom, HDF5 bitshuffle/LZ4 filter layout (see FrameCompressor)
+		};
+		struct FrameHeader {
+			uint32_t	magic;			//- FRAME_MAGIC
+			uint32_t	header_size;
+			int64_t		frame_nb;
+			double		timestamp;		//- s since the Epoch
+			uint32_t	dtype;			//- DataType
+			uint32_t	width;
+			uint32_t	height;
+			uint32_t	data_size;		//- bytes of the data following the header
+		};
+		static const uint32_t FRAME_MAGIC = 0x44415058;		//- "XPAD"
+		enum {MAX_CHUNKS = 32};
+
+		struct Stats {
+			int				nb_clients;
+			unsigned long	nb_sent;		//- frames sent (all clients)
+			unsigned long	nb_dropped;		//- frames not sent to a slow client
+		};
+
+		FrameStreamer(const std::string& address, Policy default_policy, int queue_depth);
+		~FrameStreamer();
+
+		const std::string& getAddress() const	{return m_address;}
+
+		//! Send the image to the clients (image is not used after the call)
+		void sendFrame(int frame_nb, double timestamp, const void* image,
+					   int width, int height, int depth);
+		//! Send the (pixel index, count) pairs of the hit pixels of a width x height frame
+		void sendSparseFrame(int frame_nb, double timestamp, const uint32_t* indices,
+							 const uint32_t* counts, int nb_hits, int width, int height);
+		//! Send the compressed chunks (one per module, at most MAX_CHUNKS) of a width x height frame
+		void sendCompressedFrame(int frame_nb, double timestamp, const char* const* chunks,
+								 const int* chunk_sizes, int nb_chunks, int width, int height, int depth);
+		//! Send the 1-D profile (azimuthal integration) of a frame
+		void sendProfile(int frame_nb, double timestamp, const float* profile, int nb_bins);
+		//! Disconnect the blocking clients a frame is being sent to (stop of the acquisition)
+		void interruptBlockingSends();
+		void getStats(Stats& stats);
+
+	private:
+		FrameStreamer(const FrameStreamer&);
+		FrameStreamer& operator=(const FrameStreamer&);
+
+		struct Frame;
+		class Client;
+		class AcceptThread;
+		friend class Client;
+		friend class AcceptThread;
+
+		enum {MAX_PARTS = MAX_CHUNKS + 1};
+
+		void _accept();
+		void _sendFrame(FrameHeader& header, const struct iovec* parts, int nb_parts);
+		static bool _send(int fd, const FrameHeader& header, const struct iovec* parts, int nb_parts);
+		void _releaseFrame(Frame* frame);
+
+		std::string				m_address;
+		std::string				m_unix_path;
+		Policy					m_default_policy;
+		int						m_queue_depth;
+		int						m_listen_fd;
+		Cond					m_cond;
+		bool					m_quit;
+		std::list<Client*>		m_clients;
+		AcceptThread*			m_accept_thread;
+		unsigned long			m_nb_sent;
+		unsigned long			m_nb_dropped;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADFRAMESTREAMER_H
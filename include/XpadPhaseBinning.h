@@ -0,0 +1,72 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADPHASEBINNING_H
+#define XPADPHASEBINNING_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class PhaseAccumulator
+	* \brief per phase sums of the frames of a pump-probe phase binning
+	*        block: 32 bits sums (saturated) of the 16 or 32 bits frames.
+	*******************************************************************/
+	class PhaseAccumulator
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "PhaseAccumulator", "Xpad");
+
+	public:
+		PhaseAccumulator();
+
+		//! Sums of nb_phases phases of nb_pixels pixels, reset
+		void init(int nb_pixels, int nb_phases);
+		void reset();
+
+		int getNbPixels() const		{return m_nb_pixels;}
+		int getNbPhases() const		{return m_nb_phases;}
+
+		//! Add a frame to the sums of phase
+		void addFrame(int phase, const void* frame, bool is_32_bits);
+		const uint32_t* getSums(int phase) const	{return &m_sums[size_t(phase) * m_nb_pixels];}
+		//! Sums of phase as a frame: 32 bits, or 16 bits saturated
+		void getFrame(int phase, void* frame, bool is_32_bits) const;
+
+	private:
+		template <class T>
+		void _add(uint32_t* sums, const T* pixels);
+
+		int						m_nb_pixels;
+		int						m_nb_phases;
+		std::vector<uint32_t>	m_sums;		//- [phase][pixel]
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADPHASEBINNING_H
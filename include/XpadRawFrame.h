@@ -0,0 +1,58 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADRAWFRAME_H
+#define XPADRAWFRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* Native line format of the driver (16 bits words): the lines of the
+	* modules are interleaved (line 1 of each module, then line 2...), each
+	* one being RAW_LINE_HEADER words, the 80 * nb_chips pixels and
+	* RAW_LINE_FOOTER words. Word RAW_MODULE_WORD of the header is the index
+	* of the module in the image, word RAW_ROW_WORD the row (from 1).
+	*******************************************************************/
+	const int RAW_LINE_HEADER	= 5;
+	const int RAW_LINE_FOOTER	= 1;
+	const int RAW_MODULE_WORD	= 1;
+	const int RAW_ROW_WORD		= 4;
+
+	//! Words of a raw line
+	int getRawLineWords(int nb_chips);
+	//! Bytes of a raw frame
+	size_t getRawFrameSize(int nb_modules, int nb_chips);
+
+	//! Offline reassembly of a frame dumped in the native line format (not the images
+	//! published by the camera, raw mode included, which are in image order) with the modules stacked:
+	//! lines are placed by their header, the lines with an invalid header are skipped
+	//! and the pixels of the lines never placed are 0. Returns the nb of lines placed.
+	int reassembleRawFrame(const uint16_t* raw, uint16_t* image, int nb_modules, int nb_chips);
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADRAWFRAME_H
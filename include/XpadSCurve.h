@@ -0,0 +1,110 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADSCURVE_H
+#define XPADSCURVE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+#include "ThreadUtils.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class SCurveAnalyzer
+	* \brief per pixel S-curve of a threshold scan (ITHL or DACL steps):
+	*        accumulates the noise counts of each step and finds, for each
+	*        pixel, the first step where the noise counts reach a threshold.
+	*        Both are run by a pool of nb_threads threads (the calling one included),
+	*        kept from one frame to the next, each one taking blocks of pixels.
+	*******************************************************************/
+	class SCurveAnalyzer
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "SCurveAnalyzer", "Xpad");
+
+	public:
+		SCurveAnalyzer();
+		~SCurveAnalyzer();
+
+		//! Reset the counts of a scan of nb_steps steps (nb_threads = 0 -> nb of online cpus),
+		//! the pool is only restarted if the nb of threads changed
+		void init(int nb_pixels, int nb_steps, int nb_threads = 0);
+
+		int getNbPixels() const		{return m_nb_pixels;}
+		int getNbSteps() const		{return m_nb_steps;}
+		int getNbThreads() const	{return m_nb_threads;}
+
+		//! Add an image (16 or 32 bits counters, image order) to the counts of step
+		void addFrame(int step, const void* frame, bool is_32_bits);
+		const uint32_t* getCounts(int step) const	{return &m_counts[step * m_nb_pixels];}
+
+		//! First step where the counts reach noise_counts for each pixel, -1 if never reached
+		void findEdges(uint32_t noise_counts, std::vector<int32_t>& edges);
+
+		//! Time (s) spent in addFrame and findEdges since init
+		double getAnalysisDuration() const	{return m_analysis_duration;}
+
+	private:
+		SCurveAnalyzer(const SCurveAnalyzer&);
+		SCurveAnalyzer& operator=(const SCurveAnalyzer&);
+
+		class Worker;
+		friend class Worker;
+
+		enum Job {
+			ADD_FRAME_16, ADD_FRAME_32, FIND_EDGES
+		};
+
+		void _stopWorkers();
+		void _run(Job job);
+		void _runBlocks();
+		void _runBlock(Job job, int begin, int end);
+
+		int						m_nb_pixels;
+		int						m_nb_steps;
+		int						m_nb_threads;
+		std::vector<uint32_t>	m_counts;			//- [step][pixel]
+		double					m_analysis_duration;
+		std::vector<Worker*>	m_workers;
+
+		//- running job
+		Cond					m_cond;
+		bool					m_quit;
+		unsigned long			m_generation;
+		Job						m_job;
+		int						m_nb_blocks;
+		volatile int			m_next_block;
+		int						m_nb_done;
+		int						m_step;
+		const void*				m_frame;
+		uint32_t				m_noise_counts;
+		int32_t*				m_edges;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADSCURVE_H
@@ -0,0 +1,88 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADSPARSEFRAME_H
+#define XPADSPARSEFRAME_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Debug.h"
+#include "Exceptions.h"
+
+namespace lima
+{
+namespace Xpad
+{
+	/*******************************************************************
+	* \class SparseEncoder
+	* \brief (pixel index, count) pairs of the hit pixels of a frame, for the
+	*        low flux acquisitions. The frame is kept dense when more than
+	*        max_occupancy of its pixels are hit.
+	*******************************************************************/
+	class SparseEncoder
+	{
+		DEB_CLASS_NAMESPC(DebModCamera, "SparseEncoder", "Xpad");
+
+	public:
+		struct Stats {
+			unsigned long	nb_frames;
+			unsigned long	nb_sparse;		//- frames encoded as pairs
+			double			hit_bytes;		//- bytes of the pairs of the sparse frames
+			double			dense_bytes;	//- bytes of these frames if dense
+		};
+
+		SparseEncoder();
+
+		//! Frames of nb_pixels pixels of depth bytes (2 or 4), max_occupancy in [0, 1]. Resets the stats.
+		void init(int nb_pixels, int depth, double max_occupancy);
+
+		//! Encode a frame, false if it has to be kept dense
+		bool encode(const void* image);
+
+		int getNbHits() const				{return m_nb_hits;}
+		const uint32_t* getIndices() const	{return &m_indices[0];}
+		const uint32_t* getCounts() const	{return &m_counts[0];}
+
+		void resetStats();
+		void getStats(Stats& stats) const	{stats = m_stats;}
+
+		//! Dense image (nb_pixels pixels of depth bytes) of the pairs
+		static void decode(const uint32_t* indices, const uint32_t* counts, int nb_hits,
+						   void* image, int nb_pixels, int depth);
+
+	private:
+		template <class T>
+		bool _encode(const T* image);
+
+		int						m_nb_pixels;
+		int						m_depth;
+		int						m_max_hits;
+		int						m_nb_hits;
+		std::vector<uint32_t>	m_indices;
+		std::vector<uint32_t>	m_counts;
+		Stats					m_stats;
+	};
+
+} // namespace Xpad
+} // namespace lima
+
+#endif // XPADSPARSEFRAME_H
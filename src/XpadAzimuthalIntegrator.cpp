@@ -0,0 +1,310 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadAzimuthalIntegrator.h"
+#include "Timestamp.h"
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int BINS_PER_BLOCK = 32;		//- bins taken at once by a thread
+
+//---------------------------
+//- Worker: integrates blocks of bins of each new frame until the integrator stops it
+//---------------------------
+class AzimuthalIntegrator::Worker : public Thread
+{
+public:
+	Worker(AzimuthalIntegrator& integrator) : m_integrator(integrator) {}
+
+protected:
+	virtual void threadFunction()
+	{
+		AutoMutex aLock(m_integrator.m_cond.mutex());
+		unsigned long generation = m_integrator.m_generation;
+		while (true)
+		{
+			while (!m_integrator.m_quit && m_integrator.m_generation == generation)
+				m_integrator.m_cond.wait();
+			if (m_integrator.m_quit)
+				break;
+			generation = m_integrator.m_generation;
+
+			aLock.unlock();
+			m_integrator._integrateBins();
+			aLock.lock();
+		}
+	}
+
+private:
+	AzimuthalIntegrator&	m_integrator;
+};
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+AzimuthalIntegrator::AzimuthalIntegrator() :
+m_nb_bins(0),
+m_integration_duration(0.),
+m_quit(false),
+m_generation(0),
+m_frame(NULL),
+m_is_32_bits(false),
+m_next_block(0),
+m_nb_blocks(0),
+m_nb_done(0)
+{
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+AzimuthalIntegrator::~AzimuthalIntegrator()
+{
+	_stopWorkers();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void AzimuthalIntegrator::_stopWorkers()
+{
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_quit = true;
+		m_cond.broadcast();
+	}
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i]->join();
+		delete m_workers[i];
+	}
+	m_workers.clear();
+	m_quit = false;
+}
+
+//-----------------------------------------------------
+//		Pixel splitting: the weight of a pixel in a bin is the part of
+//		its 2theta range [min, max of its corners] in the bin
+//-----------------------------------------------------
+void AzimuthalIntegrator::init(const Geometry& geometry, int width, int height, int nb_threads)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(geometry.distance, geometry.nb_bins, width, height);
+
+	if (geometry.distance <= 0. || geometry.pixel_size_x <= 0. || geometry.pixel_size_y <= 0. ||
+		geometry.nb_bins < 1 || width < 1 || height < 1)
+		throw LIMA_HW_EXC(InvalidValue, "Azimuthal integration: invalid geometry");
+
+	_stopWorkers();
+
+	//- 1. 2theta range of each pixel (deg)
+	int nb_pixels = width * height;
+	double size_x = geometry.pixel_size_x * 1e-3;		//- mm
+	double size_y = geometry.pixel_size_y * 1e-3;
+	vector<float> tth_low(nb_pixels), tth_high(nb_pixels);
+	for (int y = 0; y < height; y++)
+	{
+		double dy[2] = {(y - geometry.center_y) * size_y, (y + 1 - geometry.center_y) * size_y};
+		bool center_row = (dy[0] <= 0. && dy[1] >= 0.);
+		for (int x = 0; x < width; x++)
+		{
+			double dx[2] = {(x - geometry.center_x) * size_x, (x + 1 - geometry.center_x) * size_x};
+			bool center_col = (dx[0] <= 0. && dx[1] >= 0.);
+			double r_min = 1e300, r_max = 0.;
+			for (int i = 0; i < 2; i++)
+				for (int j = 0; j < 2; j++)
+				{
+					double r = sqrt(dx[i] * dx[i] + dy[j] * dy[j]);
+					r_min = min(r_min, r);
+					r_max = max(r_max, r);
+				}
+			//- the radius is minimal on an edge when the center is in front of the pixel
+			if (center_row && center_col)
+				r_min = 0.;
+			else if (center_row)
+				r_min = min(fabs(dx[0]), fabs(dx[1]));
+			else if (center_col)
+				r_min = min(fabs(dy[0]), fabs(dy[1]));
+			tth_low[y * width + x]	= atan2(r_min, geometry.distance) * 180. / M_PI;
+			tth_high[y * width + x]	= atan2(r_max, geometry.distance) * 180. / M_PI;
+		}
+	}
+
+	double tth_min = geometry.tth_min, tth_max = geometry.tth_max;
+	if (tth_min >= tth_max)
+	{
+		tth_min = *min_element(tth_low.begin(), tth_low.end());
+		tth_max = *max_element(tth_high.begin(), tth_high.end());
+	}
+	m_nb_bins = geometry.nb_bins;
+	double bin_width = (tth_max - tth_min) / m_nb_bins;
+
+	m_axis.resize(m_nb_bins);
+	for (int bin = 0; bin < m_nb_bins; bin++)
+		m_axis[bin] = tth_min + (bin + 0.5) * bin_width;
+
+	//- 2. CSR matrix: entries counted then filled bin by bin
+	m_bin_ptr.assign(m_nb_bins + 1, 0);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		vector<int32_t> fill;
+		if (pass == 1)
+		{
+			for (int bin = 0; bin < m_nb_bins; bin++)
+				m_bin_ptr[bin + 1] += m_bin_ptr[bin];
+			m_pixels.resize(m_bin_ptr[m_nb_bins]);
+			m_weights.resize(m_bin_ptr[m_nb_bins]);
+			fill.assign(m_bin_ptr.begin(), m_bin_ptr.end() - 1);
+		}
+
+		for (int pix = 0; pix < nb_pixels; pix++)
+		{
+			double low = (tth_low[pix] - tth_min) / bin_width;
+			double high = (tth_high[pix] - tth_min) / bin_width;
+			if (high <= 0. || low >= m_nb_bins)
+				continue;
+			int first = max(int(floor(low)), 0);
+			int last = min(int(floor(high)), m_nb_bins - 1);
+			double span = high - low;
+			for (int bin = first; bin <= last; bin++)
+			{
+				double weight = (span > 0.) ? (min(high, bin + 1.) - max(low, double(bin))) / span : 1.;
+				if (weight <= 0.)
+					continue;
+				if (pass == 0)
+					m_bin_ptr[bin + 1]++;
+				else
+				{
+					m_pixels[fill[bin]] = pix;
+					m_weights[fill[bin]] = weight;
+					fill[bin]++;
+				}
+			}
+		}
+	}
+
+	m_norm.assign(m_nb_bins, 0.f);
+	for (int bin = 0; bin < m_nb_bins; bin++)
+	{
+		double sum = 0.;
+		for (int k = m_bin_ptr[bin]; k < m_bin_ptr[bin + 1]; k++)
+			sum += m_weights[k];
+		m_norm[bin] = (sum > 0.) ? 1. / sum : 0.;
+	}
+	m_profile.assign(m_nb_bins, 0.f);
+	m_nb_blocks = (m_nb_bins + BINS_PER_BLOCK - 1) / BINS_PER_BLOCK;
+	m_integration_duration = 0.;
+	DEB_TRACE() << "Azimuthal integration: " << m_pixels.size() << " entries for " << m_nb_bins << " bins";
+
+	//- the calling thread is one of the nb_threads
+	if (nb_threads <= 0)
+		nb_threads = max(int(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+	nb_threads = min(nb_threads, m_nb_blocks);
+	for (int i = 1; i < nb_threads; i++)
+	{
+		Worker* worker = new Worker(*this);
+		worker->start();
+		m_workers.push_back(worker);
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void AzimuthalIntegrator::integrate(const void* frame, bool is_32_bits)
+{
+	DEB_MEMBER_FUNCT();
+
+	if (!m_nb_bins)
+		throw LIMA_HW_EXC(Error, "Azimuthal integration: not initialized");
+
+	Timestamp t0 = Timestamp::now();
+
+	AutoMutex aLock(m_cond.mutex());
+	m_frame		 = frame;
+	m_is_32_bits = is_32_bits;
+	m_nb_done	 = 0;
+	__sync_synchronize();
+	m_next_block = 0;
+	m_generation++;
+	m_cond.broadcast();
+	aLock.unlock();
+
+	_integrateBins();
+
+	aLock.lock();
+	while (m_nb_done < m_nb_blocks)
+		m_cond.wait();
+	aLock.unlock();
+
+	m_integration_duration += Timestamp::now() - t0;
+}
+
+//-----------------------------------------------------
+//		Take the blocks of bins of the current frame until none is left
+//-----------------------------------------------------
+void AzimuthalIntegrator::_integrateBins()
+{
+	int nb_done = 0;
+	int block;
+	while ((block = __sync_fetch_and_add(&m_next_block, 1)) < m_nb_blocks)
+	{
+		int begin = block * BINS_PER_BLOCK;
+		int end = min(begin + BINS_PER_BLOCK, m_nb_bins);
+		if (m_is_32_bits)
+			_integrateBins(static_cast<const uint32_t*>(m_frame), begin, end);
+		else
+			_integrateBins(static_cast<const uint16_t*>(m_frame), begin, end);
+		nb_done++;
+	}
+
+	if (nb_done)
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_nb_done += nb_done;
+		m_cond.broadcast();
+	}
+}
+
+//-----------------------------------------------------
+//		SpMV of a block of bins: branch free dot product of each row
+//-----------------------------------------------------
+template <class T>
+void AzimuthalIntegrator::_integrateBins(const T* frame, int begin, int end)
+{
+	if (m_pixels.empty())
+		return;
+	const int32_t* pixels = &m_pixels[0];
+	const float* weights = &m_weights[0];
+	for (int bin = begin; bin < end; bin++)
+	{
+		float sum = 0.f;
+		for (int k = m_bin_ptr[bin]; k < m_bin_ptr[bin + 1]; k++)
+			sum += weights[k] * float(frame[pixels[k]]);
+		m_profile[bin] = sum * m_norm[bin];
+	}
+}
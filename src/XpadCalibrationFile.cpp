@@ -0,0 +1,405 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadCalibrationFile.h"
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const char		CALIB_MAGIC[8]	= {'X','P','A','D','C','A','L','B'};
+static const uint32_t	CALIB_VERSION	= 1;
+static const size_t		CALIB_ALIGN		= 64;
+static const char		TEXT_INDEX_NAME[]	= "xpad_calibration.txt";
+static const char		TEXT_MAGIC[]		= "XPADCALIB-TEXT";
+static const int		TEXT_VERSION		= 1;
+
+//- Binary calibration file header
+struct CalibHeader {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	header_size;
+	uint32_t	modules_mask;
+	uint32_t	nb_modules;
+	uint32_t	nb_chips;
+	uint32_t	nb_config_g;
+	uint64_t	config_g_offset;
+	uint64_t	dacl_offset;
+	uint64_t	file_size;
+	uint64_t	creation_time;
+	uint32_t	checksum;			//- of the bytes after the header
+	uint32_t	reserved;
+	char		description[128];
+};
+
+static size_t alignOffset(size_t offset)
+{
+	return (offset + CALIB_ALIGN - 1) / CALIB_ALIGN * CALIB_ALIGN;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+string CalibrationFile::_fileName(const string& path, const char* prefix, int mod_num)
+{
+	ostringstream name;
+	name << path << "/" << prefix << "_mod" << mod_num << ".txt";
+	return name.str();
+}
+
+//-----------------------------------------------------
+//		Read the text calibration of the modules of calib
+//-----------------------------------------------------
+bool CalibrationFile::readText(const string& path, DetectorState& calib)
+{
+	DEB_STATIC_FUNCT();
+
+	//- index: only the calibrations written in this layout are read
+	string index_name = path + "/" + TEXT_INDEX_NAME;
+	ifstream index_file(index_name.c_str());
+	if (!index_file)
+	{
+		DEB_TRACE() << path << " has no " << TEXT_INDEX_NAME << ": not a text calibration of this layout";
+		return false;
+	}
+	string magic, key_mask, key_chips;
+	int version = 0, nb_chips = 0;
+	unsigned int modules_mask = 0;
+	index_file >> magic >> version >> key_mask >> std::hex >> modules_mask >> std::dec >> key_chips >> nb_chips;
+	if (!index_file || magic != TEXT_MAGIC || version != TEXT_VERSION ||
+		key_mask != "modules_mask" || key_chips != "nb_chips")
+	{
+		DEB_WARNING() << index_name << " is not a valid calibration index (version " << TEXT_VERSION << ")";
+		return false;
+	}
+	if (modules_mask != calib.getModulesMask() || nb_chips != calib.getNbChips())
+	{
+		DEB_WARNING() << path << " is a calibration of another detector geometry (modules mask "
+					  << std::hex << modules_mask << ")";
+		return false;
+	}
+
+	for (int mod_idx = 0; mod_idx < calib.getNbModules(); mod_idx++)
+	{
+		int mod_num = calib.getModuleBit(mod_idx) + 1;
+
+		//- DACL
+		string dacl_name = _fileName(path, "dacl", mod_num);
+		ifstream dacl_file(dacl_name.c_str());
+		if (!dacl_file)
+		{
+			DEB_TRACE() << dacl_name << " not found";
+			return false;
+		}
+		for (int row = 0; row < XPAD_NB_ROWS; row++)
+		{
+			for (int chip = 0; chip < calib.getNbChips(); chip++)
+			{
+				uint16_t* dacl_row = calib.getDaclRow(mod_idx, chip, row);
+				for (int col = 0; col < XPAD_NB_COLUMNS; col++)
+					dacl_file >> dacl_row[col];
+				calib.setDaclRowValid(mod_idx, chip, row, true);
+			}
+		}
+		if (!dacl_file)
+		{
+			DEB_WARNING() << dacl_name << " is not a valid DACL file";
+			return false;
+		}
+
+		//- config G
+		string configg_name = _fileName(path, "configg", mod_num);
+		ifstream configg_file(configg_name.c_str());
+		if (!configg_file)
+		{
+			DEB_TRACE() << configg_name << " not found";
+			return false;
+		}
+		for (int chip = 0; chip < calib.getNbChips(); chip++)
+		{
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+			{
+				unsigned long value = 0;
+				configg_file >> value;
+				calib.setConfigG(mod_idx, chip, index, value);
+			}
+		}
+		if (!configg_file)
+		{
+			DEB_WARNING() << configg_name << " is not a valid config G file";
+			return false;
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------------------
+//		Write the text calibration of the modules of calib
+//-----------------------------------------------------
+void CalibrationFile::writeText(const string& path, const DetectorState& calib)
+{
+	DEB_STATIC_FUNCT();
+
+	for (int mod_idx = 0; mod_idx < calib.getNbModules(); mod_idx++)
+	{
+		int mod_num = calib.getModuleBit(mod_idx) + 1;
+
+		string dacl_name = _fileName(path, "dacl", mod_num);
+		ofstream dacl_file(dacl_name.c_str());
+		for (int row = 0; row < XPAD_NB_ROWS; row++)
+		{
+			for (int chip = 0; chip < calib.getNbChips(); chip++)
+			{
+				const uint16_t* dacl_row = calib.getDaclRow(mod_idx, chip, row);
+				for (int col = 0; col < XPAD_NB_COLUMNS; col++)
+					dacl_file << dacl_row[col] << " ";
+			}
+			dacl_file << "\n";
+		}
+
+		string configg_name = _fileName(path, "configg", mod_num);
+		ofstream configg_file(configg_name.c_str());
+		for (int chip = 0; chip < calib.getNbChips(); chip++)
+		{
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+				configg_file << calib.getConfigG(mod_idx, chip, index) << " ";
+			configg_file << "\n";
+		}
+
+		if (!dacl_file || !configg_file)
+			throw LIMA_HW_EXC(Error, "Can not write the calibration files");
+	}
+
+	//- the index is written last: an interrupted write is not taken for a calibration
+	string index_name = path + "/" + TEXT_INDEX_NAME;
+	ofstream index_file(index_name.c_str());
+	index_file << TEXT_MAGIC << " " << TEXT_VERSION << "\n"
+			   << "modules_mask " << std::hex << "0x" << calib.getModulesMask() << std::dec << "\n"
+			   << "nb_chips " << calib.getNbChips() << "\n";
+	if (!index_file)
+		throw LIMA_HW_EXC(Error, "Can not write the calibration index");
+}
+
+//-----------------------------------------------------
+//		Write the binary calibration of the modules of calib
+//-----------------------------------------------------
+void CalibrationFile::writeBinary(const string& file_name, const DetectorState& calib, const string& description)
+{
+	DEB_STATIC_FUNCT();
+
+	CalibHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CALIB_MAGIC, sizeof(header.magic));
+	header.version			= CALIB_VERSION;
+	header.header_size		= sizeof(header);
+	header.modules_mask		= calib.getModulesMask();
+	header.nb_modules		= calib.getNbModules();
+	header.nb_chips			= calib.getNbChips();
+	header.nb_config_g		= DetectorState::NB_CONFIG_G;
+	header.config_g_offset	= alignOffset(sizeof(header));
+	size_t config_g_size	= size_t(header.nb_modules) * header.nb_chips * DetectorState::NB_CONFIG_G * sizeof(uint32_t);
+	header.dacl_offset		= alignOffset(header.config_g_offset + config_g_size);
+	header.file_size		= header.dacl_offset + calib.getDaclSize() * sizeof(uint16_t);
+	header.creation_time	= time(NULL);
+	strncpy(header.description, description.c_str(), sizeof(header.description) - 1);
+
+	vector<char> data(header.file_size, 0);
+	uint32_t* config_g = reinterpret_cast<uint32_t*>(&data[header.config_g_offset]);
+	for (int mod_idx = 0; mod_idx < calib.getNbModules(); mod_idx++)
+		for (int chip = 0; chip < calib.getNbChips(); chip++)
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+				*config_g++ = calib.getConfigG(mod_idx, chip, index);
+	memcpy(&data[header.dacl_offset], calib.getDacl(), calib.getDaclSize() * sizeof(uint16_t));
+
+	header.checksum = DetectorState::checksum(&data[sizeof(header)], data.size() - sizeof(header));
+	memcpy(&data[0], &header, sizeof(header));
+
+	string tmp_name = file_name + ".tmp";
+	ofstream file(tmp_name.c_str(), ios::out | ios::binary | ios::trunc);
+	file.write(&data[0], data.size());
+	file.close();
+	if (!file || rename(tmp_name.c_str(), file_name.c_str()) != 0)
+		throw LIMA_HW_EXC(Error, "Can not write the binary calibration file");
+
+	DEB_TRACE() << "Binary calibration written in " << file_name << " (" << data.size() << " bytes)";
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void CalibrationFile::textToBinary(const string& path, const string& file_name,
+								   unsigned int modules_mask, int nb_chips)
+{
+	DEB_STATIC_FUNCT();
+
+	int nb_modules = 0;
+	for (int bit = 0; bit < 32; bit++)
+		if (modules_mask & (1U << bit))
+			nb_modules++;
+
+	DetectorState calib;
+	calib.init(modules_mask, nb_modules, nb_chips);
+	if (!readText(path, calib))
+		throw LIMA_HW_EXC(Error, "Can not read the text calibration: not written by this plugin (xpix OTN calibrations can not be converted) or invalid");
+	writeBinary(file_name, calib, path);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void CalibrationFile::binaryToText(const string& file_name, const string& path)
+{
+	DEB_STATIC_FUNCT();
+
+	CalibrationMap map(file_name);
+	DetectorState calib;
+	calib.init(map.getModulesMask(), map.getNbModules(), map.getNbChips());
+	map.copyTo(calib);
+	writeText(path, calib);
+}
+
+//-----------------------------------------------------
+//		Map the file and check its header (and checksum if verify)
+//-----------------------------------------------------
+CalibrationMap::CalibrationMap(const string& file_name, bool verify) :
+m_base(MAP_FAILED),
+m_size(0)
+{
+	DEB_CONSTRUCTOR();
+	DEB_PARAM() << DEB_VAR2(file_name, verify);
+
+	int fd = open(file_name.c_str(), O_RDONLY);
+	struct stat file_stat;
+	if (fd < 0 || fstat(fd, &file_stat) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		throw LIMA_HW_EXC(Error, "Can not open the binary calibration file");
+	}
+	m_size = file_stat.st_size;
+	if (m_size >= sizeof(CalibHeader))
+		m_base = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (m_base == MAP_FAILED)
+		throw LIMA_HW_EXC(Error, "Can not map the binary calibration file");
+
+	const char* data = static_cast<const char*>(m_base);
+	const CalibHeader* header = reinterpret_cast<const CalibHeader*>(data);
+	size_t config_g_size = size_t(header->nb_modules) * header->nb_chips * DetectorState::NB_CONFIG_G * sizeof(uint32_t);
+	size_t dacl_size = size_t(header->nb_modules) * XPAD_NB_ROWS * header->nb_chips * XPAD_NB_COLUMNS * sizeof(uint16_t);
+	bool valid = memcmp(header->magic, CALIB_MAGIC, sizeof(header->magic)) == 0 &&
+				 header->version == CALIB_VERSION &&
+				 header->header_size == sizeof(CalibHeader) &&
+				 header->nb_config_g == DetectorState::NB_CONFIG_G &&
+				 header->file_size == m_size &&
+				 header->config_g_offset + config_g_size <= header->dacl_offset &&
+				 header->dacl_offset + dacl_size == m_size;
+	if (valid && verify)
+		valid = DetectorState::checksum(data + sizeof(CalibHeader), m_size - sizeof(CalibHeader)) == header->checksum;
+	if (!valid)
+	{
+		munmap(m_base, m_size);
+		DEB_ERROR() << file_name << " is not a valid binary calibration (version " << CALIB_VERSION << ")";
+		throw LIMA_HW_EXC(Error, "Invalid binary calibration file");
+	}
+
+	m_modules_mask	= header->modules_mask;
+	m_nb_modules	= header->nb_modules;
+	m_nb_chips		= header->nb_chips;
+	m_description	= string(header->description, strnlen(header->description, sizeof(header->description)));
+	m_creation_time	= header->creation_time;
+	m_config_g		= reinterpret_cast<const uint32_t*>(data + header->config_g_offset);
+	m_dacl			= reinterpret_cast<const uint16_t*>(data + header->dacl_offset);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+CalibrationMap::~CalibrationMap()
+{
+	munmap(m_base, m_size);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool CalibrationMap::isCalibrationMap(const string& file_name)
+{
+	char magic[sizeof(CALIB_MAGIC)];
+	ifstream file(file_name.c_str(), ios::in | ios::binary);
+	return file.read(magic, sizeof(magic)) && memcmp(magic, CALIB_MAGIC, sizeof(magic)) == 0;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int CalibrationMap::getModuleBit(int mod_idx) const
+{
+	for (int bit = 0; bit < 32; bit++)
+		if ((m_modules_mask & (1U << bit)) && mod_idx-- == 0)
+			return bit;
+	return -1;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+uint32_t CalibrationMap::getConfigG(int mod_idx, int chip, int index) const
+{
+	return m_config_g[(mod_idx * m_nb_chips + chip) * DetectorState::NB_CONFIG_G + index];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+const uint16_t* CalibrationMap::getDaclRow(int mod_idx, int chip, int row) const
+{
+	int width = XPAD_NB_COLUMNS * m_nb_chips;
+	return &m_dacl[(mod_idx * XPAD_NB_ROWS + row) * width + chip * XPAD_NB_COLUMNS];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void CalibrationMap::copyTo(DetectorState& calib) const
+{
+	DEB_MEMBER_FUNCT();
+
+	if (calib.getModulesMask() != m_modules_mask || calib.getNbChips() != m_nb_chips)
+		throw LIMA_HW_EXC(InvalidValue, "Binary calibration of another detector geometry");
+
+	for (int mod_idx = 0; mod_idx < m_nb_modules; mod_idx++)
+		for (int chip = 0; chip < m_nb_chips; chip++)
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+				calib.setConfigG(mod_idx, chip, index, getConfigG(mod_idx, chip, index));
+	memcpy(calib.getDacl(), m_dacl, calib.getDaclSize() * sizeof(uint16_t));
+	calib.setDaclValid(true);
+}
@@ -20,29 +20,203 @@
 // along with this program; if not, see <http://www.gnu.org/licenses/>.
 //###########################################################################
 #include "XpadCamera.h"
+#include "XpadCalibrationFile.h"
+#include "XpadSCurve.h"
 #include <sstream>
+#include <set>
 #include <iostream>
 #include <string>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 using namespace lima;
 using namespace lima::Xpad;
 using namespace std;
 
+//---------------------------
+//- Config G programming: the (module, chip) pairs sharing the same key (all the
+//- registers or one register value) and the same chips in their modules are
+//- programmed by one masked call. groups[key][chip mask] = modules mask
+//- (the chip argument of the xpci config loads is always a chip mask)
+//---------------------------
+template <class Key>
+static int groupConfigG(const vector<Key>& keys, const vector<bool>& pending,
+						const DetectorState& state, map<Key, map<unsigned int, unsigned int> >& groups)
+{
+	int nb_chips = state.getNbChips();
+	map<Key, vector<unsigned int> > chip_masks;
+	for (int mod_idx = 0; mod_idx < state.getNbModules(); mod_idx++)
+	{
+		for (int chip = 0; chip < nb_chips; chip++)
+		{
+			int pos = mod_idx * nb_chips + chip;
+			if (!pending[pos])
+				continue;
+			vector<unsigned int>& masks = chip_masks[keys[pos]];
+			masks.resize(state.getNbModules(), 0);
+			masks[mod_idx] |= 1U << chip;
+		}
+	}
+
+	int nb_calls = 0;
+	groups.clear();
+	typename map<Key, vector<unsigned int> >::const_iterator it;
+	for (it = chip_masks.begin(); it != chip_masks.end(); ++it)
+	{
+		map<unsigned int, unsigned int>& key_groups = groups[it->first];
+		for (size_t mod_idx = 0; mod_idx < it->second.size(); mod_idx++)
+		{
+			unsigned int chip_mask = it->second[mod_idx];
+			if (!chip_mask)
+				continue;
+			if (key_groups.find(chip_mask) == key_groups.end())
+				nb_calls++;
+			key_groups[chip_mask] |= 1U << state.getModuleBit(mod_idx);
+		}
+	}
+	return nb_calls;
+}
+
 
 //- Const.
-static const int 	BOARDNUM 	= 0;
 
+//- PCIe boards opened by the cameras of the process: the xpix library keeps
+//- one global context, so only one board can be opened per process
+static Mutex		opened_boards_lock;
+static set<int>		opened_boards;
+
+//- Exposure limits: Texp is given to the modules as an unsigned int in usec
+static const double	MIN_EXP_TIME_USEC	= 1.;
+static const double	MAX_EXP_TIME_USEC	= 4294967295.;
+static const double	MAX_WAIT_TIME_USEC	= 4294967295.;
+
+//- Max time given to the acquisition thread to publish the acquired images after a stop
+static const double	STOP_TIMEOUT_SEC	= 5.;
+
+//- Frames the host stages (publication thread) can lag behind the readout before it waits
+static const int	PUBLISH_NB_FRAMES	= 16;
+
+//- Calibration id (RAM slot of the modules) used by the host side uploads (snapshot restore, differential upload)
+static const unsigned int	HOST_CALIB_ID	= 0;
+
+//- Nb of images used by calibrateReadoutModel()
+static const int 	READOUT_CALIB_NB_IMAGES	= 10;
+static const int 	READOUT_CALIB_NB_LOOPS	= 10;
+//- imXPAD pixel config word: DACL on bits 3..8, counter enabled by bit 0
+static const int	DACL_SHIFT		= 3;
+static const int	DACL_NB_VALUES	= 64;
+static const int	DACL_ENABLE		= 0x1;
+static const size_t	DACL_CACHE_ALIGN	= 64;
+
+//---------------------------
+//- Nominal readout model of each detector model (refined by calibrateReadoutModel())
+//---------------------------
+static Camera::ReadoutModel getNominalReadoutModel(unsigned short xpad_model)
+{
+	Camera::ReadoutModel model;
+	model.ovf_readout_usec				= 10.;
+	model.link_mbytes_per_sec			= 180.;
+	model.host_copy_usec_per_mbyte		= 250.;
+	model.host_reorder_usec_per_mbyte	= 1000.;
+
+	switch (xpad_model)
+	{
+	case IMXPAD_S340:
+		model.chip_readout_usec = 700.;
+		break;
+	case IMXPAD_S540:
+		model.chip_readout_usec = 800.;
+		break;
+	default: //- BACKPLANE, S70, S140
+		model.chip_readout_usec = 500.;
+		break;
+	}
+	return model;
+}
+
+
+//---------------------------
+//- Acquisition thread: runs the SYNC and live acquisitions and the calibrations
+//- so that the yat::Task only handles control messages
+//---------------------------
+class Camera::AcqThread : public Thread
+{
+	DEB_CLASS_NAMESPC(DebModCamera, "Camera", "AcqThread");
+
+public:
+	AcqThread(Camera& cam) : m_cam(cam) {}
+
+protected:
+	virtual void threadFunction();
+
+private:
+	Camera& m_cam;
+};
+
+//---------------------------
+//- Scan thread: sums and publishes the images of a threshold scan step
+//- while the acquisition thread acquires the next one
+//---------------------------
+class Camera::ScanThread : public Thread
+{
+	DEB_CLASS_NAMESPC(DebModCamera, "Camera", "ScanThread");
+
+public:
+	ScanThread(Camera& cam) : m_cam(cam) {}
+
+protected:
+	virtual void threadFunction();
+
+private:
+	Camera& m_cam;
+};
+
+//---------------------------
+//- Publication thread: runs the host stages (sparse encoding, integration,
+//- compression, ring, streaming) of the frames published by the readout
+//---------------------------
+class Camera::PublishThread : public Thread
+{
+	DEB_CLASS_NAMESPC(DebModCamera, "Camera", "PublishThread");
+
+public:
+	PublishThread(Camera& cam) : m_cam(cam) {}
+
+protected:
+	virtual void threadFunction();
+
+private:
+	Camera& m_cam;
+};
+
+//---------------------------
+//- Keeps the driver images of a scope until the host stages that read them are done
+//- (also when the scope is left on an exception)
+//---------------------------
+class Camera::HostFramesRelease
+{
+public:
+	HostFramesRelease(Camera& cam) : m_cam(cam) {}
+	~HostFramesRelease() {m_cam._releaseHostFrames();}
+
+private:
+	Camera& m_cam;
+};
 
 //---------------------------
 //- Ctor
 //---------------------------
-Camera::Camera(string xpad_model): 	m_buffer_cb_mgr(m_buffer_alloc_mgr),
+Camera::Camera(string xpad_model, string snapshot_path, int board_num): 	m_board_num(board_num),
+m_buffer_cb_mgr(m_buffer_alloc_mgr),
 m_buffer_ctrl_mgr(m_buffer_cb_mgr),
-m_modules_mask(0x00),
-m_chip_number(7),
+m_nb_frames(1),
 m_pixel_depth(B4),
-m_nb_frames(1)
+m_modules_mask(0x00),
+m_chip_number(7)
 {
 	DEB_CONSTRUCTOR();
 
@@ -51,6 +225,79 @@ m_nb_frames(1)
     m_acquisition_type	= Camera::SYNC;
     m_current_nb_frames = 0;
 
+    m_acq_thread                = NULL;
+    m_publish_thread            = NULL;
+    m_host_frames_queued        = 0;
+    m_host_frames_done          = 0;
+    m_host_frames_failed        = false;
+    m_publish_quit              = false;
+    m_frame_ring                = NULL;
+    m_frame_ring_nb_slots       = 0;
+    m_frame_streamer            = NULL;
+    m_compression               = false;
+    m_compression_nb_threads    = 0;
+    m_compressed_frame_listener = NULL;
+    m_sparse_output             = false;
+    m_sparse_max_occupancy      = 0.05;
+    m_sparse_frame_listener     = NULL;
+    m_raw_mode                  = false;
+    m_integration               = false;
+    m_integration_stream_profile_only = false;
+    m_profile_listener          = NULL;
+    m_dead_time_correction      = false;
+    m_float_output              = false;
+    m_dacl                      = NULL;
+    m_dacl_cached               = false;
+    m_live_running              = false;
+    m_live_snapshot_dirty       = false;
+    m_circular                  = false;
+    m_circular_nb_pre_frames    = 0;
+    m_circular_nb_post_frames   = 0;
+    m_circular_event            = false;
+    m_circular_nb_ring_frames   = 0;
+    m_phase_binning             = false;
+    m_phase_nb_phases           = 1;
+    m_phase_nb_cycles           = 1;
+    m_job                       = Camera::ACQUISITION_JOB;
+    m_calibration_type          = Camera::OTN_SLOW;
+    m_calibration_per_module    = false;
+    m_cancel_asked              = false;
+    memset(&m_calibration_progress, 0, sizeof(m_calibration_progress));
+    m_wait_flag                 = true;
+    m_quit                      = false;
+    m_thread_running            = false;
+    m_acq_thread_cpu_mask       = 0;
+    m_acq_thread_rt_priority    = 0;
+    m_control_latency           = 0.;
+    m_last_stop_duration        = 0.;
+    memset(&m_upload_stats, 0, sizeof(m_upload_stats));
+    memset(&m_host_calibration_stats, 0, sizeof(m_host_calibration_stats));
+    m_host_calibration_params.exp_time_usec = 1000;
+    m_host_calibration_params.nb_images     = 1;
+    m_host_calibration_params.ithl_min      = 0;
+    m_host_calibration_params.ithl_max      = 63;
+    m_host_calibration_params.dacl_flat     = DACL_NB_VALUES / 2;
+    m_host_calibration_params.dacl_margin   = 1;
+    m_host_calibration_params.noise_counts  = 10;
+    m_host_calibration_params.nb_threads    = 0;
+
+    m_scan_ithl_min             = 0;
+    m_scan_nb_steps             = 0;
+    m_scan_nb_images            = 1;
+    m_scan_nb_steps_done        = 0;
+    m_scan_publish_frames       = false;
+    m_scan_mode                 = false;
+    m_scan_mode_ithl_min        = 0;
+    m_scan_mode_nb_steps        = 0;
+    m_scan_mode_nb_images       = 0;
+    m_scan_end                  = false;
+    m_scan_failed               = false;
+    m_scan_filled_step[0] = m_scan_filled_step[1] = -1;
+    m_max_recovery_attempts     = 3;
+    m_recovery_step             = Camera::RECOVERY_IDLE;
+    m_nb_recoveries             = 0;
+    m_last_recovery_time        = 0.;
+
     if		(xpad_model == "BACKPLANE") 	m_xpad_model = BACKPLANE;
     else if	(xpad_model == "IMXPAD_S70")	m_xpad_model = IMXPAD_S70;
     else if	(xpad_model == "IMXPAD_S140")	m_xpad_model = IMXPAD_S140;
@@ -59,60 +306,124 @@ m_nb_frames(1)
     else
     	throw LIMA_HW_EXC(Error, "Xpad Model not supported");
 
+    m_readout_model = getNominalReadoutModel(m_xpad_model);
+
+    m_exp_time_usec             = 0;
+    m_time_between_images_usec  = 0;
+    m_exposure_programmed       = false;
+    m_time_before_start_usec    = 0;
+    m_shutter_time_usec         = 0;
+    m_ovf_refresh_time_usec     = 0;
+
     //-------------------------------------------------------------
-    //- Init the xpix driver
-    if(xpci_init(0,m_xpad_model) != 0)
+    //- One camera per board, one board per process: checked and reserved at once
     {
-        DEB_TRACE() << "PCIe board UNsuccessfully initialized";
-        throw LIMA_HW_EXC(Error, "PCIe board UNsuccessfully initialized");
+        AutoMutex aLock(opened_boards_lock);
+        if (opened_boards.count(m_board_num))
+            throw LIMA_HW_EXC(Error, "PCIe board already opened by another camera");
+        if (!opened_boards.empty())
+            throw LIMA_HW_EXC(Error, "Only one PCIe board per process: the xpix library has a single context");
+        opened_boards.insert(m_board_num);
     }
-    else
+
+    //- Init the xpix driver
+    bool board_opened = false;
+    try
     {
-        DEB_TRACE() << "PCIe board successfully initialized";
-	    //- Get Modules that are ready
-	    if (xpci_modAskReady(&m_modules_mask) == 0)
-	    {
-		    DEB_TRACE() << "Ask modules that are ready: OK (modules mask = " << std::hex << m_modules_mask << ")" ;
-		    m_module_number = xpci_getModNb(m_modules_mask);
+        DEB_TRACE() << "Opening PCIe board " << m_board_num;
+        if(xpci_init(m_board_num,m_xpad_model) != 0)
+        {
+            DEB_TRACE() << "PCIe board UNsuccessfully initialized";
+            throw LIMA_HW_EXC(Error, "PCIe board UNsuccessfully initialized");
+        }
+        else
+        {
+            board_opened = true;
+            DEB_TRACE() << "PCIe board successfully initialized";
+    	    //- Get Modules that are ready
+    	    if (xpci_modAskReady(&m_modules_mask) == 0)
+    	    {
+    		    DEB_TRACE() << "Ask modules that are ready: OK (modules mask = " << std::hex << m_modules_mask << ")" ;
+    		    m_module_number = xpci_getModNb(m_modules_mask);
             
-		    if (m_module_number != 0)
-		    {
-			    DEB_TRACE() << "--> Number of Modules 		 = " << m_module_number ;			
-		    }
-		    else
-		    {
-			    DEB_ERROR() << "No modules found: retry to Init" ;
-			    //- Test if PCIe is OK
-			    if(xpci_isPCIeOK() == 0) 
-			    {
-				    DEB_TRACE() << "PCIe hardware check is OK" ;
-			    }
-			    else
-			    {
-				    DEB_ERROR() << "PCIe hardware check has FAILED:" ;
-				    DEB_ERROR() << "1. Check if green led is ON (if not go to p.3)" ;
-				    DEB_ERROR() << "2. Reset PCIe board" ;
-				    DEB_ERROR() << "3. Power off and power on PC (do not reboot, power has to be cut off)\n" ;
-				    throw LIMA_HW_EXC(Error, "PCIe hardware check has FAILED!");
-			    }
-			    throw LIMA_HW_EXC(Error, "No modules found: retry to Init");			
-		    }	
-	    }
-	    else
-	    {
-		    DEB_ERROR() << "Ask modules that are ready: FAILED" ;
-		    throw LIMA_HW_EXC(Error, "No Modules are ready");
-	    }
-
-	    //ATTENTION: Modules should be ordered! 
-	    m_image_size = Size(80 * m_chip_number ,120 * m_module_number); //- MODIF-NL-ICA
-	    DEB_TRACE() << "--> Number of chips 		 = " << std::dec << m_chip_number ;
-	    DEB_TRACE() << "--> Image width 	(pixels) = " << std::dec << m_image_size.getWidth() ;
-	    DEB_TRACE() << "--> Image height	(pixels) = " << std::dec << m_image_size.getHeight() ;
-		go(2000);
-
-        //- allocate the dacl array: not used yet
-        //m_dacl = new unsigned short[m_image_size.getWidth() * m_image_size.getHeight()];
+    		    if (m_module_number != 0)
+    		    {
+    			    DEB_TRACE() << "--> Number of Modules 		 = " << m_module_number ;			
+    		    }
+    		    else
+    		    {
+    			    DEB_ERROR() << "No modules found: retry to Init" ;
+    			    //- Test if PCIe is OK
+    			    if(xpci_isPCIeOK() == 0) 
+    			    {
+    				    DEB_TRACE() << "PCIe hardware check is OK" ;
+    			    }
+    			    else
+    			    {
+    				    DEB_ERROR() << "PCIe hardware check has FAILED:" ;
+    				    DEB_ERROR() << "1. Check if green led is ON (if not go to p.3)" ;
+    				    DEB_ERROR() << "2. Reset PCIe board" ;
+    				    DEB_ERROR() << "3. Power off and power on PC (do not reboot, power has to be cut off)\n" ;
+    				    throw LIMA_HW_EXC(Error, "PCIe hardware check has FAILED!");
+    			    }
+    			    throw LIMA_HW_EXC(Error, "No modules found: retry to Init");			
+    		    }	
+    	    }
+    	    else
+    	    {
+    		    DEB_ERROR() << "Ask modules that are ready: FAILED" ;
+    		    throw LIMA_HW_EXC(Error, "No Modules are ready");
+    	    }
+
+    	    //ATTENTION: Modules should be ordered! 
+    	    m_image_size = Size(80 * m_chip_number ,120 * m_module_number); //- MODIF-NL-ICA
+    	    DEB_TRACE() << "--> Number of chips 		 = " << std::dec << m_chip_number ;
+    	    DEB_TRACE() << "--> Image width 	(pixels) = " << std::dec << m_image_size.getWidth() ;
+    	    DEB_TRACE() << "--> Image height	(pixels) = " << std::dec << m_image_size.getHeight() ;
+
+            //- allocate the DACL read back cache (cache line aligned), before the threads are started
+            void* dacl = NULL;
+            if (posix_memalign(&dacl, DACL_CACHE_ALIGN, m_image_size.getWidth() * m_image_size.getHeight() * sizeof(unsigned short)) != 0)
+                throw LIMA_HW_EXC(Error, "Can not allocate the DACL cache");
+            m_dacl = static_cast<unsigned short*>(dacl);
+            m_dacl_cached = false;
+
+    		go(2000);
+
+            //- start the acquisition thread
+            m_acq_thread = new AcqThread(*this);
+            m_acq_thread->start();
+
+            //- and the publication thread of the host stages
+            m_host_frames.resize(PUBLISH_NB_FRAMES);
+            m_publish_thread = new PublishThread(*this);
+            m_publish_thread->start();
+
+            //- nothing is known about what is programmed in the detector: warm start from the snapshot
+            m_state.init(m_modules_mask, m_module_number, m_chip_number);
+            m_snapshot_path = snapshot_path;
+            if (!m_snapshot_path.empty())
+            {
+                try
+                {
+                    restoreSnapshot();
+                }
+                catch (Exception& e)
+                {
+                    DEB_ERROR() << "Warm start failed, the detector has to be configured: " << e.getErrMsg();
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+        //- the destructor is not called: release the board
+        if (board_opened)
+            xpci_close(m_board_num);
+        free(m_dacl);
+        AutoMutex aLock(opened_boards_lock);
+        opened_boards.erase(m_board_num);
+        throw;
     }
 }
 
@@ -123,11 +434,42 @@ Camera::~Camera()
 {
 	DEB_DESTRUCTOR();
 
+	//- stop the acquisition thread
+	if (m_acq_thread)
+	{
+		if (m_thread_running)
+			stop();
+
+		AutoMutex aLock(m_cond.mutex());
+		m_quit = true;
+		m_cond.broadcast();
+		aLock.unlock();
+
+		m_acq_thread->join();
+		delete m_acq_thread;
+	}
+
+	if (m_publish_thread)
+	{
+		AutoMutex aLock(m_publish_cond.mutex());
+		m_publish_quit = true;
+		m_publish_cond.broadcast();
+		aLock.unlock();
+
+		m_publish_thread->join();
+		delete m_publish_thread;
+	}
+
 	//- close the xpix driver
-	xpci_close(0);
-	DEB_TRACE() << "XPCI Lib closed";
+	xpci_close(m_board_num);
+	DEB_TRACE() << "XPCI Lib closed (board " << m_board_num << ")";
+
+	AutoMutex aLock(opened_boards_lock);
+	opened_boards.erase(m_board_num);
 
-    //delete [] m_dacl;
+    free(m_dacl);
+    delete m_frame_ring;
+    delete m_frame_streamer;
 }
 
 //---------------------------
@@ -137,18 +479,64 @@ void Camera::start()
 {
 	DEB_MEMBER_FUNCT();
 
+	{
+		AutoMutex aLock(m_cond.mutex());
+		if (!m_wait_flag)
+			throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	}
+
     m_stop_asked = false;
+	m_current_nb_frames = -1;
 	unsigned long local_nb_frames = 0;
 
-    //-	((80 colonnes * 7 chips) * taille du pixel) * 120 lignes * nb_modules
-	if (m_pixel_depth == B2)
+	m_full_image_size_in_bytes = _getFrameSizeInBytes();
+
+	//- (re)create the shared memory ring for the current frame size
+	if (!m_frame_ring_name.empty() &&
+		(!m_frame_ring || m_frame_ring->getFrameSize() != m_full_image_size_in_bytes))
+	{
+		delete m_frame_ring;
+		m_frame_ring = NULL;
+		int nb_pixels = m_image_size.getWidth() * m_image_size.getHeight();
+		m_frame_ring = new FrameRing(m_frame_ring_name, m_frame_ring_nb_slots,
+									m_image_size.getWidth(), m_image_size.getHeight(),
+									m_full_image_size_in_bytes / nb_pixels);
+	}
+
+	if (m_sparse_output)
+	{
+		int nb_pixels = m_image_size.getWidth() * m_image_size.getHeight();
+		m_sparse_encoder.init(nb_pixels, m_full_image_size_in_bytes / nb_pixels, m_sparse_max_occupancy);
+	}
+
+	//- one compressed chunk per module
+	if (m_compression)
 	{
-		m_full_image_size_in_bytes = ((80 * m_chip_number) * 2)  * (120 * m_module_number);
-	} 
-	else if(m_pixel_depth == B4)
+		if (m_frame_streamer && m_module_number > FrameStreamer::MAX_CHUNKS)
+			throw LIMA_HW_EXC(InvalidValue, "Compressed frames can not be streamed: too many modules");
+		int nb_pixels = m_image_size.getWidth() * m_image_size.getHeight();
+		m_frame_compressor.init(m_module_number, m_full_image_size_in_bytes / m_module_number,
+								m_full_image_size_in_bytes / nb_pixels, m_compression_nb_threads);
+	}
+
+	//- the corrected counts (or floats) of the copy in the lima buffers
+	if (m_dead_time_correction || m_float_output)
 	{
-		m_full_image_size_in_bytes = ((80 * m_chip_number) * 4 )  * (120 * m_module_number);
-	} 
+		if (m_raw_mode)
+			throw LIMA_HW_EXC(InvalidValue, "Raw mode: no dead-time correction nor float conversion");
+		if (m_dead_time_correction && m_dead_time_tau_ns.size() != 1 &&
+			int(m_dead_time_tau_ns.size()) != m_module_number)
+			throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: one dead time per module (or one for all) is needed");
+
+		_initDeadTimeCorrector();
+	}
+
+	//- the host stages read the lima buffers in place: never more frames queued than the lima ring
+	//- holds (the publication thread is idle, the previous acquisition waited for it)
+	int nb_buffers, nb_concat_frames;
+	m_buffer_cb_mgr.getNbBuffers(nb_buffers);
+	m_buffer_cb_mgr.getNbConcatFrames(nb_concat_frames);
+	m_host_frames.resize(max(1, min(PUBLISH_NB_FRAMES, nb_buffers * nb_concat_frames)));
 
 	DEB_TRACE() << "m_acquisition_type = " << m_acquisition_type ;
 
@@ -159,9 +547,33 @@ void Camera::start()
 	DEB_TRACE() << "\tm_nb_frames (before live mode check)			= " << m_nb_frames;
 	DEB_TRACE() << "\tm_imxpad_format 		= " << m_imxpad_format;
 
+	//- the circular mode reads one image after the other
+	if (m_circular && m_nb_frames != m_circular_nb_pre_frames + m_circular_nb_post_frames)
+		throw LIMA_HW_EXC(InvalidValue, "Circular mode: nb frames has to be nb pre + nb post event frames");
+
+	//- phase binning reads nb_cycles cycles for each publication of the phases
+	if (m_phase_binning && (m_circular || m_nb_frames == 0 || m_nb_frames % m_phase_nb_phases))
+		throw LIMA_HW_EXC(InvalidValue, "Phase binning: nb frames has to be a multiple of nb phases");
+
+	//- threshold scan mode: the scan images are the frames of the acquisition
+	if (m_scan_mode)
+	{
+		if (m_circular || m_phase_binning || m_nb_frames != m_scan_mode_nb_steps * m_scan_mode_nb_images)
+			throw LIMA_HW_EXC(InvalidValue, "Threshold scan mode: nb frames has to be nb steps * nb images");
+
+		AutoMutex aLock(m_cond.mutex());
+		m_scan_ithl_min		= m_scan_mode_ithl_min;
+		m_scan_nb_steps		= m_scan_mode_nb_steps;
+		m_scan_nb_images	= m_scan_mode_nb_images;
+		_startScanJob(true);
+		return;
+	}
+
 	//- Check if live mode
-	if (m_nb_frames == 0) //- ie live mode
+	if (m_nb_frames == 0 || m_circular) //- ie live mode
 		local_nb_frames = 1;
+	else if (m_phase_binning)
+		local_nb_frames = m_phase_nb_phases * m_phase_nb_cycles;
 	else
 		local_nb_frames = m_nb_frames;
 
@@ -169,38 +581,19 @@ void Camera::start()
 		
 
 	//- call the setExposureParameters
-    
-
-    //m_xpad_model parameter must be 1 (in our detector type IMXPAD_S140) or XPIX_NOT_USED_YET
-    //maybe library must manage this, we can provide IMXPAD_Sxx to this function if necessary
-	setExposureParameters(	m_exp_time_usec,
-							m_time_between_images_usec,
-							m_time_before_start_usec,
-							m_shutter_time_usec,
-							m_ovf_refresh_time_usec,
-							m_imxpad_trigger_mode,
-							XPIX_NOT_USED_YET,
-							XPIX_NOT_USED_YET,
-							local_nb_frames,
-							XPIX_NOT_USED_YET,
-							m_imxpad_format,
-							(m_xpad_model == IMXPAD_S140)?1:XPIX_NOT_USED_YET,/**/
-							XPIX_NOT_USED_YET,
-							XPIX_NOT_USED_YET,
-							XPIX_NOT_USED_YET,
-							XPIX_NOT_USED_YET);
+	_setExposureParameters(local_nb_frames);
 
 
-	if (m_nb_frames == 0) //- aka live mode
+	if (m_nb_frames == 0 || m_circular || m_phase_binning || m_acquisition_type == Camera::SYNC) //- live mode or SYNC
     {
-        //- Post XPAD_DLL_START_LIVE_ACQ_MSG msg
-		this->post(new yat::Message(XPAD_DLL_START_LIVE_ACQ_MSG), kPOST_MSG_TMO);
+        //- Wake up the acquisition thread
+		AutoMutex aLock(m_cond.mutex());
+		m_job = Camera::ACQUISITION_JOB;
+		m_status = Camera::Exposure;
+		m_job_post_ts = Timestamp::now();
+		m_wait_flag = false;
+		m_cond.broadcast();
     }
-    else if(m_acquisition_type == Camera::SYNC)
-	{
-		//- Post XPAD_DLL_START_SYNC_MSG msg
-		this->post(new yat::Message(XPAD_DLL_START_SYNC_MSG), kPOST_MSG_TMO);
-	}
 	else if (m_acquisition_type == Camera::ASYNC)
 	{
 		//- Post XPAD_DLL_START_ASYNC_MSG msg
@@ -220,11 +613,58 @@ void Camera::stop()
 {
 	DEB_MEMBER_FUNCT();
 
+	Timestamp t0 = Timestamp::now();
+
+	AutoMutex aLock(m_cond.mutex());
+	//- a running calibration is cancelled: an OTN calibration step can not be aborted, no timeout
+	//- nor Fault then, the calibration job sets the status when it ends
+	if (!m_wait_flag && m_job == Camera::CALIBRATION_JOB)
+	{
+		aLock.unlock();
+		cancelCalibration();
+		m_last_stop_duration = Timestamp::now() - t0;
+		DEB_TRACE() << "Calibration cancelled by stop in " << m_last_stop_duration << " s";
+		return;
+	}
+    m_stop_asked = true;
+	//- a blocking streaming client must not hold the publication thread
+	if (m_frame_streamer)
+		m_frame_streamer->interruptBlockingSends();
+	aLock.unlock();
+
 	//- call the abort fct from xpix lib
 	xpci_modAbortExposure();
-    m_stop_asked = true;
 
-	m_status = Camera::Ready;
+	//- wait for the acquisition thread to publish the images already acquired
+	aLock.lock();
+	bool timeout = false;
+	while (!m_wait_flag && !timeout)
+	{
+		double remaining = STOP_TIMEOUT_SEC - (Timestamp::now() - t0);
+		timeout = (remaining <= 0.) || !m_cond.wait(remaining);
+	}
+	aLock.unlock();
+
+	m_last_stop_duration = Timestamp::now() - t0;
+	DEB_TRACE() << "Stop to idle in " << m_last_stop_duration << " s";
+
+	if (timeout)
+	{
+		DEB_ERROR() << "Acquisition thread still running " << STOP_TIMEOUT_SEC << " s after stop";
+		m_status = Camera::Fault;
+	}
+	else
+		m_status = Camera::Ready;
+}
+
+//---------------------------
+//- Camera::getLastStopDuration()
+//---------------------------
+void Camera::getLastStopDuration(double& duration)
+{
+	DEB_MEMBER_FUNCT();
+	duration = m_last_stop_duration;
+	DEB_RETURN() << DEB_VAR1(duration);
 }
 
 //-----------------------------------------------------
@@ -264,11 +704,19 @@ void Camera::setPixelDepth(ImageType pixel_depth)
 		m_pixel_depth = B4;
         m_imxpad_format = 1;
 		break;
+
+	//- 32 bits counts converted to floats (and dead-time corrected) in the lima buffers
+	case Bpp32F:
+		m_pixel_depth = B4;
+        m_imxpad_format = 1;
+		break;
 	default:
 		DEB_ERROR() << "Pixel Depth is unsupported: only 16 or 32 bits is supported" ;
 		throw LIMA_HW_EXC(Error, "Pixel Depth is unsupported: only 16 or 32 bits is supported");
 		break;
 	}
+	m_float_output = (pixel_depth == Bpp32F);
+	_exposureChanged();
 }
 
 //-----------------------------------------------------
@@ -284,7 +732,7 @@ void Camera::getPixelDepth(ImageType& pixel_depth)
 		break;
 
 	case 1:
-		pixel_depth = Bpp32;
+		pixel_depth = m_float_output ? Bpp32F : Bpp32;
 		break;	
 	}
 }
@@ -344,6 +792,7 @@ void Camera::setTrigMode(TrigMode mode)
 		throw LIMA_HW_EXC(Error, "Trigger mode unsupported: only IntTrig, ExtGate or ExtTrigSingle");
 		break;
 	}
+	_exposureChanged();
 }
 
 //-----------------------------------------------------
@@ -379,7 +828,12 @@ void Camera::setExpTime(double exp_time_sec)
 
 	DEB_PARAM() << DEB_VAR1(exp_time_sec);
 
+	//- live acquisition: applied at the next frame boundary
+	if (_queueLiveCommand(Camera::LIVE_SET_EXP_TIME, 0, long(exp_time_sec * 1e6)))
+		return;
+
     m_exp_time_usec = exp_time_sec * 1e6;
+	_exposureChanged();
 }
 
 //-----------------------------------------------------
@@ -396,890 +850,3684 @@ void Camera::getExpTime(double& exp_time_sec)
 
 
 //-----------------------------------------------------
-//
+//		The wait time between two images is what the latency adds to the readout
 //-----------------------------------------------------
-void Camera::setNbFrames(int nb_frames)
+void Camera::setLatTime(double lat_time_sec)
 {
 	DEB_MEMBER_FUNCT();
-	DEB_PARAM() << DEB_VAR1(nb_frames);
-	m_nb_frames = nb_frames;
+	DEB_PARAM() << DEB_VAR1(lat_time_sec);
+
+	double wait_usec = lat_time_sec * 1e6 - _getFrameDeadTimeUsec();
+	if (wait_usec > MAX_WAIT_TIME_USEC)
+		throw LIMA_HW_EXC(InvalidValue, "Latency time too long");
+	m_time_between_images_usec = (wait_usec > 0.) ? (unsigned int)(wait_usec + 0.5) : 0;
+	_exposureChanged();
 }
 
 //-----------------------------------------------------
 //
 //-----------------------------------------------------
-void Camera::getNbFrames(int& nb_frames)
+void Camera::getLatTime(double& lat_time_sec)
 {
 	DEB_MEMBER_FUNCT();
-	nb_frames = m_nb_frames;
-	DEB_RETURN() << DEB_VAR1(nb_frames);
-}
 
-//---------------------------------------------------------------------------------------
-// Camera::getNbHwAcquiredFrames()
-//---------------------------------------------------------------------------------------
-int Camera::getNbHwAcquiredFrames()
-{
-	return m_current_nb_frames + 1; //- because m_current_nb_frames start at 0 
+	lat_time_sec = (_getFrameDeadTimeUsec() + m_time_between_images_usec) / 1e6;
+
+	DEB_RETURN() << DEB_VAR1(lat_time_sec);
 }
 
 //-----------------------------------------------------
-//
+//		Valid exposure and latency ranges
 //-----------------------------------------------------
-void Camera::getStatus(Camera::Status& status)
+void Camera::getValidRanges(double& min_exp_time, double& max_exp_time,
+							double& min_lat_time, double& max_lat_time)
 {
 	DEB_MEMBER_FUNCT();
-	status = m_status;
-	DEB_RETURN() << DEB_VAR1(DEB_HEX(status));
+
+	//- the latency between two images can not be shorter than the readout of the detector
+	double readout_usec = _getFrameDeadTimeUsec();
+
+	min_exp_time = MIN_EXP_TIME_USEC / 1e6;
+	max_exp_time = MAX_EXP_TIME_USEC / 1e6;
+	min_lat_time = readout_usec / 1e6;
+	max_lat_time = (readout_usec + MAX_WAIT_TIME_USEC) / 1e6;
+
+	DEB_RETURN() << DEB_VAR4(min_exp_time, max_exp_time, min_lat_time, max_lat_time);
 }
- 
+
 //-----------------------------------------------------
-//
+//		Max frame rate with the current configuration
 //-----------------------------------------------------
-void Camera::handle_message( yat::Message& msg )  throw( yat::Exception )
+void Camera::getMaxFrameRate(double& max_frame_rate)
 {
 	DEB_MEMBER_FUNCT();
-	try
-	{
-		switch ( msg.type() )
-		{
-			//-----------------------------------------------------	
-		case yat::TASK_INIT:
-			{
-				DEB_TRACE() <<"Camera::->TASK_INIT";          
-			}
-			break;
-			//-----------------------------------------------------    
-		case yat::TASK_EXIT:
-			{
-				DEB_TRACE() <<"Camera::->TASK_EXIT";                
-			}
-			break;
-			//-----------------------------------------------------    
-		case yat::TASK_TIMEOUT:
-			{
-				DEB_TRACE() <<"Camera::->TASK_TIMEOUT";       
-			}
-			break;
-			//-----------------------------------------------------    
-		case XPAD_DLL_START_SYNC_MSG:
-			{
-				DEB_TRACE() <<"Camera::->XPAD_DLL_START_SYNC_MSG";
-
-				//- A mettre dans le prepareAcq?
-                
-				//- Declare local temporary image buffer
-				void**	image_array;
-
-				// allocate multiple buffers
-				DEB_TRACE() <<"Allocating images array (" << m_nb_frames << " images)";
-				if(m_imxpad_format == 0) //- aka 16 bits
-					image_array = reinterpret_cast<void**>(new uint16_t* [ m_nb_frames ]);
-				else //- aka 32 bits
-					image_array = reinterpret_cast<void**>(new uint32_t* [ m_nb_frames ]);
-                
-                		DEB_TRACE() <<"Allocating every image pointer of the images array (1 image full size = "<< m_full_image_size_in_bytes << ") ";
-				for( int i=0 ; i < m_nb_frames ; i++ )
-				{
-					if(m_imxpad_format == 0) //- aka 16 bits
-						image_array[i] = new uint16_t [ m_full_image_size_in_bytes / 2 ];//we allocate a number of pixels
-					else //- aka 32 bits
-						image_array[i] = new uint32_t [ m_full_image_size_in_bytes / 4 ];//we allocate a number of pixels
-				}
-
-				m_status = Camera::Exposure;
-
-				//- Start the img sequence
-				DEB_TRACE() <<"Start acquiring a sequence of images";
-
-				if ( xpci_getImgSeq(	m_pixel_depth, 
-					                    m_modules_mask,
-					                    m_chip_number,
-                            			m_nb_frames,
-                            			(void**)image_array,
-                            			// next are ignored in V2:
-                            			XPIX_V1_COMPATIBILITY,
-					                    XPIX_V1_COMPATIBILITY,
-					                    XPIX_V1_COMPATIBILITY,
-					                    XPIX_V1_COMPATIBILITY) == -1)
-				{
-					DEB_ERROR() << "Error: xpci_getImgSeq as returned an error..." ;
-
-					DEB_TRACE() << "Freeing each image pointer of the images array";
-					for(int i=0 ; i < m_nb_frames ; i++)
-					{
-						if(m_pixel_depth == B2)
-							delete[] reinterpret_cast<uint16_t*>(image_array[i]);
-						else
-							delete[] reinterpret_cast<uint32_t*>(image_array[i]);
-					}
 
-					DEB_TRACE() << "Freeing the images array";
-					if(m_imxpad_format == 0) //- aka 16 bits
-						delete[] reinterpret_cast<uint16_t**>(image_array);
-					else //- aka 32 bits
-						delete[] reinterpret_cast<uint32_t**>(image_array);
+	//- Overflow refresh (32 bits mode) interrupts the exposure
+	double ovf_usec = 0.;
+	if (m_pixel_depth == B4 && m_ovf_refresh_time_usec != 0)
+		ovf_usec = floor(m_exp_time_usec / (double)m_ovf_refresh_time_usec) * m_readout_model.ovf_readout_usec;
+
+	//- the wait time programmed between two images (latency) is part of the period
+	double detector_period_usec = max((double)m_exp_time_usec, MIN_EXP_TIME_USEC) + ovf_usec +
+								  _getFrameDeadTimeUsec() + m_time_between_images_usec;
+
+	double period_usec;
+	if (m_circular)
+		//- the ring images stay in the staging memory until the event
+		period_usec = detector_period_usec;
+	else if (m_nb_frames == 0)
+		//- live: one sequence per image, the next one starts once the image is in the lima buffer
+		period_usec = detector_period_usec + _getHostFrameTimeUsec();
+	else
+		period_usec = max(detector_period_usec, _getHostFrameTimeUsec());
 
-					m_status = Camera::Fault;
-                    throw LIMA_HW_EXC(Error, "xpci_getImgSeq as returned an error ! ");
-				}
+	max_frame_rate = 1e6 / period_usec;
 
-				m_status = Camera::Readout;
+	DEB_RETURN() << DEB_VAR1(max_frame_rate);
+}
 
-				DEB_TRACE() 	<< "\n#######################"
-								<< "\nall images are acquired"
-								<< "\n#######################" ;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getReadoutModel(Camera::ReadoutModel& model)
+{
+	DEB_MEMBER_FUNCT();
+	model = m_readout_model;
+}
 
-				int	i=0;
+//-----------------------------------------------------
+//		Measure the readout model parameters: a job of the acquisition thread, waited for
+//-----------------------------------------------------
+void Camera::calibrateReadoutModel()
+{
+	DEB_MEMBER_FUNCT();
 
-				//- Publish each image and call new frame ready for each frame
-				StdBufferCbMgr& buffer_mgr = m_buffer_cb_mgr;
-				DEB_TRACE() <<"Publish each acquired image through newFrameReady()";
-				for(i=0; i<m_nb_frames; i++)
-				{
-                    m_current_nb_frames = i;
-					int buffer_nb, concat_frame_nb;
-					buffer_mgr.setStartTimestamp(Timestamp::now());
-					buffer_mgr.acqFrameNb2BufferNb(i, buffer_nb, concat_frame_nb);
-
-					void* lima_img_ptr;
-					if(m_imxpad_format == 0) //- aka 16 bits
-						lima_img_ptr = (uint16_t*)(buffer_mgr.getBufferPtr(buffer_nb,concat_frame_nb));
-					else //- aka 32 bits
-						lima_img_ptr = (uint32_t*)(buffer_mgr.getBufferPtr(buffer_nb,concat_frame_nb));
-
-					//- copy image in the lima buffer
-					if(m_imxpad_format == 0) //- aka 16 bits
-						memcpy((uint16_t *)lima_img_ptr, (uint16_t *)image_array[i],m_full_image_size_in_bytes);
-					else //- aka 32 bits
-						memcpy((uint32_t *)lima_img_ptr, (uint32_t *)image_array[i],m_full_image_size_in_bytes);
-
-					HwFrameInfoType frame_info;
-					frame_info.acq_frame_nb = i;
-					//- raise the image to Lima
-					buffer_mgr.newFrameReady(frame_info);
-                    DEB_TRACE() << "image " << i <<" published with newFrameReady()" ;
-				}
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+
+	m_stop_asked = false;
+	m_job = Camera::READOUT_CALIBRATION_JOB;
+	m_status = Camera::Calibrating;
+	m_job_post_ts = Timestamp::now();
+	m_wait_flag = false;
+	m_cond.broadcast();
+
+	while (!m_wait_flag)
+		m_cond.wait();
+	if (m_status != Camera::Ready)
+		throw LIMA_HW_EXC(Error, "calibrateReadoutModel: the readout measurement failed");
+}
 
-				DEB_TRACE() <<"Freeing every image pointer of the images array";
-                //- they were allocated by the xpci_getImgSeq function
-				for(i=0 ; i < m_nb_frames ; i++)
-					delete[] image_array[i];
-				DEB_TRACE() <<"Freeing images array";
-				delete[] image_array;
-				m_status = Camera::Ready;
-				DEB_TRACE() <<"m_status is Ready";
+//-----------------------------------------------------
+//		Readout calibration job
+//-----------------------------------------------------
+void Camera::_calibrateReadoutModel()
+{
+	DEB_MEMBER_FUNCT();
 
-			}
-			break;
+	int frame_size = _getFrameSizeInBytes();
+	double frame_mbytes = frame_size / 1048576.;
+	vector<char> src(frame_size * READOUT_CALIB_NB_IMAGES);
+	vector<char> dst(frame_size);
+
+	//- 1. host copy cost (copy of one image in the lima buffer)
+	Timestamp t0 = Timestamp::now();
+	for (int loop = 0; loop < READOUT_CALIB_NB_LOOPS; loop++)
+		memcpy(&dst[0], &src[(loop % READOUT_CALIB_NB_IMAGES) * frame_size], frame_size);
+	double copy_usec = (Timestamp::now() - t0) * 1e6 / READOUT_CALIB_NB_LOOPS;
+	m_readout_model.host_copy_usec_per_mbyte = copy_usec / frame_mbytes;
+
+	//- 2. host reorder cost (lines interleaved by module -> lines ordered by module)
+	int nb_lines = 120 * m_module_number;
+	int line_size = frame_size / nb_lines;
+	t0 = Timestamp::now();
+	for (int loop = 0; loop < READOUT_CALIB_NB_LOOPS; loop++)
+	{
+		char* img = &src[(loop % READOUT_CALIB_NB_IMAGES) * frame_size];
+		for (int line = 0; line < 120; line++)
+			for (int mod = 0; mod < m_module_number; mod++)
+				memcpy(&dst[(mod * 120 + line) * line_size], img + (line * m_module_number + mod) * line_size, line_size);
+	}
+	double reorder_usec = (Timestamp::now() - t0) * 1e6 / READOUT_CALIB_NB_LOOPS;
+	m_readout_model.host_reorder_usec_per_mbyte = reorder_usec / frame_mbytes;
+
+	//- 3. detector readout of an image in 16 and in 32 bits: the chips readout is the same,
+	//- the difference is the transfer of the extra bytes on the link
+	int nb_pixels = (80 * m_chip_number) * (120 * m_module_number);
+	vector<char> images(size_t(nb_pixels) * 4 * READOUT_CALIB_NB_IMAGES);
+	vector<void*> image_array(READOUT_CALIB_NB_IMAGES);
+	for (int i = 0; i < READOUT_CALIB_NB_IMAGES; i++)
+		image_array[i] = &images[size_t(i) * nb_pixels * 4];
+
+	unsigned int programmed_exposure[16];
+	memcpy(programmed_exposure, m_programmed_exposure, sizeof(programmed_exposure));
+	bool exposure_programmed = m_exposure_programmed;
+	double readout_usec[2];
+	try
+	{
+		readout_usec[0] = _measureReadoutUsec(B2, 0, image_array);
+		readout_usec[1] = _measureReadoutUsec(B4, 1, image_array);
+	}
+	catch (Exception&)
+	{
+		if (exposure_programmed)
+			setExposureParameters(	programmed_exposure[0], programmed_exposure[1], programmed_exposure[2],
+									programmed_exposure[3], programmed_exposure[4], programmed_exposure[5],
+									programmed_exposure[6], programmed_exposure[7], programmed_exposure[8],
+									programmed_exposure[9], programmed_exposure[10], programmed_exposure[11],
+									programmed_exposure[12], programmed_exposure[13], programmed_exposure[14],
+									programmed_exposure[15]);
+		throw;
+	}
+	if (exposure_programmed)
+		setExposureParameters(	programmed_exposure[0], programmed_exposure[1], programmed_exposure[2],
+								programmed_exposure[3], programmed_exposure[4], programmed_exposure[5],
+								programmed_exposure[6], programmed_exposure[7], programmed_exposure[8],
+								programmed_exposure[9], programmed_exposure[10], programmed_exposure[11],
+								programmed_exposure[12], programmed_exposure[13], programmed_exposure[14],
+								programmed_exposure[15]);
+
+	double mbytes_16 = nb_pixels * 2 / 1048576.;
+	double mbytes_32 = nb_pixels * 4 / 1048576.;
+	if (readout_usec[1] > readout_usec[0])
+		m_readout_model.link_mbytes_per_sec = (mbytes_32 - mbytes_16) / (readout_usec[1] - readout_usec[0]) * 1e6;
+	else
+		DEB_WARNING() << "calibrateReadoutModel: no transfer time measured, link throughput kept";
+	double transfer_usec = mbytes_16 / m_readout_model.link_mbytes_per_sec * 1e6;
+	m_readout_model.chip_readout_usec = max(readout_usec[0] - transfer_usec, 0.);
 
-            //-----------------------------------------------------    
-			case XPAD_DLL_START_LIVE_ACQ_MSG:
-			{
-				DEB_TRACE() 	<< "=========================================";
-                DEB_TRACE() <<"Camera::->XPAD_DLL_START_LIVE_ACQ_MSG";
+	DEB_TRACE() << "calibrateReadoutModel -> readout = " << readout_usec[0] << " / " << readout_usec[1] << " usec"
+				<< " | link = " << m_readout_model.link_mbytes_per_sec << " MB/s"
+				<< " | copy = " << copy_usec << " usec"
+				<< " | reorder = " << reorder_usec << " usec";
 
-				int one_frame = 1;
+	m_status = Camera::Ready;
+}
 
-				//- Declare local temporary image buffer
-				void**	image_array;
+//-----------------------------------------------------
+//		Readout dead time of one image: difference between a sequence of N images and a single
+//		image (with the shortest exposure) removes the fixed start overhead of the sequence
+//-----------------------------------------------------
+double Camera::_measureReadoutUsec(IMG_TYPE pixel_depth, unsigned format, vector<void*>& image_array)
+{
+	DEB_MEMBER_FUNCT();
 
-				// allocate multiple buffers
-				DEB_TRACE() <<"Allocating images array (" << one_frame << " images)";
-				if(m_pixel_depth == B2)
-					image_array = reinterpret_cast<void**>(new uint16_t* [ one_frame ]);
-				else//B4
-					image_array = reinterpret_cast<void**>(new uint32_t* [ one_frame ]);
+	double seq_usec[2];
+	unsigned nb_images[2] = {1, READOUT_CALIB_NB_IMAGES};
+	for (int k = 0; k < 2; k++)
+	{
+		if (m_stop_asked)
+			throw LIMA_HW_EXC(Error, "calibrateReadoutModel: stopped");
+		setExposureParameters(	(unsigned)MIN_EXP_TIME_USEC, 0, 0,
+								m_shutter_time_usec, m_ovf_refresh_time_usec, 0,
+								XPIX_NOT_USED_YET, XPIX_NOT_USED_YET,
+								nb_images[k], XPIX_NOT_USED_YET, format,
+								(m_xpad_model == IMXPAD_S140)?1:XPIX_NOT_USED_YET,
+								XPIX_NOT_USED_YET, XPIX_NOT_USED_YET, XPIX_NOT_USED_YET, XPIX_NOT_USED_YET);
+		Timestamp t0 = Timestamp::now();
+		if (xpci_getImgSeq(	pixel_depth, m_modules_mask, m_chip_number, nb_images[k], &image_array[0],
+							XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY,
+							XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY) == -1)
+			throw LIMA_HW_EXC(Error, "calibrateReadoutModel: xpci_getImgSeq as returned an error ! ");
+		seq_usec[k] = (Timestamp::now() - t0) * 1e6;
+	}
+	return (seq_usec[1] - seq_usec[0]) / (READOUT_CALIB_NB_IMAGES - 1) - MIN_EXP_TIME_USEC;
+}
 
-				DEB_TRACE() <<"Allocating every image pointer of the images array (1 image full size = "<< m_full_image_size_in_bytes << ") ";
-				for( int i=0 ; i < one_frame ; i++ )
-				{
-					if(m_pixel_depth == B2)
-						image_array[i] = new uint16_t [ m_full_image_size_in_bytes / 2 ];//we allocate a number of pixels
-					else //B4
-						image_array[i] = new uint32_t [ m_full_image_size_in_bytes / 4 ];//we allocate a number of pixels
-				}
+//-----------------------------------------------------
+//		Size of one image ((80 columns * 7 chips) * pixel size) * 120 lines * nb modules
+//-----------------------------------------------------
+int Camera::_getFrameSizeInBytes()
+{
+	int pixel_size = (m_pixel_depth == B2) ? 2 : 4;
+	return ((80 * m_chip_number) * pixel_size) * (120 * m_module_number);
+}
 
-				m_status = Camera::Exposure;
-
-				//- Start the img sequence
-				DEB_TRACE() <<"Start acquiring a sequence of images";
-
-				if ( xpci_getImgSeq(	m_pixel_depth, 
-					                    m_modules_mask,
-					                    m_chip_number,
-                            			one_frame,
-                            			(void**)image_array,
-                            			// next are ignored in V2:
-                            			XPIX_V1_COMPATIBILITY,
-					                    XPIX_V1_COMPATIBILITY,
-					                    XPIX_V1_COMPATIBILITY,
-					                    XPIX_V1_COMPATIBILITY) == -1)
-				{
-					DEB_ERROR() << "Error: getImgSeq as returned an error..." ;
+//-----------------------------------------------------
+//		Readout dead time of one image (chips readout + transfer)
+//-----------------------------------------------------
+double Camera::_getFrameDeadTimeUsec()
+{
+	double frame_mbytes = _getFrameSizeInBytes() / 1048576.;
+	return m_readout_model.chip_readout_usec + frame_mbytes / m_readout_model.link_mbytes_per_sec * 1e6;
+}
 
-					DEB_TRACE() << "Freeing every image pointer of the images array";
-					for(int i=0 ; i < one_frame ; i++)
-					{
-						if(m_pixel_depth == B2)
-							delete[] reinterpret_cast<uint16_t*>(image_array[i]);
-						else
-							delete[] reinterpret_cast<uint32_t*>(image_array[i]);
-					}
-
-					DEB_TRACE() << "Freeing images array";
-					if(m_pixel_depth == B2)
-						delete[] reinterpret_cast<uint16_t**>(image_array);
-					else//B4
-						delete[] reinterpret_cast<uint32_t**>(image_array);
+//-----------------------------------------------------
+//		Host time spent on one image on the readout path: its copy in the lima buffer (none
+//		when the driver writes in place). xpci_getImgSeq delivers the lines in order, the
+//		reorder cost does not apply, and the host stages run on the publication thread
+//-----------------------------------------------------
+double Camera::_getHostFrameTimeUsec()
+{
+	int nb_buffers, nb_concat_frames;
+	m_buffer_cb_mgr.getNbBuffers(nb_buffers);
+	m_buffer_cb_mgr.getNbConcatFrames(nb_concat_frames);
+	int nb_sequence_frames = (m_nb_frames == 0) ? 1 : m_nb_frames;
+	if (m_raw_mode && nb_sequence_frames <= nb_buffers * nb_concat_frames)
+		return 0.;
+
+	double frame_mbytes = _getFrameSizeInBytes() / 1048576.;
+	return frame_mbytes * m_readout_model.host_copy_usec_per_mbyte;
+}
 
-					m_status = Camera::Fault;
-                    throw LIMA_HW_EXC(Error, "xpci_getImgSeq as returned an error ! ");
-				}
+//-----------------------------------------------------
+//		The ring is created at the next start (its frame size is the one of the acquisition)
+//-----------------------------------------------------
+void Camera::setFrameRing(const string& name, int nb_slots)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(name, nb_slots);
+
+	if (!name.empty() && nb_slots < 1)
+		throw LIMA_HW_EXC(InvalidValue, "Frame ring: invalid nb of slots");
+
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	delete m_frame_ring;
+	m_frame_ring = NULL;
+	m_frame_ring_name = name;
+	m_frame_ring_nb_slots = name.empty() ? 0 : nb_slots;
+}
 
-				m_status = Camera::Readout;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getFrameRing(string& name, int& nb_slots)
+{
+	name = m_frame_ring_name;
+	nb_slots = m_frame_ring_nb_slots;
+}
 
-				DEB_TRACE() 	<< "\n#######################"
-								<< "\nall images are acquired"
-								<< "\n#######################" ;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getFrameRingStats(unsigned long& nb_written, unsigned long& nb_overruns, unsigned long& lag)
+{
+	DEB_MEMBER_FUNCT();
 
-				int	i=0;
+	uint64_t written = 0, overruns = 0, ring_lag = 0;
+	AutoMutex aLock(m_cond.mutex());
+	if (m_frame_ring)
+		m_frame_ring->getStats(written, overruns, ring_lag);
+	nb_written = written;
+	nb_overruns = overruns;
+	lag = ring_lag;
+}
 
-				//- Publish each image and call new frame ready for each frame
-				StdBufferCbMgr& buffer_mgr = m_buffer_cb_mgr;
-				DEB_TRACE() <<"Publish each acquired image through newFrameReady()";
-				for(i=0; i<one_frame; i++)
-				{
-                    m_current_nb_frames = i;
-					int buffer_nb, concat_frame_nb;
-					buffer_mgr.setStartTimestamp(Timestamp::now());
-					buffer_mgr.acqFrameNb2BufferNb(i, buffer_nb, concat_frame_nb);
-
-					void* lima_img_ptr;
-					if(m_pixel_depth == B2)
-						lima_img_ptr = (uint16_t*)(buffer_mgr.getBufferPtr(buffer_nb,concat_frame_nb));
-					else//B4
-						lima_img_ptr = (uint32_t*)(buffer_mgr.getBufferPtr(buffer_nb,concat_frame_nb));
-
-					//- copy image in the lima buffer
-					if(m_pixel_depth == B2)
-						memcpy((uint16_t *)lima_img_ptr, (uint16_t *)image_array[i],m_full_image_size_in_bytes);
-					else//B4
-						memcpy((uint32_t *)lima_img_ptr, (uint32_t *)image_array[i],m_full_image_size_in_bytes);
-
-					DEB_TRACE() << "image# " << i <<" cleaned" ;
-					HwFrameInfoType frame_info;
-					frame_info.acq_frame_nb = i;
-					//- raise the image to Lima
-					buffer_mgr.newFrameReady(frame_info);
-				}
+//-----------------------------------------------------
+//		The clients can connect as soon as the streaming is set
+//-----------------------------------------------------
+void Camera::setFrameStreaming(const string& address, Camera::StreamPolicy policy, int queue_depth)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(address, policy, queue_depth);
+
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	delete m_frame_streamer;
+	m_frame_streamer = NULL;
+	if (!address.empty())
+		m_frame_streamer = new FrameStreamer(address, FrameStreamer::Policy(policy), queue_depth);
+}
 
-				DEB_TRACE() <<"Freeing every image pointer of the images array";
-				for(int i=0 ; i < one_frame ; i++)
-				{
-					if(m_pixel_depth == B2)
-						delete[] reinterpret_cast<uint16_t*>(image_array[i]);
-					else
-						delete[] reinterpret_cast<uint32_t*>(image_array[i]);
-				}
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getFrameStreamingStats(int& nb_clients, unsigned long& nb_sent, unsigned long& nb_dropped)
+{
+	DEB_MEMBER_FUNCT();
 
-				DEB_TRACE() << "Freeing images array";
-				if(m_pixel_depth == B2)
-					delete[] reinterpret_cast<uint16_t**>(image_array);
-				else//B4
-					delete[] reinterpret_cast<uint32_t**>(image_array);
+	FrameStreamer::Stats stats;
+	memset(&stats, 0, sizeof(stats));
+	AutoMutex aLock(m_cond.mutex());
+	if (m_frame_streamer)
+		m_frame_streamer->getStats(stats);
+	nb_clients = stats.nb_clients;
+	nb_sent = stats.nb_sent;
+	nb_dropped = stats.nb_dropped;
+}
 
-				m_status = Camera::Ready;
-				DEB_TRACE() <<"m_status is Ready";
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setCompression(bool enable, int nb_threads)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(enable, nb_threads);
 
-                if (m_stop_asked == false)
-                {
-                    //- Post XPAD_DLL_START_LIVE_ACQ_MSG msg
-		            this->post(new yat::Message(XPAD_DLL_START_LIVE_ACQ_MSG), kPOST_MSG_TMO);
-                }
-			}
-			break;          
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_compression = enable;
+	m_compression_nb_threads = nb_threads;
+}
 
-			//-----------------------------------------------------    
-			case XPAD_DLL_START_ASYNC_MSG:
-			{
-				/*************
-			 	DEB_TRACE() <<"Camera::->XPAD_DLL_START_FAST_ASYNC_MSG";
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getCompression(bool& enable, int& nb_threads)
+{
+	enable = m_compression;
+	nb_threads = m_compression_nb_threads;
+}
 
-				 //- A mettre dans le prepareAcq?
-				 // allocate multiple buffers
-				 DEB_TRACE() <<"allocating images array (" << m_nb_frames << " images)";
-				 pSeqImage = new uint16_t* [ m_nb_frames ];
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setCompressedFrameListener(Camera::CompressedFrameListener* listener)
+{
+	DEB_MEMBER_FUNCT();
 
-				  DEB_TRACE() <<"allocating every image pointer of the images array (1 image full size = "<< m_full_image_size_in_bytes << ") ";
-				  for( int i=0 ; i < m_nb_frames ; i++ )
-					  pSeqImage[i] = new uint16_t[ m_full_image_size_in_bytes / 2 ];
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_compressed_frame_listener = listener;
+}
 
-				  m_status = Camera::Exposure;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getCompressionStats(unsigned long& nb_frames, double& ratio, double& mbytes_per_sec)
+{
+	DEB_MEMBER_FUNCT();
 
-				  //- Start the img sequence
-				  DEB_TRACE() <<"start acquiring a sequence of images";
-				  cout << " ============================================== " << endl;
-				  cout << "Parametres pour getImgSeqAs: "<< endl;
-				  cout << "m_pixel_depth 	= "<< m_pixel_depth << endl;
-				  cout << "m_modules_mask = "<< m_modules_mask << endl;
-				  cout << "m_chip_number 	= "<< m_chip_number << endl;
-				  cout << "m_trigger_type = "<< m_trigger_type << endl;
-				  cout << "m_exp_time 	= "<< m_exp_time << endl;
-				  cout << "m_time_unit 	= "<< m_time_unit << endl;
-				  cout << "m_nb_frames 	= "<< m_nb_frames << endl;
+	FrameCompressor::Stats stats;
+	m_frame_compressor.getStats(stats);
 
+	nb_frames = stats.nb_frames;
+	ratio = (stats.compressed_mbytes > 0.) ? stats.raw_mbytes / stats.compressed_mbytes : 0.;
+	mbytes_per_sec = (stats.duration > 0.) ? stats.raw_mbytes / stats.duration : 0.;
+}
 
-				  //- Start the acquisition in Async mode
-				  if ( xpci_getImgSeqAs(	m_pixel_depth,
-					  m_modules_mask,
-					  m_chip_number,
-					  NULL, //- callback fct not used
-					  10000, //- callback timeout: 10s
-					  m_trigger_type,
-					  m_exp_time,
-					  m_time_unit,
-					  m_nb_frames,
-					  (void**)pSeqImage,
-					  FIRST_TIMEOUT,
-					  NULL) //- user Parameter not used
-					  == -1)
+//-----------------------------------------------------
+//		The matrix is built now, for the current image size
+//-----------------------------------------------------
+void Camera::setIntegration(bool enable, double distance, double center_x, double center_y, int nb_bins,
+							double tth_min, double tth_max, bool stream_profile_only, int nb_threads)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(enable, distance, nb_bins, stream_profile_only);
 
-				  {
-					  DEB_ERROR() << "Error: getImgSeq as returned an error..." ;
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
 
-					  DEB_TRACE() << "Freeing every image pointer of the images array";
-					  for(int i=0 ; i < m_nb_frames ; i++)
-						  delete[] pSeqImage[i];
+	if (enable)
+	{
+		AzimuthalIntegrator::Geometry geometry;
+		geometry.distance	= distance;
+		geometry.center_x	= center_x;
+		geometry.center_y	= center_y;
+		getPixelSize(geometry.pixel_size_x, geometry.pixel_size_y);
+		geometry.nb_bins	= nb_bins;
+		geometry.tth_min	= tth_min;
+		geometry.tth_max	= tth_max;
+
+		AutoMutex integrationLock(m_integration_lock);
+		m_integrator.init(geometry, m_image_size.getWidth(), m_image_size.getHeight(), nb_threads);
+	}
+	m_integration = enable;
+	m_integration_stream_profile_only = stream_profile_only;
+}
 
-					  DEB_TRACE() << "Freeing images array";
-					  delete[] pSeqImage;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getIntegration(bool& enable, int& nb_bins, bool& stream_profile_only)
+{
+	enable = m_integration;
+	nb_bins = m_integrator.getNbBins();
+	stream_profile_only = m_integration_stream_profile_only;
+}
 
-					  m_status = Camera::Fault;
-					  throw LIMA_HW_EXC(Error, "xpci_getImgSeqAs as returned an error...");
-				  }
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setProfileListener(Camera::ProfileListener* listener)
+{
+	DEB_MEMBER_FUNCT();
 
-				  m_status = Camera::Readout;
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_profile_listener = listener;
+}
 
-				  int nb_images_aquired_before = 0;
-				  int nb_images_acquired = 0;
-				  int current_treated_image = 0;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getLastProfile(vector<float>& tth, vector<float>& intensity)
+{
+	DEB_MEMBER_FUNCT();
 
-							  size_t n1 = 6 + 80 * m_chip_number;
-							  size_t n2 = 80 * m_chip_number;
-				  uint16_t OneLine[n1];
+	AutoMutex aLock(m_integration_lock);
+	int nb_bins = m_integrator.getNbBins();
+	if (!nb_bins)
+		throw LIMA_HW_EXC(Error, "Azimuthal integration not set");
+	tth.assign(m_integrator.getRadialAxis(), m_integrator.getRadialAxis() + nb_bins);
+	intensity.assign(m_integrator.getProfile(), m_integrator.getProfile() + nb_bins);
+}
 
-				  //- While acquisition is running
-				  while(xpci_asyncReadStatus() || current_treated_image < m_nb_frames)
-				  {
-					  //- for debug
-					  //yat::ThreadingUtilities::sleep(0,50000000); //50 ms
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setCircularMode(bool enable, int nb_pre_frames, int nb_post_frames)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(enable, nb_pre_frames, nb_post_frames);
 
-					  //DEB_TRACE() << "----------------------------";
-					  //DEB_TRACE() << "Nb images treated			= " << current_treated_image;
-						  do
-					  {
-						nb_images_acquired = xpci_getGotImages();
-						if ( nb_images_acquired == nb_images_aquired_before )
-						yat::ThreadingUtilities::sleep(0,48000000); //48 ms
-						else
-						break;
-					  }
-					  while (1);
+	if (enable && (nb_pre_frames < 1 || nb_post_frames < 0))
+		throw LIMA_HW_EXC(InvalidValue, "Circular mode: invalid nb of pre or post event frames");
 
-					 // DEB_TRACE() << "Nb images acquired			= " << nb_images_acquired;
-					  //DEB_TRACE() << "Nb images acquired before		= " << nb_images_aquired_before;
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_circular = enable;
+	m_circular_nb_pre_frames = nb_pre_frames;
+	m_circular_nb_post_frames = nb_post_frames;
+}
 
-					  //- ATTENTION : //-MODIF-NL-ICA: THSI IS EXACTLY WHAT WE DON'T WANT!!!!!
-					  //- Xpix acquires a buffer sized according to m_module_number.
-					  //- Displayed/Lima image will be ALWAYS 560*960, even if some modules are not availables !
-					  //- Image zone where a module is not available will be set to "zero"
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getCircularMode(bool& enable, int& nb_pre_frames, int& nb_post_frames)
+{
+	enable = m_circular;
+	nb_pre_frames = m_circular_nb_pre_frames;
+	nb_post_frames = m_circular_nb_post_frames;
+}
 
-					  //XPIX LIB buffer						//Device requested buffer
-					  //--------------						//--------------
-					  //line 1 	mod1						//line 1 	mod1
-					  //line 1 	mod2						//line 2 	mod1
-					  //line 1 	mod3						//line 3 	mod1
-					  //...									//...
-					  //line 1	mod8						//line 120	mod1
-					  //--------------						//--------------
-					  //line 2 	mod1						//line 1 	mod2
-					  //line 2 	mod2						//line 2 	mod2
-					  //line 2 	mod3						//line 3 	mod2
-					  //...									//...
-					  //line 2	mod4						//line 120	mod2
-					  //--------------						//--------------
-					  //...									//...
-					  //--------------						//--------------
-					  //line 120 	mod1						//line 1 	mod8
-					  //line 120 	mod2						//line 2 	mod8
-					  //line 120 	mod3						//line 3 	mod8
-					  //...									//...
-					  //line 120	mod8						//line 120	mod8
+//-----------------------------------------------------
+//		Software event: the ring is frozen after the image being read
+//-----------------------------------------------------
+void Camera::triggerEvent()
+{
+	DEB_MEMBER_FUNCT();
 
-					  int	i=0, j=0, k=0;
-					  //- clean each image and call new frame for each frame
-					  StdBufferCbMgr& buffer_mgr = m_buffer_cb_mgr;
-					  //DEB_TRACE() <<"Cleanning each acquired image and publish it through newFrameReady ...";
-					  for( i = nb_images_aquired_before; i<nb_images_acquired; i++ )
-					  {
-						  nb_images_aquired_before = nb_images_acquired;
+	{
+		AutoMutex aLock(m_cond.mutex());
+		if (!m_circular || m_wait_flag || m_job != Camera::ACQUISITION_JOB)
+			throw LIMA_HW_EXC(Error, "No circular acquisition running");
+	}
+	AutoMutex aLock(m_circular_lock);
+	m_circular_event = true;
+}
 
-						  current_treated_image++;
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getCircularStatus(long& nb_ring_frames, bool& frozen)
+{
+	AutoMutex aLock(m_circular_lock);
+	nb_ring_frames = m_circular_nb_ring_frames;
+	frozen = m_circular_event;
+}
 
-						  pOneImage = pSeqImage[i];
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setPhaseBinning(bool enable, int nb_phases, int nb_cycles)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(enable, nb_phases, nb_cycles);
 
-						  int buffer_nb, concat_frame_nb;
-						  buffer_mgr.setStartTimestamp(Timestamp::now());
+	if (enable && (nb_phases < 1 || nb_cycles < 1))
+		throw LIMA_HW_EXC(InvalidValue, "Phase binning: invalid nb of phases or cycles");
 
-						  buffer_mgr.acqFrameNb2BufferNb(i, buffer_nb, concat_frame_nb);
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_phase_binning = enable;
+	m_phase_nb_phases = nb_phases;
+	m_phase_nb_cycles = nb_cycles;
+}
 
-						  uint16_t *ptr = (uint16_t*)(buffer_mgr.getBufferPtr(buffer_nb,concat_frame_nb));
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getPhaseBinning(bool& enable, int& nb_phases, int& nb_cycles)
+{
+	enable = m_phase_binning;
+	nb_phases = m_phase_nb_phases;
+	nb_cycles = m_phase_nb_cycles;
+}
 
-						  //clean the ptr with zero memory, pixels of a not available module are set to "0"
-						  memset((uint16_t *)ptr,0,m_image_size.getWidth() * m_image_size.getHeight() * 2);
-						  // DEB_TRACE() << "---- Niveau ------- 5 ---- ";
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setRawMode(bool enable)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(enable);
 
-						  //iterate on all lines of all modules returned by xpix API
-						  for(j = 0; j < 120 * m_module_number; j++)
-						  {
-							  //DEB_TRACE() << "---- Niveau ------- 5.1 ---- ";
-							  ::memset(OneLine, 0, n1 * sizeof(uint16_t));
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_raw_mode = enable;
+}
 
-							  //copy entire line with its header and footer
-							  //DEB_TRACE() << "---- Niveau ------- 5.2 ---- ";
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getRawMode(bool& enable)
+{
+	enable = m_raw_mode;
+}
 
-							  for ( k = 0; k < n1; k++ )
-								  OneLine[k] = pOneImage[j * n1 + k];
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setSparseOutput(bool enable, double max_occupancy)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(enable, max_occupancy);
+
+	if (max_occupancy < 0. || max_occupancy > 1.)
+		throw LIMA_HW_EXC(InvalidValue, "Sparse output: invalid occupancy threshold");
+
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_sparse_output = enable;
+	m_sparse_max_occupancy = max_occupancy;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getSparseOutput(bool& enable, double& max_occupancy)
+{
+	enable = m_sparse_output;
+	max_occupancy = m_sparse_max_occupancy;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setSparseFrameListener(Camera::SparseFrameListener* listener)
+{
+	DEB_MEMBER_FUNCT();
+
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_sparse_frame_listener = listener;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getSparseStats(unsigned long& nb_frames, unsigned long& nb_sparse, double& reduction)
+{
+	SparseEncoder::Stats stats;
+	m_sparse_encoder.getStats(stats);
+
+	nb_frames = stats.nb_frames;
+	nb_sparse = stats.nb_sparse;
+	reduction = (stats.hit_bytes > 0.) ? stats.dense_bytes / stats.hit_bytes : 0.;
+}
+
+//-----------------------------------------------------
+//		The tables are built at start, for the exposure time of the acquisition
+//-----------------------------------------------------
+void Camera::setDeadTimeCorrection(bool enable, const vector<double>& tau_ns)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(enable, tau_ns.size());
+
+	if (enable && tau_ns.size() != 1 && int(tau_ns.size()) != m_module_number)
+		throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: one dead time per module (or one for all) is needed");
+	for (size_t i = 0; i < tau_ns.size(); i++)
+		if (tau_ns[i] < 0.)
+			throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: invalid dead time");
+
+	//- live acquisition: the dead times are applied at the next frame boundary, the correction
+	//- can only be switched on or off between two acquisitions
+	if (enable == m_dead_time_correction && _queueLiveCommand(Camera::LIVE_SET_DEAD_TIMES, 0, 0, tau_ns))
+		return;
+
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+	m_dead_time_correction = enable;
+	m_dead_time_tau_ns = tau_ns;
+}
+
+//-----------------------------------------------------
+//		Tables of the dead-time correction (and float conversion) for the current
+//		exposure time and dead times
+//-----------------------------------------------------
+void Camera::_initDeadTimeCorrector()
+{
+	DEB_MEMBER_FUNCT();
+
+	vector<double> tau(m_module_number, 0.);
+	if (m_dead_time_correction)
+		for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+			tau[mod_idx] = 1e-9 * m_dead_time_tau_ns[(m_dead_time_tau_ns.size() == 1) ? 0 : mod_idx];
+	//- a phase sum holds the counts of nb_cycles exposures
+	double exp_time = m_exp_time_usec * 1e-6 * (m_phase_binning ? m_phase_nb_cycles : 1);
+	int nb_pixels = m_image_size.getWidth() * m_image_size.getHeight();
+	m_dead_time_corrector.init(m_module_number, nb_pixels / m_module_number,
+							   m_full_image_size_in_bytes / nb_pixels, exp_time, tau, m_float_output);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getDeadTimeCorrection(bool& enable, vector<double>& tau_ns)
+{
+	enable = m_dead_time_correction;
+	tau_ns = m_dead_time_tau_ns;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setNbFrames(int nb_frames)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_frames);
+	m_nb_frames = nb_frames;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getNbFrames(int& nb_frames)
+{
+	DEB_MEMBER_FUNCT();
+	nb_frames = m_nb_frames;
+	DEB_RETURN() << DEB_VAR1(nb_frames);
+}
+
+//---------------------------------------------------------------------------------------
+// Camera::getNbHwAcquiredFrames()
+//---------------------------------------------------------------------------------------
+int Camera::getNbHwAcquiredFrames()
+{
+	return m_current_nb_frames + 1; //- because m_current_nb_frames start at 0 
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getStatus(Camera::Status& status)
+{
+	DEB_MEMBER_FUNCT();
+	status = m_status;
+	DEB_RETURN() << DEB_VAR1(DEB_HEX(status));
+}
+ 
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::handle_message( yat::Message& msg )  throw( yat::Exception )
+{
+	DEB_MEMBER_FUNCT();
+	try
+	{
+		switch ( msg.type() )
+		{
+			//-----------------------------------------------------	
+		case yat::TASK_INIT:
+			{
+				DEB_TRACE() <<"Camera::->TASK_INIT";          
+			}
+			break;
+			//-----------------------------------------------------    
+		case yat::TASK_EXIT:
+			{
+				DEB_TRACE() <<"Camera::->TASK_EXIT";                
+			}
+			break;
+			//-----------------------------------------------------    
+		case yat::TASK_TIMEOUT:
+			{
+				DEB_TRACE() <<"Camera::->TASK_TIMEOUT";       
+			}
+			break;
+			//-----------------------------------------------------    
+			case XPAD_DLL_START_ASYNC_MSG:
+			{
+				/*************
+			 	DEB_TRACE() <<"Camera::->XPAD_DLL_START_FAST_ASYNC_MSG";
+
+				 //- A mettre dans le prepareAcq?
+				 // allocate multiple buffers
+				 DEB_TRACE() <<"allocating images array (" << m_nb_frames << " images)";
+				 pSeqImage = new uint16_t* [ m_nb_frames ];
+
+				  DEB_TRACE() <<"allocating every image pointer of the images array (1 image full size = "<< m_full_image_size_in_bytes << ") ";
+				  for( int i=0 ; i < m_nb_frames ; i++ )
+					  pSeqImage[i] = new uint16_t[ m_full_image_size_in_bytes / 2 ];
+
+				  m_status = Camera::Exposure;
+
+				  //- Start the img sequence
+				  DEB_TRACE() <<"start acquiring a sequence of images";
+				  cout << " ============================================== " << endl;
+				  cout << "Parametres pour getImgSeqAs: "<< endl;
+				  cout << "m_pixel_depth 	= "<< m_pixel_depth << endl;
+				  cout << "m_modules_mask = "<< m_modules_mask << endl;
+				  cout << "m_chip_number 	= "<< m_chip_number << endl;
+				  cout << "m_trigger_type = "<< m_trigger_type << endl;
+				  cout << "m_exp_time 	= "<< m_exp_time << endl;
+				  cout << "m_time_unit 	= "<< m_time_unit << endl;
+				  cout << "m_nb_frames 	= "<< m_nb_frames << endl;
+
+
+				  //- Start the acquisition in Async mode
+				  if ( xpci_getImgSeqAs(	m_pixel_depth,
+					  m_modules_mask,
+					  m_chip_number,
+					  NULL, //- callback fct not used
+					  10000, //- callback timeout: 10s
+					  m_trigger_type,
+					  m_exp_time,
+					  m_time_unit,
+					  m_nb_frames,
+					  (void**)pSeqImage,
+					  FIRST_TIMEOUT,
+					  NULL) //- user Parameter not used
+					  == -1)
+
+				  {
+					  DEB_ERROR() << "Error: getImgSeq as returned an error..." ;
+
+					  DEB_TRACE() << "Freeing every image pointer of the images array";
+					  for(int i=0 ; i < m_nb_frames ; i++)
+						  delete[] pSeqImage[i];
+
+					  DEB_TRACE() << "Freeing images array";
+					  delete[] pSeqImage;
+
+					  m_status = Camera::Fault;
+					  throw LIMA_HW_EXC(Error, "xpci_getImgSeqAs as returned an error...");
+				  }
+
+				  m_status = Camera::Readout;
+
+				  int nb_images_aquired_before = 0;
+				  int nb_images_acquired = 0;
+				  int current_treated_image = 0;
+
+							  size_t n1 = 6 + 80 * m_chip_number;
+							  size_t n2 = 80 * m_chip_number;
+				  uint16_t OneLine[n1];
+
+				  //- While acquisition is running
+				  while(xpci_asyncReadStatus() || current_treated_image < m_nb_frames)
+				  {
+					  //- for debug
+					  //yat::ThreadingUtilities::sleep(0,50000000); //50 ms
+
+					  //DEB_TRACE() << "----------------------------";
+					  //DEB_TRACE() << "Nb images treated			= " << current_treated_image;
+						  do
+					  {
+						nb_images_acquired = xpci_getGotImages();
+						if ( nb_images_acquired == nb_images_aquired_before )
+						yat::ThreadingUtilities::sleep(0,48000000); //48 ms
+						else
+						break;
+					  }
+					  while (1);
+
+					 // DEB_TRACE() << "Nb images acquired			= " << nb_images_acquired;
+					  //DEB_TRACE() << "Nb images acquired before		= " << nb_images_aquired_before;
+
+					  //- ATTENTION : //-MODIF-NL-ICA: THSI IS EXACTLY WHAT WE DON'T WANT!!!!!
+					  //- Xpix acquires a buffer sized according to m_module_number.
+					  //- Displayed/Lima image will be ALWAYS 560*960, even if some modules are not availables !
+					  //- Image zone where a module is not available will be set to "zero"
+
+					  //XPIX LIB buffer						//Device requested buffer
+					  //--------------						//--------------
+					  //line 1 	mod1						//line 1 	mod1
+					  //line 1 	mod2						//line 2 	mod1
+					  //line 1 	mod3						//line 3 	mod1
+					  //...									//...
+					  //line 1	mod8						//line 120	mod1
+					  //--------------						//--------------
+					  //line 2 	mod1						//line 1 	mod2
+					  //line 2 	mod2						//line 2 	mod2
+					  //line 2 	mod3						//line 3 	mod2
+					  //...									//...
+					  //line 2	mod4						//line 120	mod2
+					  //--------------						//--------------
+					  //...									//...
+					  //--------------						//--------------
+					  //line 120 	mod1						//line 1 	mod8
+					  //line 120 	mod2						//line 2 	mod8
+					  //line 120 	mod3						//line 3 	mod8
+					  //...									//...
+					  //line 120	mod8						//line 120	mod8
+
+					  int	i=0, j=0, k=0;
+					  //- clean each image and call new frame for each frame
+					  StdBufferCbMgr& buffer_mgr = m_buffer_cb_mgr;
+					  //DEB_TRACE() <<"Cleanning each acquired image and publish it through newFrameReady ...";
+					  for( i = nb_images_aquired_before; i<nb_images_acquired; i++ )
+					  {
+						  nb_images_aquired_before = nb_images_acquired;
+
+						  current_treated_image++;
+
+						  pOneImage = pSeqImage[i];
+
+						  int buffer_nb, concat_frame_nb;
+						  buffer_mgr.setStartTimestamp(Timestamp::now());
+
+						  buffer_mgr.acqFrameNb2BufferNb(i, buffer_nb, concat_frame_nb);
+
+						  uint16_t *ptr = (uint16_t*)(buffer_mgr.getBufferPtr(buffer_nb,concat_frame_nb));
+
+						  //clean the ptr with zero memory, pixels of a not available module are set to "0"
+						  memset((uint16_t *)ptr,0,m_image_size.getWidth() * m_image_size.getHeight() * 2);
+						  // DEB_TRACE() << "---- Niveau ------- 5 ---- ";
+
+						  //iterate on all lines of all modules returned by xpix API
+						  for(j = 0; j < 120 * m_module_number; j++)
+						  {
+							  //DEB_TRACE() << "---- Niveau ------- 5.1 ---- ";
+							  ::memset(OneLine, 0, n1 * sizeof(uint16_t));
+
+							  //copy entire line with its header and footer
+							  //DEB_TRACE() << "---- Niveau ------- 5.2 ---- ";
+
+							  for ( k = 0; k < n1; k++ )
+								  OneLine[k] = pOneImage[j * n1 + k];
+
+							  //compute "offset line" where to copy OneLine[] in the *ptr, to ensure that the lines are copied in order of modules
+							  //DEB_TRACE() << "---- Niveau ------- 5.3 ---- ";
+							  int offset = ((120 * (OneLine[1] )) + (OneLine[4] - 1));
+
+							  //copy cleaned line in the lima buffer
+							  //DEB_TRACE() << "---- Niveau ------- 5.4 ---- ";
+							  for(k = 0; k < n2; k++)
+								  ptr[offset * n2 + k] = OneLine[5 + k];
+						  }
+						  //DEB_TRACE() << "---- Niveau ------- 6 ---- ";
+
+						  DEB_TRACE() << "image# " << i <<" cleaned" ;
+						  HwFrameInfoType frame_info;
+						  //DEB_TRACE() << "---- Niveau ------- 7 ---- ";
+						  frame_info.acq_frame_nb = i;
+						  //- raise the image to lima
+						  buffer_mgr.newFrameReady(frame_info);
+						  //DEB_TRACE() << "---- Niveau ------- 8 ---- ";
+					  }
+				  }
+
+				  DEB_TRACE() <<"Freeing every image pointer of the images array";
+				  for(int j=0 ; j < m_nb_frames ; j++)
+					  delete[] pSeqImage[j];
+				  DEB_TRACE() <<"Freeing images array";
+				  delete[] pSeqImage;
+				  m_status = Camera::Ready;
+				  DEB_TRACE() <<"m_status is Ready";
+			
+                    */
+		  }
+		  break;
+		}
+  }
+  catch( yat::Exception& ex )
+  {
+	  DEB_ERROR() << "Error : " << ex.errors[0].desc;
+  }
+}
+
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getControlLatency(double& latency)
+{
+	DEB_MEMBER_FUNCT();
+	AutoMutex aLock(m_cond.mutex());
+	latency = m_control_latency;
+	DEB_RETURN() << DEB_VAR1(latency);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setAcqThreadAffinity(unsigned long cpu_mask)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(DEB_HEX(cpu_mask));
+	m_acq_thread_cpu_mask = cpu_mask;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getAcqThreadAffinity(unsigned long& cpu_mask)
+{
+	DEB_MEMBER_FUNCT();
+	cpu_mask = m_acq_thread_cpu_mask;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getBoardNumber(int& board_num)
+{
+	board_num = m_board_num;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setAcqThreadRealTimePriority(int rt_priority)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(rt_priority);
+
+	if (rt_priority < 0 || rt_priority > sched_get_priority_max(SCHED_FIFO))
+		throw LIMA_HW_EXC(InvalidValue, "Real time priority out of range");
+	m_acq_thread_rt_priority = rt_priority;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getAcqThreadRealTimePriority(int& rt_priority)
+{
+	DEB_MEMBER_FUNCT();
+	rt_priority = m_acq_thread_rt_priority;
+}
+
+//-----------------------------------------------------
+//		Apply the affinity and the scheduling to the calling (acquisition) thread
+//-----------------------------------------------------
+void Camera::_applyAcqThreadScheduling()
+{
+	DEB_MEMBER_FUNCT();
+
+	pthread_t self = pthread_self();
+
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	int nb_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	for (int cpu = 0; cpu < nb_cpus && cpu < CPU_SETSIZE; cpu++)
+		if (m_acq_thread_cpu_mask == 0 || (cpu < (int)(8 * sizeof(unsigned long)) && (m_acq_thread_cpu_mask & (1UL << cpu))))
+			CPU_SET(cpu, &cpu_set);
+	if (pthread_setaffinity_np(self, sizeof(cpu_set), &cpu_set) != 0)
+		DEB_WARNING() << "Could not set the acquisition thread affinity to " << DEB_HEX(m_acq_thread_cpu_mask);
+
+	struct sched_param param;
+	param.sched_priority = m_acq_thread_rt_priority;
+	int policy = (m_acq_thread_rt_priority > 0) ? SCHED_FIFO : SCHED_OTHER;
+	if (pthread_setschedparam(self, policy, &param) != 0)
+		DEB_WARNING() << "Could not set the acquisition thread scheduling (SCHED_FIFO needs CAP_SYS_NICE)";
+}
+
+//-----------------------------------------------------
+//		Acquisition thread main loop
+//-----------------------------------------------------
+void Camera::AcqThread::threadFunction()
+{
+	DEB_MEMBER_FUNCT();
+
+	AutoMutex aLock(m_cam.m_cond.mutex());
+	while (!m_cam.m_quit)
+	{
+		while (m_cam.m_wait_flag && !m_cam.m_quit)
+		{
+			m_cam.m_thread_running = false;
+			m_cam.m_cond.broadcast();
+			m_cam.m_cond.wait();
+		}
+		if (m_cam.m_quit)
+			break;
+
+		//- time the job (start, calibration, scan) waited for the acquisition thread
+		m_cam.m_thread_running = true;
+		m_cam.m_control_latency = Timestamp::now() - m_cam.m_job_post_ts;
+		DEB_TRACE() << "Control command latency = " << m_cam.m_control_latency << " s";
+		aLock.unlock();
+
+		try
+		{
+			m_cam._applyAcqThreadScheduling();
+			if (m_cam.m_job == Camera::CALIBRATION_JOB)
+				m_cam._calibrate();
+			else if (m_cam.m_job == Camera::SCAN_JOB)
+				m_cam._thresholdScan();
+			else if (m_cam.m_job == Camera::READOUT_CALIBRATION_JOB)
+				m_cam._calibrateReadoutModel();
+			else if (m_cam.m_circular)
+				m_cam._acquireCircular();
+			else if (m_cam.m_phase_binning)
+				m_cam._acquirePhaseBinning();
+			else if (m_cam.m_nb_frames == 0) //- aka live mode
+				m_cam._acquireLive();
+			else
+				m_cam._acquire(m_cam.m_nb_frames);
+		}
+		catch (Exception& e)
+		{
+			DEB_ERROR() << "Acquisition failed: " << e.getErrMsg();
+			m_cam.m_status = Camera::Fault;
+		}
+
+		//- the job ends with the host stages of its frames
+		if (!m_cam._waitHostFrames())
+			m_cam.m_status = Camera::Fault;
+
+		aLock.lock();
+		m_cam.m_wait_flag = true;
+	}
+	m_cam.m_thread_running = false;
+	m_cam.m_cond.broadcast();
+}
+
+//-----------------------------------------------------
+//		SYNC acquisition of a sequence of images
+//-----------------------------------------------------
+void Camera::_acquire(int nb_frames)
+{
+	DEB_MEMBER_FUNCT();
+
+	m_buffer_cb_mgr.setStartTimestamp(Timestamp::now());
+	_acquireWithRecovery(nb_frames, 0);
+
+	m_status = Camera::Ready;
+	DEB_TRACE() <<"m_status is Ready";
+}
+
+//-----------------------------------------------------
+//		Live acquisition: one image after the other until stop
+//-----------------------------------------------------
+void Camera::_acquireLive()
+{
+	DEB_MEMBER_FUNCT();
+
+	{
+		AutoMutex aLock(m_live_lock);
+		m_live_running = true;
+	}
+	m_live_snapshot_dirty = false;
+
+	m_buffer_cb_mgr.setStartTimestamp(Timestamp::now());
+	try
+	{
+		for (int frame_nb = 0; !m_stop_asked; frame_nb++)
+		{
+			_applyLiveCommands(true);
+			_acquireWithRecovery(1, frame_nb);
+		}
+	}
+	catch (Exception&)
+	{
+		_endLive();
+		throw;
+	}
+	_endLive();
+
+	m_status = Camera::Ready;
+	DEB_TRACE() <<"m_status is Ready";
+}
+
+//-----------------------------------------------------
+//		Pre-trigger circular acquisition: one image after the other in the ring until
+//		the event (no host stage meanwhile), then the post event images. The ring, oldest
+//		image first, and the post event images are published with their readout time.
+//		The event has to be seen between two images, and the library has no read of a
+//		running sequence image by image: one sequence per image, re-armed each time.
+//-----------------------------------------------------
+void Camera::_acquireCircular()
+{
+	DEB_MEMBER_FUNCT();
+
+	int nb_pre = m_circular_nb_pre_frames;
+	int nb_post = m_circular_nb_post_frames;
+	vector<char> images(size_t(nb_pre + nb_post) * m_full_image_size_in_bytes);
+	vector<void*> slots(nb_pre + nb_post);
+	vector<double> capture_times(nb_pre + nb_post, 0.);
+	for (int i = 0; i < nb_pre + nb_post; i++)
+		slots[i] = &images[size_t(i) * m_full_image_size_in_bytes];
+	HostFramesRelease release(*this);
+
+	{
+		AutoMutex aLock(m_circular_lock);
+		m_circular_event = false;
+		m_circular_nb_ring_frames = 0;
+	}
+
+	m_buffer_cb_mgr.setStartTimestamp(Timestamp::now());
+
+	//- 1. the ring runs until the event (or stop)
+	long nb_ring_frames = 0;
+	bool frozen = false;
+	while (!m_stop_asked && !frozen)
+	{
+		int slot = nb_ring_frames % nb_pre;
+		if (xpci_getImgSeq(m_pixel_depth, m_modules_mask, m_chip_number, 1, &slots[slot],
+						   XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY,
+						   XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY) == -1)
+		{
+			if (m_stop_asked)
+				break;
+			m_status = Camera::Fault;
+			throw LIMA_HW_EXC(Error, "Circular acquisition: xpci_getImgSeq as returned an error ! ");
+		}
+		capture_times[slot] = Timestamp::now();
+		nb_ring_frames++;
+
+		AutoMutex aLock(m_circular_lock);
+		m_circular_nb_ring_frames = nb_ring_frames;
+		frozen = m_circular_event;
+	}
+	if (!frozen)
+	{
+		DEB_TRACE() << "Circular acquisition stopped before the event: nothing published";
+		m_status = Camera::Ready;
+		return;
+	}
+	DEB_TRACE() << "Event after " << nb_ring_frames << " ring images";
+
+	//- 2. post event images (the ones read before a stop are still published)
+	int nb_post_done = 0;
+	for (; nb_post_done < nb_post && !m_stop_asked; nb_post_done++)
+	{
+		if (xpci_getImgSeq(m_pixel_depth, m_modules_mask, m_chip_number, 1, &slots[nb_pre + nb_post_done],
+						   XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY,
+						   XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY) == -1)
+		{
+			if (m_stop_asked)
+				break;
+			m_status = Camera::Fault;
+			throw LIMA_HW_EXC(Error, "Circular acquisition: xpci_getImgSeq as returned an error ! ");
+		}
+		capture_times[nb_pre + nb_post_done] = Timestamp::now();
+	}
+
+	//- 3. publish in order: ring from its oldest image, then the post event images
+	m_status = Camera::Readout;
+	int nb_ring = min(nb_ring_frames, long(nb_pre));
+	long first = nb_ring_frames - nb_ring;
+	for (int i = 0; i < nb_ring; i++)
+	{
+		int slot = (first + i) % nb_pre;
+		_publishFrame(i, slots[slot], capture_times[slot]);
+	}
+	for (int i = 0; i < nb_post_done; i++)
+		_publishFrame(nb_ring + i, slots[nb_pre + i], capture_times[nb_pre + i]);
+
+	m_status = Camera::Ready;
+	DEB_TRACE() <<"m_status is Ready";
+}
+
+//-----------------------------------------------------
+//		Pump-probe phase binning: each block of nb_cycles cycles is read in one sequence,
+//		its frames summed by phase (widening adds in 32 bits) and the sums published
+//-----------------------------------------------------
+void Camera::_acquirePhaseBinning()
+{
+	DEB_MEMBER_FUNCT();
+
+	int nb_phases = m_phase_nb_phases;
+	int nb_block_frames = nb_phases * m_phase_nb_cycles;
+	int nb_blocks = m_nb_frames / nb_phases;
+	int nb_pixels = m_image_size.getWidth() * m_image_size.getHeight();
+	bool is_32_bits = (m_full_image_size_in_bytes / nb_pixels == 4);
+
+	vector<char> images(size_t(nb_block_frames) * m_full_image_size_in_bytes);
+	vector<void*> image_array(nb_block_frames);
+	for (int i = 0; i < nb_block_frames; i++)
+		image_array[i] = &images[size_t(i) * m_full_image_size_in_bytes];
+	//- one sum per phase: the host stages of a block read them until the next block is summed
+	vector<char> sum_frames(size_t(nb_phases) * m_full_image_size_in_bytes);
+	HostFramesRelease release(*this);
+	PhaseAccumulator accumulator;
+	accumulator.init(nb_pixels, nb_phases);
+
+	m_buffer_cb_mgr.setStartTimestamp(Timestamp::now());
+	for (int block = 0; block < nb_blocks && !m_stop_asked; block++)
+	{
+		//- the first block is programmed by start
+		if (block > 0)
+			_setExposureParameters(nb_block_frames);
+
+		m_status = Camera::Exposure;
+		int ret = xpci_getImgSeq(m_pixel_depth, m_modules_mask, m_chip_number, nb_block_frames, &image_array[0],
+								 XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY,
+								 XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY);
+		//- on abort, the cycles read before the stop are still summed
+		int nb_acquired = nb_block_frames;
+		if (m_stop_asked)
+			nb_acquired = min(max(xpci_getGotImages(), 0), nb_block_frames);
+		else if (ret == -1)
+		{
+			m_status = Camera::Fault;
+			throw LIMA_HW_EXC(Error, "Phase binning: xpci_getImgSeq as returned an error ! ");
+		}
+
+		m_status = Camera::Readout;
+		accumulator.reset();
+		for (int i = 0; i < nb_acquired; i++)
+			accumulator.addFrame(i % nb_phases, image_array[i], is_32_bits);
+
+		_releaseHostFrames();
+		for (int phase = 0; phase < nb_phases; phase++)
+		{
+			void* sum_frame = &sum_frames[size_t(phase) * m_full_image_size_in_bytes];
+			accumulator.getFrame(phase, sum_frame, is_32_bits);
+			_publishFrame(block * nb_phases + phase, sum_frame);
+		}
+		DEB_TRACE() << "Phase binning: block " << block << " published (" << nb_acquired << " frames)";
+	}
+
+	m_status = Camera::Ready;
+	DEB_TRACE() <<"m_status is Ready";
+}
+
+//-----------------------------------------------------
+//		Queue a parameter update if a live acquisition is running: false if not
+//-----------------------------------------------------
+bool Camera::_queueLiveCommand(Camera::LiveCommandType type, unsigned long reg, long value,
+							   const vector<double>& values)
+{
+	DEB_MEMBER_FUNCT();
+
+	AutoMutex aLock(m_live_lock);
+	if (!m_live_running)
+		return false;
+
+	LiveCommand cmd;
+	cmd.type	= type;
+	cmd.reg		= reg;
+	cmd.value	= value;
+	cmd.values	= values;
+	m_live_commands.push_back(cmd);
+	DEB_TRACE() << "Live command " << type << " queued (" << m_live_commands.size() << " pending)";
+	return true;
+}
+
+//-----------------------------------------------------
+//		Apply the queued parameter updates (between two live frames): the queue is
+//		swapped under the lock so that the updates of a frame boundary are a whole
+//-----------------------------------------------------
+void Camera::_applyLiveCommands(bool reprogram_exposure)
+{
+	DEB_MEMBER_FUNCT();
+
+	deque<LiveCommand> commands;
+	{
+		AutoMutex aLock(m_live_lock);
+		if (m_live_commands.empty())
+			return;
+		commands.swap(m_live_commands);
+	}
+
+	bool exposure_changed = false;
+	bool dead_times_changed = false;
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		const LiveCommand& cmd = commands[i];
+		try
+		{
+			switch (cmd.type)
+			{
+			case Camera::LIVE_SET_EXP_TIME:
+				m_exp_time_usec = cmd.value;
+				exposure_changed = true;
+				break;
+			case Camera::LIVE_STEP_ITHL:
+				_stepITHL(cmd.value);
+				break;
+			case Camera::LIVE_LOAD_CONFIG_G:
+				_loadConfigG(cmd.reg, cmd.value);
+				break;
+			case Camera::LIVE_SET_DEAD_TIMES:
+				m_dead_time_tau_ns = cmd.values;
+				dead_times_changed = true;
+				break;
+			}
+		}
+		catch (Exception& e)
+		{
+			//- the live acquisition goes on with the previous parameters
+			DEB_ERROR() << "Live command " << cmd.type << " failed: " << e.getErrMsg();
+		}
+	}
+
+	if (exposure_changed)
+	{
+		if (reprogram_exposure)
+			_setExposureParameters(1);
+		_updateExposureState();
+	}
+	//- the correction tables depend on the exposure time and on the dead times
+	if ((exposure_changed || dead_times_changed) && (m_dead_time_correction || m_float_output))
+		_initDeadTimeCorrector();
+	//- the snapshot is written at the end of the live acquisition, not between two frames
+	m_live_snapshot_dirty = true;
+}
+
+//-----------------------------------------------------
+//		End of the live acquisition: the updates queued meanwhile are applied now,
+//		the exposure is programmed by the next start, the snapshot is written once
+//-----------------------------------------------------
+void Camera::_endLive()
+{
+	{
+		AutoMutex aLock(m_live_lock);
+		m_live_running = false;
+	}
+	_applyLiveCommands(false);
+	if (m_live_snapshot_dirty)
+	{
+		m_live_snapshot_dirty = false;
+		_saveSnapshot();
+	}
+}
+
+//-----------------------------------------------------
+//		Acquire nb_frames images, recovering in place from driver errors
+//-----------------------------------------------------
+void Camera::_acquireWithRecovery(int nb_frames, int first_frame_nb)
+{
+	DEB_MEMBER_FUNCT();
+
+	int nb_attempts = 0;
+	while (true)
+	{
+		try
+		{
+			int nb_done = m_current_nb_frames + 1 - first_frame_nb;
+			if (nb_done < nb_frames)
+				_acquireImages(nb_frames - nb_done, first_frame_nb + nb_done);
+			return;
+		}
+		catch (Exception& e)
+		{
+			int nb_done = m_current_nb_frames + 1 - first_frame_nb;
+			if (m_stop_asked || nb_attempts >= m_max_recovery_attempts)
+				throw;
+			nb_attempts++;
+			DEB_WARNING() << "Recovery attempt " << nb_attempts << " after: " << e.getErrMsg();
+			_recover(nb_frames - nb_done);
+		}
+	}
+}
+
+//-----------------------------------------------------
+//		Recovery state machine: bring the detector back to the state of the
+//		interrupted acquisition so that it can be resumed from the last published image
+//-----------------------------------------------------
+void Camera::_recover(int nb_remaining_frames)
+{
+	DEB_MEMBER_FUNCT();
+
+	Timestamp t0 = Timestamp::now();
+	try
+	{
+		//- 1. re-query the modules readiness
+		m_recovery_step = Camera::RECOVERY_ASK_READY;
+		unsigned int modules_mask = 0x00;
+		if (xpci_modAskReady(&modules_mask) != 0 || (modules_mask & m_modules_mask) != m_modules_mask)
+			throw LIMA_HW_EXC(Error, "Recovery: modules are not ready");
+		DEB_TRACE() << "Recovery: modules ready (modules mask = " << std::hex << modules_mask << ")";
+
+		//- 2. reprogram the config G and the DACL mirrored in the state, then the exposure parameters
+		m_recovery_step = Camera::RECOVERY_RELOAD;
+		{
+			AutoMutex aLock(m_state_lock);
+			DetectorState programmed = m_state;
+			_programState(programmed);
+		}
+		_setExposureParameters(nb_remaining_frames);
+
+		//- 3. the acquisition is resumed by the caller from the last published image
+		m_recovery_step = Camera::RECOVERY_RESUME;
+	}
+	catch (...)
+	{
+		m_recovery_step = Camera::RECOVERY_FAILED;
+		throw;
+	}
+
+	//- 4. time to recovery
+	m_last_recovery_time = Timestamp::now() - t0;
+	m_nb_recoveries++;
+	DEB_TRACE() << "Recovery done in " << m_last_recovery_time << " s, resuming " << nb_remaining_frames << " images";
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setMaxRecoveryAttempts(int nb_attempts)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR1(nb_attempts);
+	m_max_recovery_attempts = nb_attempts;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getMaxRecoveryAttempts(int& nb_attempts)
+{
+	DEB_MEMBER_FUNCT();
+	nb_attempts = m_max_recovery_attempts;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getRecoveryStatus(Camera::RecoveryStep& step, int& nb_recoveries, double& last_recovery_time)
+{
+	DEB_MEMBER_FUNCT();
+	step = m_recovery_step;
+	nb_recoveries = m_nb_recoveries;
+	last_recovery_time = m_last_recovery_time;
+	DEB_RETURN() << DEB_VAR3(step, nb_recoveries, last_recovery_time);
+}
+
+//-----------------------------------------------------
+//		Acquire nb_frames images and publish them from first_frame_nb
+//-----------------------------------------------------
+void Camera::_acquireImages(int nb_frames, int first_frame_nb)
+{
+	DEB_MEMBER_FUNCT();
+
+	//- Raw mode: the driver writes straight in the lima buffers when they hold the whole sequence
+	int nb_buffers, nb_concat_frames;
+	m_buffer_cb_mgr.getNbBuffers(nb_buffers);
+	m_buffer_cb_mgr.getNbConcatFrames(nb_concat_frames);
+	bool in_place = m_raw_mode && nb_frames <= nb_buffers * nb_concat_frames;
+
+	//- Declare local temporary image buffer
+	DEB_TRACE() <<"Allocating images array (" << nb_frames << " images of " << m_full_image_size_in_bytes << " bytes)";
+	vector<void*> image_array(nb_frames);
+	for (int i = 0; i < nb_frames; i++)
+	{
+		if (in_place)
+		{
+			int buffer_nb, concat_frame_nb;
+			m_buffer_cb_mgr.acqFrameNb2BufferNb(first_frame_nb + i, buffer_nb, concat_frame_nb);
+			image_array[i] = m_buffer_cb_mgr.getBufferPtr(buffer_nb, concat_frame_nb);
+		}
+		else
+			image_array[i] = new char[m_full_image_size_in_bytes];
+	}
+
+	m_status = Camera::Exposure;
+
+	//- Start the img sequence
+	DEB_TRACE() <<"Start acquiring a sequence of images";
+
+	int ret = xpci_getImgSeq(	m_pixel_depth, 
+		                    	m_modules_mask,
+		                    	m_chip_number,
+                   				nb_frames,
+                   				&image_array[0],
+                   				// next are ignored in V2:
+                   				XPIX_V1_COMPATIBILITY,
+		                    	XPIX_V1_COMPATIBILITY,
+		                    	XPIX_V1_COMPATIBILITY,
+		                    	XPIX_V1_COMPATIBILITY);
+
+	//- On abort, the images completed by the driver before the stop are still published
+	int nb_acquired = nb_frames;
+	if (m_stop_asked)
+	{
+		nb_acquired = min(max(xpci_getGotImages(), 0), nb_frames);
+		DEB_TRACE() << "Acquisition aborted after " << nb_acquired << " images";
+	}
+	else if (ret == -1)
+	{
+		DEB_ERROR() << "Error: xpci_getImgSeq as returned an error..." ;
+
+		//- images completed before the error are published: a recovery resumes after them
+		nb_acquired = min(max(xpci_getGotImages(), 0), nb_frames);
+		for (int i = 0; i < nb_acquired; i++)
+			_publishFrame(first_frame_nb + i, image_array[i]);
+
+		DEB_TRACE() << "Freeing the images array";
+		_releaseHostFrames();
+		for (int i = 0; i < nb_frames && !in_place; i++)
+			delete[] (char*)image_array[i];
+
+		m_status = Camera::Fault;
+		throw LIMA_HW_EXC(Error, "xpci_getImgSeq as returned an error ! ");
+	}
+
+	m_status = Camera::Readout;
+
+	DEB_TRACE() 	<< "\n#######################"
+					<< "\nall images are acquired"
+					<< "\n#######################" ;
+
+	//- Publish each image and call new frame ready for each frame
+	DEB_TRACE() <<"Publish each acquired image through newFrameReady()";
+	for (int i = 0; i < nb_acquired; i++)
+		_publishFrame(first_frame_nb + i, image_array[i]);
+
+	//- release the staging memory right now, not at the next acquisition
+	DEB_TRACE() <<"Freeing the images array";
+	_releaseHostFrames();
+	for (int i = 0; i < nb_frames && !in_place; i++)
+		delete[] (char*)image_array[i];
+}
+
+//-----------------------------------------------------
+//		Publication thread main loop: the queued frames in order, dropped after a stop
+//-----------------------------------------------------
+void Camera::PublishThread::threadFunction()
+{
+	DEB_MEMBER_FUNCT();
+
+	AutoMutex aLock(m_cam.m_publish_cond.mutex());
+	while (true)
+	{
+		while (!m_cam.m_publish_quit && m_cam.m_host_frames_done == m_cam.m_host_frames_queued)
+			m_cam.m_publish_cond.wait();
+		if (m_cam.m_host_frames_done == m_cam.m_host_frames_queued)
+			break;
+
+		Camera::HostFrame& frame = m_cam.m_host_frames[m_cam.m_host_frames_done % m_cam.m_host_frames.size()];
+		aLock.unlock();
+
+		if (!m_cam.m_stop_asked)
+		{
+			try
+			{
+				m_cam._processHostFrame(frame);
+			}
+			catch (Exception& e)
+			{
+				DEB_ERROR() << "Host stages of frame " << frame.frame_nb << " failed: " << e.getErrMsg();
+				aLock.lock();
+				m_cam.m_host_frames_failed = true;
+				aLock.unlock();
+			}
+		}
+
+		aLock.lock();
+		m_cam.m_host_frames_done++;
+		m_cam.m_publish_cond.broadcast();
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool Camera::_hostStagesEnabled() const
+{
+	return m_sparse_output || m_integration || m_compression || m_frame_ring || m_frame_streamer;
+}
+
+//-----------------------------------------------------
+//		The host stages read the lima buffer unless it holds corrected counts or floats,
+//		the driver image then
+//-----------------------------------------------------
+bool Camera::_hostStagesReadLimaBuffer() const
+{
+	return !(m_dead_time_correction || m_float_output);
+}
+
+//-----------------------------------------------------
+//		Wait for a free slot in the queue: as it holds at most one lima ring, the lima
+//		buffer of the next frame is then no longer read by the host stages
+//-----------------------------------------------------
+void Camera::_waitHostFrameSlot()
+{
+	AutoMutex aLock(m_publish_cond.mutex());
+	while (m_host_frames_queued - m_host_frames_done >= m_host_frames.size())
+		m_publish_cond.wait();
+}
+
+//-----------------------------------------------------
+//		Queue the image (not a copy) for the publication thread, call _waitHostFrameSlot before
+//-----------------------------------------------------
+void Camera::_queueHostFrame(int frame_nb, const void* image, double timestamp)
+{
+	AutoMutex aLock(m_publish_cond.mutex());
+	Camera::HostFrame& frame = m_host_frames[m_host_frames_queued % m_host_frames.size()];
+	frame.frame_nb	= frame_nb;
+	frame.timestamp	= timestamp;
+	frame.image		= image;
+	m_host_frames_queued++;
+	m_publish_cond.broadcast();
+}
+
+//-----------------------------------------------------
+//		Called before the driver images are freed or reused: wait for the host stages
+//		that read them (nothing to wait for when they read the lima buffers)
+//-----------------------------------------------------
+void Camera::_releaseHostFrames()
+{
+	if (m_raw_mode || !_hostStagesEnabled() || _hostStagesReadLimaBuffer())
+		return;
+
+	AutoMutex aLock(m_publish_cond.mutex());
+	while (m_host_frames_done != m_host_frames_queued)
+		m_publish_cond.wait();
+}
+
+//-----------------------------------------------------
+//		Wait for the publication thread to process (or drop) the queued frames,
+//		false if a host stage failed since the previous call
+//-----------------------------------------------------
+bool Camera::_waitHostFrames()
+{
+	AutoMutex aLock(m_publish_cond.mutex());
+	while (m_host_frames_done != m_host_frames_queued)
+		m_publish_cond.wait();
+	bool failed = m_host_frames_failed;
+	m_host_frames_failed = false;
+	return !failed;
+}
+
+//-----------------------------------------------------
+//		Host stages of a frame, called by the publication thread
+//-----------------------------------------------------
+void Camera::_processHostFrame(Camera::HostFrame& frame)
+{
+	DEB_MEMBER_FUNCT();
+
+	int frame_nb = frame.frame_nb;
+	double timestamp = frame.timestamp;
+	void* image = const_cast<void*>(frame.image);
+
+	//- (pixel index, count) pairs of the low flux frames
+	bool sparse = m_sparse_output && m_sparse_encoder.encode(image);
+	if (sparse && m_sparse_frame_listener)
+		m_sparse_frame_listener->sparseFrameReady(*this, frame_nb, m_sparse_encoder);
+
+	//- 1-D profile, used (and copied for the streaming) under the lock of getLastProfile
+	if (m_integration)
+	{
+		AutoMutex aLock(m_integration_lock);
+		m_integrator.integrate(image, m_full_image_size_in_bytes == 4 * m_image_size.getWidth() * m_image_size.getHeight());
+		if (m_profile_listener)
+			m_profile_listener->profileReady(*this, frame_nb, m_integrator);
+		if (m_frame_streamer)
+			m_host_profile.assign(m_integrator.getProfile(), m_integrator.getProfile() + m_integrator.getNbBins());
+	}
+
+	//- chunks of the HDF5 bitshuffle/LZ4 filter, streamed instead of the dense image
+	if (m_compression)
+	{
+		m_frame_compressor.compress(image);
+		if (m_compressed_frame_listener)
+			m_compressed_frame_listener->compressedFrameReady(*this, frame_nb, m_frame_compressor);
+	}
+
+	//- mirror and stream for the external online-analysis processes
+	if (m_frame_ring || m_frame_streamer)
+	{
+		if (m_frame_ring)
+			m_frame_ring->write(frame_nb, timestamp, image);
+		if (m_frame_streamer)
+		{
+			int width = m_image_size.getWidth(), height = m_image_size.getHeight();
+			if (!m_integration || !m_integration_stream_profile_only)
+			{
+				if (sparse)
+					m_frame_streamer->sendSparseFrame(frame_nb, timestamp, m_sparse_encoder.getIndices(),
+													  m_sparse_encoder.getCounts(), m_sparse_encoder.getNbHits(),
+													  width, height);
+				else if (m_compression)
+					_streamCompressedFrame(frame_nb, timestamp);
+				else
+					m_frame_streamer->sendFrame(frame_nb, timestamp, image, width, height,
+												m_full_image_size_in_bytes / (width * height));
+			}
+			if (m_integration)
+				m_frame_streamer->sendProfile(frame_nb, timestamp, &m_host_profile[0], m_host_profile.size());
+		}
+	}
+}
+
+//-----------------------------------------------------
+//		The chunks (one per module) of the frame just compressed
+//-----------------------------------------------------
+void Camera::_streamCompressedFrame(int frame_nb, double timestamp)
+{
+	const char* chunks[FrameStreamer::MAX_CHUNKS];
+	int chunk_sizes[FrameStreamer::MAX_CHUNKS];
+	for (int chunk = 0; chunk < m_module_number; chunk++)
+		chunks[chunk] = m_frame_compressor.getChunk(chunk, chunk_sizes[chunk]);
+
+	int width = m_image_size.getWidth(), height = m_image_size.getHeight();
+	m_frame_streamer->sendCompressedFrame(frame_nb, timestamp, chunks, chunk_sizes, m_module_number,
+										  width, height, m_full_image_size_in_bytes / (width * height));
+}
+
+//-----------------------------------------------------
+//		Copy an image in the lima buffer and publish it, capture_time: time (s since the Epoch)
+//		the image was read out, 0 -> now (lima then timestamps it when published)
+//-----------------------------------------------------
+void Camera::_publishFrame(int frame_nb, void* image, double capture_time)
+{
+	DEB_MEMBER_FUNCT();
+
+	StdBufferCbMgr& buffer_mgr = m_buffer_cb_mgr;
+	int buffer_nb, concat_frame_nb;
+	HwFrameInfoType frame_info;
+	frame_info.acq_frame_nb = frame_nb;
+	if (capture_time > 0.)
+	{
+		Timestamp start;
+		buffer_mgr.getStartTimestamp(start);
+		frame_info.frame_timestamp = Timestamp(capture_time - start);
+	}
+
+	//- raw mode: the driver buffer as is, without any host stage (no copy when acquired in place)
+	if (m_raw_mode)
+	{
+		buffer_mgr.acqFrameNb2BufferNb(frame_nb, buffer_nb, concat_frame_nb);
+		void* lima_img_ptr = buffer_mgr.getBufferPtr(buffer_nb, concat_frame_nb);
+		if (lima_img_ptr != image)
+			memcpy(lima_img_ptr, image, m_full_image_size_in_bytes);
+
+		m_current_nb_frames = frame_nb;
+		buffer_mgr.newFrameReady(frame_info);
+		return;
+	}
+
+	//- the host stages may still read the lima buffer of the frame a ring before
+	bool host_stages = _hostStagesEnabled();
+	if (host_stages)
+		_waitHostFrameSlot();
+
+	buffer_mgr.acqFrameNb2BufferNb(frame_nb, buffer_nb, concat_frame_nb);
+	void* lima_img_ptr = buffer_mgr.getBufferPtr(buffer_nb, concat_frame_nb);
+
+	//- copy image in the lima buffer (dead-time corrected or converted to floats on the way)
+	if (m_dead_time_correction || m_float_output)
+		m_dead_time_corrector.correct(image, lima_img_ptr, 0,
+									  m_image_size.getWidth() * m_image_size.getHeight());
+	else
+		memcpy(lima_img_ptr, image, m_full_image_size_in_bytes);
+
+	//- host stages off the readout path, on the lima buffer or the driver image (no copy);
+	//- the publication thread drops the frames after a stop anyway
+	if (host_stages && !m_stop_asked)
+		_queueHostFrame(frame_nb, _hostStagesReadLimaBuffer() ? lima_img_ptr : image,
+						(capture_time > 0.) ? capture_time : double(Timestamp::now()));
+
+	m_current_nb_frames = frame_nb;
+	//- raise the image to Lima
+	buffer_mgr.newFrameReady(frame_info);
+	DEB_TRACE() << "image " << frame_nb <<" published with newFrameReady()" ;
+}
+
+//-----------------------------------------------------
+//		Program the exposure parameters of the current acquisition for nb_images
+//-----------------------------------------------------
+void Camera::_setExposureParameters(unsigned nb_images)
+{
+	DEB_MEMBER_FUNCT();
+
+    //m_xpad_model parameter must be 1 (in our detector type IMXPAD_S140) or XPIX_NOT_USED_YET
+    //maybe library must manage this, we can provide IMXPAD_Sxx to this function if necessary
+	setExposureParameters(	m_exp_time_usec,
+							m_time_between_images_usec,
+							m_time_before_start_usec,
+							m_shutter_time_usec,
+							m_ovf_refresh_time_usec,
+							m_imxpad_trigger_mode,
+							XPIX_NOT_USED_YET,
+							XPIX_NOT_USED_YET,
+							nb_images,
+							XPIX_NOT_USED_YET,
+							m_imxpad_format,
+							(m_xpad_model == IMXPAD_S140)?1:XPIX_NOT_USED_YET,/**/
+							XPIX_NOT_USED_YET,
+							XPIX_NOT_USED_YET,
+							XPIX_NOT_USED_YET,
+							XPIX_NOT_USED_YET);
+}
+
+//-----------------------------------------------------
+//      setExposureParam
+//-----------------------------------------------------
+void Camera::setExposureParameters(  unsigned Texp,unsigned Twait,unsigned Tinit,
+			                         unsigned Tshutter,unsigned Tovf,unsigned trigger_mode, unsigned n,unsigned p,
+			                         unsigned nbImages,unsigned BusyOutSel,unsigned formatIMG,unsigned postProc,
+			                         unsigned GP1,unsigned GP2,unsigned GP3,unsigned GP4)
+{
+
+	DEB_MEMBER_FUNCT();
+
+	unsigned int args[16] = {Texp, Twait, Tinit, Tshutter, Tovf, trigger_mode, n, p,
+							 nbImages, BusyOutSel, formatIMG, postProc, GP1, GP2, GP3, GP4};
+	memcpy(m_programmed_exposure, args, sizeof(args));
+	m_exposure_programmed = true;
+
+    if (xpci_modExposureParam(m_modules_mask, Texp, Twait, Tinit,
+	                          Tshutter, Tovf, trigger_mode,  n, p,
+	                          nbImages, BusyOutSel, formatIMG, postProc,
+	                          GP1, GP2, GP3, GP4) == 0)
+	{
+		DEB_TRACE() << "setExposureParameters (xpci_modExposureParam) -> OK" ;
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in setExposureParameters! (xpci_modExposureParam)");
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setAcquisitionType(short acq_type)
+{
+	DEB_MEMBER_FUNCT();
+    m_acquisition_type = (Camera::XpadAcqType)acq_type;
+
+	DEB_TRACE() << "m_acquisition_type = " << m_acquisition_type  ;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::loadFlatConfig(unsigned flat_value)
+{
+	DEB_MEMBER_FUNCT();
+
+	_loadFlatConfig(flat_value);
+	_saveSnapshot();
+}
+
+//-----------------------------------------------------
+//		Load a flat DACL on all the pixels without saving the snapshot
+//-----------------------------------------------------
+void Camera::_loadFlatConfig(unsigned flat_value)
+{
+	DEB_MEMBER_FUNCT();
+
+	if (xpci_modLoadFlatConfig(m_modules_mask, _getAllChipsMask(), flat_value) == 0)
+	{
+		DEB_TRACE() << "loadFlatConfig, with value: " <<  flat_value << " -> OK" ;
+
+		AutoMutex aLock(m_state_lock);
+		m_dacl_cached = false;
+		fill(m_state.getDacl(), m_state.getDacl() + m_state.getDaclSize(), flat_value);
+		m_state.setDaclValid(true);
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in loadFlatConfig!");
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::loadAllConfigG(unsigned long modNum, unsigned long chipId , unsigned long* config_values)
+{
+	DEB_MEMBER_FUNCT();
+
+	_loadAllConfigG(modNum, chipId, config_values);
+	_saveSnapshot();
+}
+
+//-----------------------------------------------------
+//		Load the 11 config G of a chip without saving the snapshot
+//-----------------------------------------------------
+void Camera::_loadAllConfigG(unsigned long modNum, unsigned long chipId , unsigned long* config_values)
+{
+	DEB_MEMBER_FUNCT();
+
+    //- Transform the module number into a module mask on 8 bits
+    //- eg: if modNum = 4, mask_local = 8
+    unsigned long mask_local_module = 0x00;
+    SET(mask_local_module,(modNum-1));// minus 1 because modNum start at 1
+    unsigned long mask_local_chip = 0x00;
+    SET(mask_local_chip,(chipId-1));// minus 1 because chipId start at 1
+
+	if(xpci_modLoadAllConfigG(mask_local_module,mask_local_chip, 
+			                                    config_values[0],//- CMOS_TP
+			                                    config_values[1],//- AMP_TP, 
+			                                    config_values[2],//- ITHH, 
+			                                    config_values[3],//- VADJ, 
+			                                    config_values[4],//- VREF, 
+			                                    config_values[5],//- IMFP, 
+			                                    config_values[6],//- IOTA, 
+			                                    config_values[7],//- IPRE, 
+			                                    config_values[8],//- ITHL, 
+			                                    config_values[9],//- ITUNE, 
+			                                    config_values[10]//- IBUFFER
+		                        ) == 0)
+	{
+		DEB_TRACE() << "loadAllConfigG for module " << modNum  << ", and chip " << chipId << " -> OK" ;
+		DEB_TRACE() << "(loadAllConfigG for mask_local_module " << mask_local_module  << ", and mask_local_chip " << mask_local_chip << " )" ;
+
+		AutoMutex aLock(m_state_lock);
+		int mod_idx = m_state.getModuleIndex(modNum - 1);
+		if (mod_idx >= 0 && chipId >= 1 && chipId <= m_chip_number)
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+				m_state.setConfigG(mod_idx, chipId - 1, index, config_values[index]);
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in loadAllConfigG!");
+	}
+}
+
+//-----------------------------------------------------
+//		Set all the config G: allConfigG holds the 11 values (order of loadAllConfigG)
+//		of each chip of each module ([module][chip][register], modules in image
+//		order), or 11 values for all the chips. What the chips already hold is
+//		skipped, the rest is programmed with as few masked calls as possible:
+//		one loadAllConfigG per set of identical chips, or one loadConfigG per
+//		register value if fewer registers differ.
+//-----------------------------------------------------
+void Camera::setAllConfigG(const vector<long>& allConfigG)
+{
+	DEB_MEMBER_FUNCT();
+
+	int nb_pairs = m_module_number * m_chip_number;
+	bool broadcast = (allConfigG.size() == (size_t)DetectorState::NB_CONFIG_G);
+	if (!broadcast && allConfigG.size() != size_t(nb_pairs) * DetectorState::NB_CONFIG_G)
+		throw LIMA_HW_EXC(InvalidValue, "setAllConfigG: 11 values per chip of each module (or 11 values) expected");
+
+	Timestamp t0 = Timestamp::now();
+	UploadStats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	AutoMutex aLock(m_state_lock);
+
+	//- plan 1: whole config G of the chips that differ
+	vector< vector<uint32_t> > chip_values(nb_pairs, vector<uint32_t>(DetectorState::NB_CONFIG_G));
+	vector<bool> chip_pending(nb_pairs, false);
+	int nb_pending = 0;
+	for (int pos = 0; pos < nb_pairs; pos++)
+	{
+		int mod_idx = pos / m_chip_number, chip = pos % m_chip_number;
+		for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+		{
+			uint32_t value = allConfigG[(broadcast ? 0 : pos * DetectorState::NB_CONFIG_G) + index];
+			chip_values[pos][index] = value;
+			if (!m_state.isConfigGValid(mod_idx, chip, index) || m_state.getConfigG(mod_idx, chip, index) != value)
+				chip_pending[pos] = true;
+		}
+		if (chip_pending[pos])
+			nb_pending++;
+	}
+	map<vector<uint32_t>, map<unsigned int, unsigned int> > chip_groups;
+	int nb_chip_calls = groupConfigG(chip_values, chip_pending, m_state, chip_groups);
+
+	//- plan 2: register values that differ
+	vector< map<uint32_t, map<unsigned int, unsigned int> > > reg_groups(DetectorState::NB_CONFIG_G);
+	int nb_reg_calls = 0;
+	for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+	{
+		vector<uint32_t> reg_values(nb_pairs);
+		vector<bool> reg_pending(nb_pairs, false);
+		for (int pos = 0; pos < nb_pairs; pos++)
+		{
+			int mod_idx = pos / m_chip_number, chip = pos % m_chip_number;
+			reg_values[pos] = chip_values[pos][index];
+			reg_pending[pos] = !m_state.isConfigGValid(mod_idx, chip, index) ||
+							   m_state.getConfigG(mod_idx, chip, index) != reg_values[pos];
+		}
+		nb_reg_calls += groupConfigG(reg_values, reg_pending, m_state, reg_groups[index]);
+	}
+
+	if (nb_chip_calls <= nb_reg_calls)
+	{
+		map<vector<uint32_t>, map<unsigned int, unsigned int> >::const_iterator it;
+		map<unsigned int, unsigned int>::const_iterator git;
+		for (it = chip_groups.begin(); it != chip_groups.end(); ++it)
+		{
+			const vector<uint32_t>& v = it->first;
+			for (git = it->second.begin(); git != it->second.end(); ++git)
+			{
+				if (xpci_modLoadAllConfigG(git->second, git->first, v[0], v[1], v[2], v[3], v[4], v[5],
+										   v[6], v[7], v[8], v[9], v[10]) != 0)
+					throw LIMA_HW_EXC(Error, "Error in xpci_modLoadAllConfigG!");
+				stats.nb_driver_calls++;
+				stats.nb_bytes += DetectorState::NB_CONFIG_G * sizeof(uint32_t);
+			}
+		}
+	}
+	else
+	{
+		for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+		{
+			map<uint32_t, map<unsigned int, unsigned int> >::const_iterator it;
+			map<unsigned int, unsigned int>::const_iterator git;
+			for (it = reg_groups[index].begin(); it != reg_groups[index].end(); ++it)
+			{
+				for (git = it->second.begin(); git != it->second.end(); ++git)
+				{
+					if (xpci_modLoadConfigG(git->second, git->first, DetectorState::getConfigGReg(index), it->first) != 0)
+						throw LIMA_HW_EXC(Error, "Error in xpci_modLoadConfigG!");
+					stats.nb_driver_calls++;
+					stats.nb_bytes += sizeof(uint32_t);
+				}
+			}
+		}
+	}
+
+	for (int pos = 0; pos < nb_pairs; pos++)
+		for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+			m_state.setConfigG(pos / m_chip_number, pos % m_chip_number, index, chip_values[pos][index]);
+
+	//- skipped calls: compared to one loadAllConfigG per chip
+	stats.nb_skipped_calls = nb_pairs - stats.nb_driver_calls;
+	stats.nb_skipped_bytes = long(nb_pairs - nb_pending) * DetectorState::NB_CONFIG_G * sizeof(uint32_t);
+	stats.duration = Timestamp::now() - t0;
+	m_upload_stats = stats;
+	aLock.unlock();
+	_saveSnapshot();
+
+	DEB_TRACE() << "setAllConfigG: " << nb_pending << " chips out of " << nb_pairs << " changed, "
+				<< stats.nb_driver_calls << " driver calls instead of " << nb_pairs
+				<< " (" << ((nb_chip_calls <= nb_reg_calls) ? "loadAllConfigG" : "loadConfigG") << ")";
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::loadConfigG(const vector<unsigned long>& reg_and_value)
+{
+	DEB_MEMBER_FUNCT();
+
+	//- live acquisition: applied at the next frame boundary
+	if (_queueLiveCommand(Camera::LIVE_LOAD_CONFIG_G, reg_and_value[0], reg_and_value[1]))
+		return;
+
+	_loadConfigG(reg_and_value[0], reg_and_value[1]);
+	_saveSnapshot();
+}
+
+//-----------------------------------------------------
+//		Load a config G register on all the chips without saving the snapshot
+//-----------------------------------------------------
+void Camera::_loadConfigG(unsigned long reg, unsigned long value)
+{
+	DEB_MEMBER_FUNCT();
+
+	if(xpci_modLoadConfigG(m_modules_mask, _getAllChipsMask(), reg, value)==0)
+	{
+		DEB_TRACE() << "loadConfigG: " << reg << ", with value: " << value << " -> OK" ;
+
+		int index = DetectorState::getConfigGIndex(reg);
+		if (index >= 0)
+		{
+			AutoMutex aLock(m_state_lock);
+			for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+				for (unsigned int chip = 0; chip < m_chip_number; chip++)
+					m_state.setConfigG(mod_idx, chip, index, value);
+		}
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in loadConfigG!");
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::loadAutoTest(unsigned known_value)
+{
+	DEB_MEMBER_FUNCT();
+
+    unsigned int mode = 0; //- 0 -> flat
+	if(xpci_modLoadAutoTest(m_modules_mask, known_value, mode)==0)
+	{
+        DEB_TRACE() << "loadAutoTest with value: " << known_value << " ; in mode: " << mode << " -> OK" ;
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in loadAutoTest!");
+	}
+}
+
+//-----------------------------------------------------
+//		Save the config L (DACL) to XPAD RAM
+//-----------------------------------------------------
+void Camera::saveConfigL(unsigned long modNum, unsigned long calibId, unsigned long chipId, unsigned long curRow, unsigned long* values)
+{
+    DEB_MEMBER_FUNCT();
+
+    //- Transform the module number into a module mask on 8 bits
+    //- eg: if modNum = 4, mask_local = 8
+    unsigned long mask_local = 0x00;
+    SET(mask_local,(modNum-1));// -1 because modNum start at 1
+    //- because start at 1 at high level and 0 at low level
+    chipId = chipId - 1;
+
+    //- Call the xpix fonction
+    if(xpci_modSaveConfigL(mask_local,calibId,chipId,curRow,(unsigned int*) values) == 0)
+	{
+        DEB_TRACE() << "saveConfigL for module: " << modNum << " | chip: " << chipId << " | row: " << curRow << " -> OK" ;
+
+        //- the row is in the RAM of the module, it is programmed by loadConfig
+        AutoMutex aLock(m_state_lock);
+        m_dacl_cached = false;
+        DetectorState& slot = _getConfigSlot(calibId);
+        int mod_idx = slot.getModuleIndex(modNum - 1);
+        if (mod_idx >= 0 && chipId < m_chip_number && curRow < (unsigned long)XPAD_NB_ROWS)
+        {
+            copy(values, values + XPAD_NB_COLUMNS, slot.getDaclRow(mod_idx, chipId, curRow));
+            slot.setDaclRowValid(mod_idx, chipId, curRow, true);
+        }
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigL!");
+	}
+}
+
+//-----------------------------------------------------
+//		Save the DACL of whole modules to XPAD RAM and load it
+//		dacl: 120 rows * (80 * nb chips) values of each module of modMask, in image order
+//-----------------------------------------------------
+void Camera::saveAndLoadConfigL(unsigned long modMask, unsigned long calibId, const unsigned short* dacl, int nb_values)
+{
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR3(DEB_HEX(modMask), calibId, nb_values);
+
+    if (modMask == 0 || (modMask & ~(unsigned long)m_modules_mask) != 0)
+        throw LIMA_HW_EXC(InvalidValue, "saveAndLoadConfigL: modules mask does not match the ready modules");
+
+    vector<int> mod_bits;
+    for (int bit = 0; bit < 32; bit++)
+        if (modMask & (1UL << bit))
+            mod_bits.push_back(bit);
+    int nb_mods = mod_bits.size();
+    int width = XPAD_NB_COLUMNS * m_chip_number;
+    int module_size = XPAD_NB_ROWS * width;
+    if (nb_values != nb_mods * module_size)
+        throw LIMA_HW_EXC(InvalidValue, "saveAndLoadConfigL: the DACL size does not match the modules mask");
+
+    Timestamp t0 = Timestamp::now();
+    UploadStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    AutoMutex aLock(m_state_lock);
+    m_dacl_cached = false;
+    DetectorState& slot = _getConfigSlot(calibId);
+
+    //- Rows are written back to back (no round trip per row); the modules having the
+    //- same row are written with a single call on their common mask
+    unsigned int values[XPAD_NB_COLUMNS];
+    vector<bool> done(nb_mods);
+    for (unsigned int chip = 0; chip < m_chip_number; chip++)
+    {
+        for (int row = 0; row < XPAD_NB_ROWS; row++)
+        {
+            fill(done.begin(), done.end(), false);
+            for (int m = 0; m < nb_mods; m++)
+            {
+                if (done[m])
+                    continue;
+                const unsigned short* dacl_row = dacl + m * module_size + row * width + chip * XPAD_NB_COLUMNS;
+                unsigned int mask_local = 1U << mod_bits[m];
+                for (int n = m + 1; n < nb_mods; n++)
+                {
+                    const unsigned short* other_row = dacl + n * module_size + row * width + chip * XPAD_NB_COLUMNS;
+                    if (!done[n] && memcmp(dacl_row, other_row, XPAD_NB_COLUMNS * sizeof(unsigned short)) == 0)
+                    {
+                        mask_local |= 1U << mod_bits[n];
+                        done[n] = true;
+                        stats.nb_skipped_calls++;
+                    }
+                }
+
+                copy(dacl_row, dacl_row + XPAD_NB_COLUMNS, values);
+                if (xpci_modSaveConfigL(mask_local, calibId, chip, row, values) != 0)
+                    throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigL!");
+                stats.nb_driver_calls++;
+                stats.nb_bytes += sizeof(values);
+            }
+        }
+    }
+
+    //- one load for all the modules
+    if (xpci_modDetLoadConfig(modMask, calibId) != 0)
+        throw LIMA_HW_EXC(Error, "Error in xpci_modDetLoadConfig!");
+    stats.nb_driver_calls++;
+
+    for (int m = 0; m < nb_mods; m++)
+    {
+        int mod_idx = slot.getModuleIndex(mod_bits[m]);
+        for (unsigned int chip = 0; chip < m_chip_number; chip++)
+        {
+            for (int row = 0; row < XPAD_NB_ROWS; row++)
+            {
+                const unsigned short* dacl_row = dacl + m * module_size + row * width + chip * XPAD_NB_COLUMNS;
+                copy(dacl_row, dacl_row + XPAD_NB_COLUMNS, slot.getDaclRow(mod_idx, chip, row));
+                slot.setDaclRowValid(mod_idx, chip, row, true);
+            }
+        }
+        m_state.copyModule(slot, mod_idx);
+    }
+
+    stats.duration = Timestamp::now() - t0;
+    m_upload_stats = stats;
+    aLock.unlock();
+    _saveSnapshot();
+
+    DEB_TRACE() << "saveAndLoadConfigL: " << nb_mods << " modules in " << stats.duration << " s ("
+                << stats.nb_driver_calls << " driver calls, " << stats.nb_skipped_calls << " rows broadcast)";
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::saveAndLoadConfigL(unsigned long modMask, unsigned long calibId, const vector<unsigned short>& dacl)
+{
+    saveAndLoadConfigL(modMask, calibId, dacl.empty() ? NULL : &dacl[0], dacl.size());
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getLastUploadStats(Camera::UploadStats& stats)
+{
+    DEB_MEMBER_FUNCT();
+    AutoMutex aLock(m_state_lock);
+    stats = m_upload_stats;
+}
+
+//-----------------------------------------------------
+//		Save the config G to XPAD RAM
+//-----------------------------------------------------
+void Camera::saveConfigG(unsigned long modNum, unsigned long calibId, unsigned long reg,unsigned long* values)
+{
+    DEB_MEMBER_FUNCT();
+
+    //- Transform the module number into a module mask on 8 bits
+    //- eg: if modNum = 4, mask_local = 8
+    unsigned long mask_local = 0x00;
+    SET(mask_local,(modNum-1)); // -1 because modNum start at 1
+
+    //- Call the xpix fonction
+    if(xpci_modSaveConfigG(mask_local,calibId,reg,(unsigned int*) values) == 0)
+	{
+        DEB_TRACE() << "saveConfigG for module: " << modNum << " | reg: " << reg << " -> OK" ;
+
+        //- one value per chip, in the RAM of the module: programmed by loadConfig
+        AutoMutex aLock(m_state_lock);
+        DetectorState& slot = _getConfigSlot(calibId);
+        int mod_idx = slot.getModuleIndex(modNum - 1);
+        int index = DetectorState::getConfigGIndex(reg);
+        if (mod_idx >= 0 && index >= 0)
+            for (unsigned int chip = 0; chip < m_chip_number; chip++)
+                slot.setConfigG(mod_idx, chip, index, values[chip]);
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigG!");
+	}
+}
+
+//-----------------------------------------------------
+//		Load the config to detector chips
+//-----------------------------------------------------
+void Camera::loadConfig(unsigned long modNum, unsigned long calibId)
+{
+    DEB_MEMBER_FUNCT();
+
+    //- Transform the module number into a module mask on 8 bits
+    //- eg: if modNum = 4, mask_local = 8
+    unsigned long mask_local = 0x00;
+    SET(mask_local,(modNum-1));// -1 because modNum start at 1
+
+    //- Call the xpix fonction
+    if(xpci_modDetLoadConfig(mask_local,calibId) == 0)
+	{
+        DEB_TRACE() << "loadConfig for module: " << modNum << " | calibID: " << calibId << " -> OK" ;
+
+        AutoMutex aLock(m_state_lock);
+        m_dacl_cached = false;
+        DetectorState& slot = _getConfigSlot(calibId);
+        int mod_idx = m_state.getModuleIndex(modNum - 1);
+        if (mod_idx >= 0)
+            m_state.copyModule(slot, mod_idx);
+        aLock.unlock();
+        _saveSnapshot();
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in xpci_modDetLoadConfig!");
+	}
+}
+
+//-----------------------------------------------------
+//		Get the modules config (Local aka DACL)
+//-----------------------------------------------------
+unsigned short*& Camera::getModConfig()
+{
+    DEB_MEMBER_FUNCT();
+
+    //- the modules are not read back while a job drives them: only the cached DACL then
+    bool busy;
+    {
+        AutoMutex aLock(m_cond.mutex());
+        busy = !m_wait_flag;
+    }
+
+    //- read back only if the DACL was written since the last read
+    AutoMutex aLock(m_state_lock);
+    if (!m_dacl_cached)
+    {
+        if (busy)
+            throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running, no DACL cached");
+
+        if(xpci_getModConfig(m_modules_mask,m_chip_number,m_dacl) == 0)
+        {
+            DEB_TRACE() << "getModConfig -> xpci_getModConfig -> OK" ;
+            m_dacl_cached = true;
+        }
+        else
+        {
+            throw LIMA_HW_EXC(Error, "Error in xpci_getModConfig!");
+        }
+    }
+    return m_dacl;
+}
+
+//-----------------------------------------------------
+//		Reset the detector
+//-----------------------------------------------------
+void Camera::reset()
+{
+    DEB_MEMBER_FUNCT();
+	unsigned int ALL_MODULES = 0xFF;
+    if(xpci_modRebootNIOS(ALL_MODULES) == 0)
+	{
+        DEB_TRACE() << "reset -> xpci_modRebootNIOS -> OK" ;
+
+        //- the modules have lost their configuration
+        AutoMutex aLock(m_state_lock);
+        m_state.invalidateConfigG();
+        m_state.setDaclValid(false);
+        m_dacl_cached = false;
+        m_config_slots.clear();
+        aLock.unlock();
+        _saveSnapshot();
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in xpci_modRebootNIOS!");
+	}
+}
+
+//-----------------------------------------------------
+//		calibrate over the noise Slow
+//-----------------------------------------------------
+void Camera::calibrateOTNSlow ( string path)
+{
+    DEB_MEMBER_FUNCT();
+    _startCalibration(Camera::OTN_SLOW, path);
+}
+
+//-----------------------------------------------------
+//		calibrate over the noise Medium
+//-----------------------------------------------------
+void Camera::calibrateOTNMedium ( string path)
+{
+    DEB_MEMBER_FUNCT();
+    _startCalibration(Camera::OTN_MEDIUM, path);
+}
+
+//-----------------------------------------------------
+//		calibrate over the noise High
+//-----------------------------------------------------
+void Camera::calibrateOTNHigh ( string path)
+{
+    DEB_MEMBER_FUNCT();
+    _startCalibration(Camera::OTN_HIGH, path);
+}
+
+//-----------------------------------------------------
+//		calibrate over the noise with the host S-curve analysis
+//-----------------------------------------------------
+void Camera::calibrateOTNHost ( string path)
+{
+    DEB_MEMBER_FUNCT();
+    _startCalibration(Camera::OTN_HOST, path);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setCalibrationPerModule(bool per_module)
+{
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR1(per_module);
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_wait_flag)
+        throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+    m_calibration_per_module = per_module;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getCalibrationPerModule(bool& per_module)
+{
+    per_module = m_calibration_per_module;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::setHostCalibrationParams(const Camera::HostCalibrationParams& params)
+{
+    DEB_MEMBER_FUNCT();
+
+    if (params.nb_images < 1 || params.ithl_min < 0 || params.ithl_max <= params.ithl_min ||
+        params.dacl_flat < 0 || params.dacl_flat >= DACL_NB_VALUES || params.dacl_margin < 0)
+        throw LIMA_HW_EXC(InvalidValue, "Invalid host calibration parameters");
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_wait_flag)
+        throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+    m_host_calibration_params = params;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getHostCalibrationParams(Camera::HostCalibrationParams& params)
+{
+    params = m_host_calibration_params;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getHostCalibrationStats(Camera::HostCalibrationStats& stats)
+{
+    AutoMutex aLock(m_cond.mutex());
+    stats = m_host_calibration_stats;
+}
+
+//-----------------------------------------------------
+//		upload a calibration
+//-----------------------------------------------------
+void Camera::uploadCalibration(string path)
+{
+    DEB_MEMBER_FUNCT();
+    _startCalibration(Camera::UPLOAD, path);
+}
+
+//-----------------------------------------------------
+//		cancel the running calibration (done between two modules)
+//-----------------------------------------------------
+void Camera::cancelCalibration()
+{
+    DEB_MEMBER_FUNCT();
+
+    AutoMutex aLock(m_cond.mutex());
+    if (m_wait_flag || m_job != Camera::CALIBRATION_JOB)
+        return;
+    m_cancel_asked = true;
+    aLock.unlock();
+
+    //- abort the images of a host calibration step
+    xpci_modAbortExposure();
+
+    //- an OTN calibration of a module can not be aborted: wait for its end, without timeout
+    aLock.lock();
+    while (!m_wait_flag)
+        m_cond.wait();
+    DEB_TRACE() << "Calibration cancelled";
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getCalibrationProgress(Camera::CalibrationProgress& progress)
+{
+    DEB_MEMBER_FUNCT();
+    AutoMutex aLock(m_cond.mutex());
+    progress = m_calibration_progress;
+}
+
+//-----------------------------------------------------
+//		Start a calibration job in the acquisition thread
+//-----------------------------------------------------
+void Camera::_startCalibration(Camera::CalibrationType type, const string& path)
+{
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR2(type, path);
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_wait_flag)
+        throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+
+    m_calibration_type = type;
+    m_calibration_path = path;
+    m_stop_asked = false;
+    m_cancel_asked = false;
+
+    memset(&m_calibration_progress, 0, sizeof(m_calibration_progress));
+    m_calibration_progress.type = type;
+    m_calibration_progress.eta = -1.;
+
+    m_job = Camera::CALIBRATION_JOB;
+    m_status = Camera::Calibrating;
+    m_job_post_ts = Timestamp::now();
+    m_wait_flag = false;
+    m_cond.broadcast();
+}
+
+//-----------------------------------------------------
+//		Calibration job: an OTN calibration is one xpix call for all the modules, or
+//		(opt-in) one call per module to report the progress and to be cancelled between
+//		two modules
+//-----------------------------------------------------
+void Camera::_calibrate()
+{
+    DEB_MEMBER_FUNCT();
+
+    if (m_calibration_type == Camera::UPLOAD)
+    {
+        DEB_TRACE() <<"Calibration->UPLOAD";
+
+        _setCalibrationProgress(1, 0, 1, -1.);
+        if(_uploadCalibrationDiff(m_calibration_path))
+        {
+            DEB_TRACE() << "uploadCalibration -> differential upload -> OK" ;
+        }
+        else if(imxpad_uploadCalibration(m_modules_mask,(char*)m_calibration_path.c_str()) == 0)
+        {
+            DEB_TRACE() << "uploadCalibration -> imxpad_uploadCalibration -> OK" ;
+            _calibrationLoaded();
+        }
+        else
+        {
+            m_status = Camera::Fault;
+            //- TODO: get the xpix error 
+            throw LIMA_HW_EXC(Error, "Error in imxpad_uploadCalibration!");
+        }
+        _setCalibrationProgress(0, 1, 1, 0.);
+        m_status = Camera::Ready;
+        return;
+    }
+
+    if (m_calibration_type == Camera::OTN_HOST)
+    {
+        _calibrateHost();
+        m_status = Camera::Ready;
+        return;
+    }
 
-							  //compute "offset line" where to copy OneLine[] in the *ptr, to ensure that the lines are copied in order of modules
-							  //DEB_TRACE() << "---- Niveau ------- 5.3 ---- ";
-							  int offset = ((120 * (OneLine[1] )) + (OneLine[4] - 1));
+    int (*calibration_fct)(unsigned, char*);
+    switch (m_calibration_type)
+    {
+    case Camera::OTN_SLOW:      calibration_fct = imxpad_calibrationOTN_SLOW;   break;
+    case Camera::OTN_MEDIUM:    calibration_fct = imxpad_calibrationOTN_MEDIUM; break;
+    case Camera::OTN_HIGH:      calibration_fct = imxpad_calibrationOTN_HIGH;   break;
+    default:
+        m_status = Camera::Fault;
+        throw LIMA_HW_EXC(NotSupported, "Calibration type not supported");
+    }
 
-							  //copy cleaned line in the lima buffer
-							  //DEB_TRACE() << "---- Niveau ------- 5.4 ---- ";
-							  for(k = 0; k < n2; k++)
-								  ptr[offset * n2 + k] = OneLine[5 + k];
-						  }
-						  //DEB_TRACE() << "---- Niveau ------- 6 ---- ";
+    //- one call for all the modules: progress (and cancel) only before and after it
+    if (!m_calibration_per_module)
+    {
+        _setCalibrationProgress(0, 0, 1, -1.);
+        DEB_TRACE() << "Calibration type " << m_calibration_type << " of modules " << DEB_HEX(m_modules_mask);
+        if (calibration_fct(m_modules_mask, (char*)m_calibration_path.c_str()) != 0)
+        {
+            m_status = Camera::Fault;
+            //- TODO: get the xpix error 
+            throw LIMA_HW_EXC(Error, "Error in imxpad_calibrationOTN!");
+        }
+        _calibrationLoaded();
+        _setCalibrationProgress(0, 1, 1, 0.);
+        m_status = Camera::Ready;
+        return;
+    }
 
-						  DEB_TRACE() << "image# " << i <<" cleaned" ;
-						  HwFrameInfoType frame_info;
-						  //DEB_TRACE() << "---- Niveau ------- 7 ---- ";
-						  frame_info.acq_frame_nb = i;
-						  //- raise the image to lima
-						  buffer_mgr.newFrameReady(frame_info);
-						  //DEB_TRACE() << "---- Niveau ------- 8 ---- ";
-					  }
-				  }
+    //- module after module, each in its own directory <path>/module_<n>
+    Timestamp t0 = Timestamp::now();
+    int nb_done = 0;
+    for (int bit = 0; bit < 32; bit++)
+    {
+        if (!(m_modules_mask & (1U << bit)))
+            continue;
+        if (_calibrationCancelled())
+        {
+            DEB_TRACE() << "Calibration cancelled after " << nb_done << " modules";
+            break;
+        }
+
+        double eta = -1.;
+        if (nb_done > 0)
+            eta = (Timestamp::now() - t0) / nb_done * (m_module_number - nb_done);
+        _setCalibrationProgress(bit + 1, nb_done, m_module_number, eta);
+
+        ostringstream module_path;
+        module_path << m_calibration_path << "/module_" << bit + 1;
+        if (mkdir(module_path.str().c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            m_status = Camera::Fault;
+            string msg = "Can not create the calibration directory " + module_path.str();
+            throw LIMA_HW_EXC(Error, msg.c_str());
+        }
+
+        DEB_TRACE() << "Calibration type " << m_calibration_type << " of module " << bit + 1;
+        if (calibration_fct(1U << bit, (char*)module_path.str().c_str()) != 0)
+        {
+            if (_calibrationCancelled())
+                break;
+            m_status = Camera::Fault;
+            //- TODO: get the xpix error 
+            throw LIMA_HW_EXC(Error, "Error in imxpad_calibrationOTN!");
+        }
+        nb_done++;
+    }
 
-				  DEB_TRACE() <<"Freeing every image pointer of the images array";
-				  for(int j=0 ; j < m_nb_frames ; j++)
-					  delete[] pSeqImage[j];
-				  DEB_TRACE() <<"Freeing images array";
-				  delete[] pSeqImage;
-				  m_status = Camera::Ready;
-				  DEB_TRACE() <<"m_status is Ready";
-			
-                    */
-		  }
-		  break;
+    if (_calibrationCancelled())
+    {
+        //- the modules calibrated before the cancel hold an unknown calibration
+        AutoMutex aLock(m_state_lock);
+        m_state.invalidateConfigG();
+        m_state.setDaclValid(false);
+        m_config_slots.clear();
+        m_dacl_cached = false;
+    }
+    else
+        _calibrationLoaded();
+    _setCalibrationProgress(0, nb_done, m_module_number, 0.);
+    m_status = Camera::Ready;
+}
+
+//-----------------------------------------------------
+//		Host calibration over the noise, all the modules at once:
+//		1. ITHL scan with a flat DACL: the ITHL of each chip is the mean noise edge of its pixels
+//		2. DACL scan with these ITHL: the DACL of each pixel is set just below its noise edge
+//		The DACL and config G files are written in m_calibration_path, then uploaded.
+//-----------------------------------------------------
+void Camera::_calibrateHost()
+{
+    DEB_MEMBER_FUNCT();
 
-            case XPAD_DLL_CALIBRATE:
+    Camera::HostCalibrationParams params = m_host_calibration_params;
+    int nb_ithl_steps = params.ithl_max - params.ithl_min + 1;
+    int nb_steps = nb_ithl_steps + DACL_NB_VALUES;
+
+    AutoMutex aLock(m_state_lock);
+    DetectorState calib = m_state;
+    aLock.unlock();
+    for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+        for (unsigned int chip = 0; chip < m_chip_number; chip++)
+            for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+                if (!calib.isConfigGValid(mod_idx, chip, index))
                 {
-                    DEB_TRACE() <<"Camera::->XPAD_DLL_CALIBRATE";
+                    m_status = Camera::Fault;
+                    throw LIMA_HW_EXC(Error, "Host calibration needs a known config G: load or upload one first");
+                }
+
+    Timestamp t0 = Timestamp::now();
+    int frame_size = _getFrameSizeInBytes();
+    int nb_pixels = m_image_size.getWidth() * m_image_size.getHeight();
+    vector<char> frames(size_t(frame_size) * params.nb_images);
+    vector<void*> image_array(params.nb_images);
+    for (int i = 0; i < params.nb_images; i++)
+        image_array[i] = &frames[size_t(i) * frame_size];
+
+    Camera::HostCalibrationStats stats;
+    memset(&stats, 0, sizeof(stats));
+    SCurveAnalyzer analyzer;
+    vector<int32_t> edges;
+
+    //- 1. ITHL scan
+    analyzer.init(nb_pixels, nb_ithl_steps, params.nb_threads);
+    stats.nb_threads = analyzer.getNbThreads();
+    _loadFlatConfig((params.dacl_flat << DACL_SHIFT) | DACL_ENABLE);
+    _loadConfigG(DetectorState::getConfigGReg(DetectorState::ITHL_IDX), params.ithl_min);
+    for (int step = 0; step < nb_ithl_steps; step++)
+    {
+        if (step > 0)
+            _stepITHL(1);
+        if (!_acquireScanStep(analyzer, step, image_array, stats, t0, nb_steps))
+        {
+            _saveSnapshot();
+            return;
+        }
+    }
+    analyzer.findEdges(params.noise_counts, edges);
+
+    int width = m_image_size.getWidth();
+    for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+    {
+        for (unsigned int chip = 0; chip < m_chip_number; chip++)
+        {
+            long sum = 0;
+            int nb = 0;
+            for (int row = 0; row < XPAD_NB_ROWS; row++)
+            {
+                const int32_t* line = &edges[(mod_idx * XPAD_NB_ROWS + row) * width + chip * XPAD_NB_COLUMNS];
+                for (int col = 0; col < XPAD_NB_COLUMNS; col++)
+                    if (line[col] >= 0)
+                    {
+                        sum += line[col];
+                        nb++;
+                    }
+            }
+            int chip_ithl = nb ? params.ithl_min + int(double(sum) / nb + 0.5) : params.ithl_max;
+            calib.setConfigG(mod_idx, chip, DetectorState::ITHL_IDX, chip_ithl);
+
+            unsigned long values[DetectorState::NB_CONFIG_G];
+            for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+                values[index] = calib.getConfigG(mod_idx, chip, index);
+            _loadAllConfigG(calib.getModuleBit(mod_idx) + 1, chip + 1, values);
+        }
+    }
+    stats.analysis_time = analyzer.getAnalysisDuration();
+
+    //- 2. DACL scan
+    analyzer.init(nb_pixels, DACL_NB_VALUES, params.nb_threads);
+    for (int dacl = 0; dacl < DACL_NB_VALUES; dacl++)
+    {
+        _loadFlatConfig((dacl << DACL_SHIFT) | DACL_ENABLE);
+        if (!_acquireScanStep(analyzer, dacl, image_array, stats, t0, nb_steps))
+        {
+            _saveSnapshot();
+            return;
+        }
+    }
+    analyzer.findEdges(params.noise_counts, edges);
+
+    uint16_t* dacl = calib.getDacl();
+    for (int pix = 0; pix < nb_pixels; pix++)
+    {
+        //- never noisy -> highest DACL, noisy from the first DACL -> lowest one
+        int value = (edges[pix] < 0) ? DACL_NB_VALUES - 1 : max(edges[pix] - params.dacl_margin, 0);
+        dacl[pix] = (value << DACL_SHIFT) | DACL_ENABLE;
+    }
+    calib.setDaclValid(true);
+    stats.analysis_time += analyzer.getAnalysisDuration();
+
+    CalibrationFile::writeText(m_calibration_path, calib);
+    if (!_uploadCalibrationDiff(m_calibration_path))
+    {
+        m_status = Camera::Fault;
+        throw LIMA_HW_EXC(Error, "Can not upload the host calibration");
+    }
+
+    stats.total_time = Timestamp::now() - t0;
+    {
+        AutoMutex aLock(m_cond.mutex());
+        m_host_calibration_stats = stats;
+    }
+    _setCalibrationProgress(0, nb_steps, nb_steps, 0.);
+
+    DEB_TRACE() << "Host calibration -> total = " << stats.total_time << " s"
+                << " | acquisition = " << stats.acquisition_time << " s"
+                << " | analysis = " << stats.analysis_time << " s"
+                << " on " << stats.nb_threads << " threads";
+}
+
+//-----------------------------------------------------
+//		Acquire the images of one scan step into the analyzer, false if cancelled
+//-----------------------------------------------------
+bool Camera::_acquireScanStep(SCurveAnalyzer& analyzer, int step, vector<void*>& image_array,
+                              Camera::HostCalibrationStats& stats, const Timestamp& t0, int nb_steps)
+{
+    DEB_MEMBER_FUNCT();
+
+    int step_done = stats.nb_frames / m_host_calibration_params.nb_images;
+    if (_calibrationCancelled())
+    {
+        DEB_TRACE() << "Host calibration cancelled after " << step_done << " steps";
+        return false;
+    }
+    double eta = step_done ? (Timestamp::now() - t0) / step_done * (nb_steps - step_done) : -1.;
+    _setCalibrationProgress(0, step_done, nb_steps, eta);
+
+    Timestamp t_acq = Timestamp::now();
+    setExposureParameters(	m_host_calibration_params.exp_time_usec, 0, 0,
+                            m_shutter_time_usec, m_ovf_refresh_time_usec, 0,
+                            XPIX_NOT_USED_YET, XPIX_NOT_USED_YET,
+                            image_array.size(), XPIX_NOT_USED_YET, m_imxpad_format,
+                            (m_xpad_model == IMXPAD_S140)?1:XPIX_NOT_USED_YET,
+                            XPIX_NOT_USED_YET, XPIX_NOT_USED_YET, XPIX_NOT_USED_YET, XPIX_NOT_USED_YET);
+    if (xpci_getImgSeq(	m_pixel_depth, m_modules_mask, m_chip_number, image_array.size(), &image_array[0],
+                        XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY,
+                        XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY) == -1)
+    {
+        if (_calibrationCancelled())
+            return false;
+        m_status = Camera::Fault;
+        throw LIMA_HW_EXC(Error, "Host calibration: xpci_getImgSeq as returned an error ! ");
+    }
+    stats.acquisition_time += Timestamp::now() - t_acq;
+
+    for (size_t i = 0; i < image_array.size(); i++)
+        analyzer.addFrame(step, image_array[i], m_pixel_depth == B4);
+    stats.nb_frames += image_array.size();
+    return true;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::_setCalibrationProgress(int module, int step, int nb_steps, double eta)
+{
+    AutoMutex aLock(m_cond.mutex());
+    m_calibration_progress.module   = module;
+    m_calibration_progress.step     = step;
+    m_calibration_progress.nb_steps = nb_steps;
+    m_calibration_progress.eta      = eta;
+}
+
+//-----------------------------------------------------
+//		upload the wait times between images
+//-----------------------------------------------------
+void Camera::uploadExpWaitTimes(unsigned long *pWaitTime, unsigned size)
+{
+    DEB_MEMBER_FUNCT();
+
+    //- Check the number of values: one per image of the detector sequence, which is
+    //- a block of nb_phases * nb_cycles images in phase binning
+    unsigned nb_images = m_phase_binning ? m_phase_nb_phases * m_phase_nb_cycles : m_nb_frames;
+    if (size != nb_images)
+    {
+        throw LIMA_HW_EXC(Error, "Error in uploadExpWaitTimes: number of values does not correspond to number of images");
+    }
+
+    if(imxpad_uploadExpWaitTimes(m_modules_mask,(unsigned int*)pWaitTime,size) == 0)
+	{
+        DEB_TRACE() << "uploadExpWaitTimes -> imxpad_uploadExpWaitTimes -> OK" ;
+	}
+	else
+	{
+		throw LIMA_HW_EXC(Error, "Error in imxpad_uploadExpWaitTimes!");
+	}
+}
+
+//-----------------------------------------------------
+//		increment the ITHL
+//-----------------------------------------------------
+void Camera::incrementITHL()
+{
+    DEB_MEMBER_FUNCT();
+
+    //- live acquisition: applied at the next frame boundary
+    if (_queueLiveCommand(Camera::LIVE_STEP_ITHL, 0, 1))
+        return;
+
+    _stepITHL(1);
+    _saveSnapshot();
+}
+
+//-----------------------------------------------------
+//		decrement the ITHL
+//-----------------------------------------------------
+void Camera::decrementITHL()
+{
+    DEB_MEMBER_FUNCT();
+
+    //- live acquisition: applied at the next frame boundary
+    if (_queueLiveCommand(Camera::LIVE_STEP_ITHL, 0, -1))
+        return;
+
+    _stepITHL(-1);
+    _saveSnapshot();
+}
 
-                    m_status = Camera::Exposure;
+//-----------------------------------------------------
+//		Step the ITHL of all the chips (+1 or -1) without saving the snapshot
+//-----------------------------------------------------
+void Camera::_stepITHL(int step)
+{
+    DEB_MEMBER_FUNCT();
+
+    if (step > 0)
+    {
+        if(imxpad_incrITHL(m_modules_mask) != 0)
+            throw LIMA_HW_EXC(Error, "Error in imxpad_incrITHL!");
+        DEB_TRACE() << "incrementITHL -> imxpad_incrITHL -> OK" ;
+    }
+    else
+    {
+        if(imxpad_decrITHL(m_modules_mask) != 0)
+            throw LIMA_HW_EXC(Error, "Error in imxpad_decrITHL!");
+        DEB_TRACE() << "decrementITHL -> imxpad_decrITHL -> OK" ;
+    }
+
+    AutoMutex aLock(m_state_lock);
+    m_state.stepConfigG(DetectorState::ITHL_IDX, step);
+}
+
+//-----------------------------------------------------
+//		Threshold scan: nb_steps ITHL steps of nb_images images from ithl_min
+//-----------------------------------------------------
+void Camera::startThresholdScan(int ithl_min, int nb_steps, int nb_images)
+{
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR3(ithl_min, nb_steps, nb_images);
+
+    if (ithl_min < 0 || nb_steps < 1 || nb_images < 1)
+        throw LIMA_HW_EXC(InvalidValue, "Invalid threshold scan parameters");
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_wait_flag)
+        throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+
+    m_scan_ithl_min         = ithl_min;
+    m_scan_nb_steps         = nb_steps;
+    m_scan_nb_images        = nb_images;
+    m_stop_asked            = false;
+    m_full_image_size_in_bytes = _getFrameSizeInBytes();
+    _startScanJob(false);
+}
+
+//-----------------------------------------------------
+//		Threshold scan run by the next Lima acquisitions, the images being published
+//-----------------------------------------------------
+void Camera::setThresholdScanMode(bool enable, int ithl_min, int nb_steps, int nb_images)
+{
+    DEB_MEMBER_FUNCT();
+    DEB_PARAM() << DEB_VAR4(enable, ithl_min, nb_steps, nb_images);
+
+    if (enable && (ithl_min < 0 || nb_steps < 1 || nb_images < 1))
+        throw LIMA_HW_EXC(InvalidValue, "Invalid threshold scan parameters");
+
+    AutoMutex aLock(m_cond.mutex());
+    if (!m_wait_flag)
+        throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+
+    m_scan_mode = enable;
+    if (enable)
+    {
+        m_scan_mode_ithl_min    = ithl_min;
+        m_scan_mode_nb_steps    = nb_steps;
+        m_scan_mode_nb_images   = nb_images;
+    }
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getThresholdScanMode(bool& enable)
+{
+    enable = m_scan_mode;
+}
+
+//-----------------------------------------------------
+//		Wake up the acquisition thread on the scan (m_cond mutex must be held)
+//-----------------------------------------------------
+void Camera::_startScanJob(bool publish_frames)
+{
+    m_scan_publish_frames   = publish_frames;
+    m_current_nb_frames     = -1;
+
+    m_job = Camera::SCAN_JOB;
+    m_status = Camera::Exposure;
+    m_job_post_ts = Timestamp::now();
+    m_wait_flag = false;
+    m_cond.broadcast();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void Camera::getThresholdScanStatus(int& ithl_min, int& nb_steps, int& nb_steps_done)
+{
+    AutoMutex aLock(m_scan_cond.mutex());
+    ithl_min        = m_scan_ithl_min;
+    nb_steps        = m_scan_nb_steps;
+    nb_steps_done   = m_scan_nb_steps_done;
+}
+
+//-----------------------------------------------------
+//		Summed counts of each pixel (image order) at a step of the last scan
+//-----------------------------------------------------
+const uint32_t* Camera::getThresholdScanCounts(int step)
+{
+    AutoMutex aLock(m_scan_cond.mutex());
+    if (step < 0 || step >= m_scan_nb_steps_done)
+        throw LIMA_HW_EXC(InvalidValue, "Threshold scan step not acquired");
+    return m_scan_counts.getCounts(step);
+}
+
+//-----------------------------------------------------
+//		Threshold scan job: the images of step k are summed and published by
+//		the scan thread while the ITHL is stepped and step k+1 is acquired
+//-----------------------------------------------------
+void Camera::_thresholdScan()
+{
+    DEB_MEMBER_FUNCT();
+
+    {
+        AutoMutex aLock(m_scan_cond.mutex());
+        m_scan_counts.init(m_image_size.getWidth() * m_image_size.getHeight(), m_scan_nb_steps);
+        m_scan_nb_steps_done = 0;
+        for (int slot = 0; slot < 2; slot++)
+        {
+            m_scan_buffers[slot].resize(size_t(m_full_image_size_in_bytes) * m_scan_nb_images);
+            m_scan_images[slot].resize(m_scan_nb_images);
+            for (int i = 0; i < m_scan_nb_images; i++)
+                m_scan_images[slot][i] = &m_scan_buffers[slot][size_t(i) * m_full_image_size_in_bytes];
+            m_scan_filled_step[slot] = -1;
+        }
+        m_scan_end = false;
+        m_scan_failed = false;
+    }
 
-                    switch (m_calibration_type)
+    //- the calibrated ITHL of each chip, restored at the end of the scan
+    DetectorState saved_state;
+    {
+        AutoMutex aLock(m_state_lock);
+        saved_state = m_state;
+    }
+    _loadConfigG(DetectorState::getConfigGReg(DetectorState::ITHL_IDX), m_scan_ithl_min);
+    _setExposureParameters(m_scan_nb_images);
+    m_buffer_cb_mgr.setStartTimestamp(Timestamp::now());
+
+    ScanThread scan_thread(*this);
+    scan_thread.start();
+    try
+    {
+        for (int step = 0; step < m_scan_nb_steps; step++)
+        {
+            int slot = step % 2;
+            {
+                AutoMutex aLock(m_scan_cond.mutex());
+                while (m_scan_filled_step[slot] >= 0 && !m_stop_asked)
+                    m_scan_cond.wait();
+            }
+            if (m_stop_asked)
+                break;
+
+            if (xpci_getImgSeq(	m_pixel_depth, m_modules_mask, m_chip_number, m_scan_nb_images,
+                                &m_scan_images[slot][0],
+                                XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY,
+                                XPIX_V1_COMPATIBILITY, XPIX_V1_COMPATIBILITY) == -1)
+            {
+                if (m_stop_asked)
+                    break;
+                throw LIMA_HW_EXC(Error, "Threshold scan: xpci_getImgSeq as returned an error ! ");
+            }
+
+            {
+                AutoMutex aLock(m_scan_cond.mutex());
+                m_scan_filled_step[slot] = step;
+                m_scan_cond.broadcast();
+            }
+
+            //- step k+1 threshold while step k is summed and published
+            if (step + 1 < m_scan_nb_steps)
+                _stepITHL(1);
+        }
+    }
+    catch (Exception&)
+    {
+        _endThresholdScan(scan_thread, saved_state);
+        m_status = Camera::Fault;
+        throw;
+    }
+    _endThresholdScan(scan_thread, saved_state);
+
+    if (m_scan_failed)
+    {
+        m_status = Camera::Fault;
+        throw LIMA_HW_EXC(Error, "Threshold scan: the images could not be published");
+    }
+    m_status = Camera::Ready;
+    DEB_TRACE() << "Threshold scan done: " << m_scan_nb_steps_done << " steps";
+}
+
+//-----------------------------------------------------
+//		Wait for the scan thread to handle the acquired steps, then restore the ITHL
+//		of each chip from the state saved before the scan
+//-----------------------------------------------------
+void Camera::_endThresholdScan(ScanThread& scan_thread, const DetectorState& saved_state)
+{
+    DEB_MEMBER_FUNCT();
+
+    {
+        AutoMutex aLock(m_scan_cond.mutex());
+        m_scan_end = true;
+        m_scan_cond.broadcast();
+    }
+    scan_thread.join();
+
+    try
+    {
+        //- one call if all the chips share the ITHL, else one loadAllConfigG per chip
+        int ithl_idx = DetectorState::ITHL_IDX;
+        bool all_valid = true;
+        bool all_same = true;
+        for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+            for (unsigned int chip = 0; chip < m_chip_number; chip++)
+            {
+                all_valid = all_valid && saved_state.isConfigGValid(mod_idx, chip, ithl_idx);
+                all_same = all_same && saved_state.getConfigG(mod_idx, chip, ithl_idx) ==
+                                       saved_state.getConfigG(0, 0, ithl_idx);
+            }
+
+        if (all_valid && all_same)
+            _loadConfigG(DetectorState::getConfigGReg(ithl_idx), saved_state.getConfigG(0, 0, ithl_idx));
+        else
+        {
+            for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+                for (unsigned int chip = 0; chip < m_chip_number; chip++)
+                {
+                    unsigned long values[DetectorState::NB_CONFIG_G];
+                    bool chip_valid = true;
+                    for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
                     {
-                        //-----------------------------------------------------	
-                    case Camera::OTN_SLOW:
-                        {
-                            DEB_TRACE() <<"XPAD_DLL_CALIBRATE->OTN_SLOW";    
-
-                            if(imxpad_calibrationOTN_SLOW(m_modules_mask,(char*)m_calibration_path.c_str()) == 0)
-                            {
-                                DEB_TRACE() << "calibrateOTNSlow -> imxpad_calibrationOTN_SLOW -> OK" ;
-                            }
-                            else
-                            {
-                                m_status = Camera::Fault;
-                                //- TODO: get the xpix error 
-                                throw LIMA_HW_EXC(Error, "Error in imxpad_calibrationOTN_SLOW!");
-                            }
-                        }
-                        break;
-
-                         //-----------------------------------------------------	
-                    case Camera::UPLOAD:
-                        {
-                            DEB_TRACE() <<"XPAD_DLL_CALIBRATE->UPLOAD";    
-
-                            if(imxpad_uploadCalibration(m_modules_mask,(char*)m_calibration_path.c_str()) == 0)
-                            {
-                                DEB_TRACE() << "uploadCalibration -> imxpad_uploadCalibration -> OK" ;
-                            }
-                            else
-                            {
-                                m_status = Camera::Fault;
-                                //- TODO: get the xpix error 
-                                throw LIMA_HW_EXC(Error, "Error in imxpad_uploadCalibration!");
-                            }
-                        }
-                        break;
+                        chip_valid = chip_valid && saved_state.isConfigGValid(mod_idx, chip, index);
+                        values[index] = saved_state.getConfigG(mod_idx, chip, index);
                     }
-                    m_status = Camera::Ready;
+                    if (chip_valid)
+                        _loadAllConfigG(saved_state.getModuleBit(mod_idx) + 1, chip + 1, values);
+                    else
+                        DEB_WARNING() << "Threshold scan: ITHL of module " << saved_state.getModuleBit(mod_idx) + 1
+                                      << " chip " << chip + 1 << " unknown before the scan, not restored";
                 }
+        }
+    }
+    catch (Exception& e)
+    {
+        DEB_ERROR() << "Threshold scan: the ITHL could not be restored: " << e.getErrMsg();
+        m_status = Camera::Fault;
+    }
+    _saveSnapshot();
+}
+
+//-----------------------------------------------------
+//		Scan thread: sum (and publish) the images of each acquired step in order
+//-----------------------------------------------------
+void Camera::ScanThread::threadFunction()
+{
+    DEB_MEMBER_FUNCT();
+
+    Cond& cond = m_cam.m_scan_cond;
+    for (int step = 0; step < m_cam.m_scan_nb_steps; step++)
+    {
+        int slot = step % 2;
+        {
+            AutoMutex aLock(cond.mutex());
+            while (m_cam.m_scan_filled_step[slot] != step && !m_cam.m_scan_end)
+                cond.wait();
+            if (m_cam.m_scan_filled_step[slot] != step)
                 break;
-		}
-  }
-  catch( yat::Exception& ex )
-  {
-	  DEB_ERROR() << "Error : " << ex.errors[0].desc;
-  }
+        }
+
+        try
+        {
+            vector<void*>& images = m_cam.m_scan_images[slot];
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                m_cam.m_scan_counts.addFrame(step, images[i], m_cam.m_pixel_depth == B4);
+                if (m_cam.m_scan_publish_frames)
+                    m_cam._publishFrame(step * images.size() + i, images[i]);
+            }
+            //- the slot is refilled once handed back
+            m_cam._releaseHostFrames();
+        }
+        catch (Exception& e)
+        {
+            DEB_ERROR() << "Threshold scan failed: " << e.getErrMsg();
+            m_cam._releaseHostFrames();
+            AutoMutex aLock(cond.mutex());
+            m_cam.m_scan_failed = true;
+            m_cam.m_stop_asked = true;
+            m_cam.m_scan_filled_step[0] = m_cam.m_scan_filled_step[1] = -1;
+            cond.broadcast();
+            break;
+        }
+
+        AutoMutex aLock(cond.mutex());
+        m_cam.m_scan_filled_step[slot] = -1;
+        m_cam.m_scan_nb_steps_done = step + 1;
+        cond.broadcast();
+    }
+}
+
+//-----------------------------------------------------
+//		Set the specific parameters
+//-----------------------------------------------------
+void Camera::setSpecificParameters( unsigned deadtime, unsigned init,
+								    unsigned shutter, unsigned ovf,
+								    unsigned n,       unsigned p,
+								    unsigned GP1,     unsigned GP2,    unsigned GP3,      unsigned GP4)
+{
+
+	DEB_MEMBER_FUNCT();
+
+	DEB_TRACE() << "Setting Specific Parameters ..." ;
+    
+	m_time_between_images_usec  = deadtime; //- Temps entre chaque image
+    m_time_before_start_usec    = init;     //- Temps initial
+    m_shutter_time_usec         = shutter;
+	m_ovf_refresh_time_usec     = ovf;
+    m_specific_param_n          = n;
+    m_specific_param_p          = p;
+    m_specific_param_GP1		= GP1;
+	m_specific_param_GP2		= GP2;
+	m_specific_param_GP3		= GP3;
+	m_specific_param_GP4		= GP4;
+	_exposureChanged();
 }
 
-
 //-----------------------------------------------------
-//      setExposureParam
+//		Detector state snapshot
 //-----------------------------------------------------
-void Camera::setExposureParameters(  unsigned Texp,unsigned Twait,unsigned Tinit,
-			                         unsigned Tshutter,unsigned Tovf,unsigned trigger_mode, unsigned n,unsigned p,
-			                         unsigned nbImages,unsigned BusyOutSel,unsigned formatIMG,unsigned postProc,
-			                         unsigned GP1,unsigned GP2,unsigned GP3,unsigned GP4)
+void Camera::setSnapshotPath(string path)
 {
-
 	DEB_MEMBER_FUNCT();
-
-    if (xpci_modExposureParam(m_modules_mask, Texp, Twait, Tinit,
-	                          Tshutter, Tovf, trigger_mode,  n, p,
-	                          nbImages, BusyOutSel, formatIMG, postProc,
-	                          GP1, GP2, GP3, GP4) == 0)
-	{
-		DEB_TRACE() << "setExposureParameters (xpci_modExposureParam) -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in setExposureParameters! (xpci_modExposureParam)");
-	}
+	DEB_PARAM() << DEB_VAR1(path);
+	m_snapshot_path = path;
+	_saveSnapshot();
 }
 
 //-----------------------------------------------------
 //
 //-----------------------------------------------------
-void Camera::setAcquisitionType(short acq_type)
+void Camera::getSnapshotPath(string& path)
 {
 	DEB_MEMBER_FUNCT();
-    m_acquisition_type = (Camera::XpadAcqType)acq_type;
-
-	DEB_TRACE() << "m_acquisition_type = " << m_acquisition_type  ;
+	path = m_snapshot_path;
 }
 
 //-----------------------------------------------------
-//
+//		Write the snapshot of the programmed state if a snapshot path is set
 //-----------------------------------------------------
-void Camera::loadFlatConfig(unsigned flat_value)
+void Camera::_saveSnapshot()
 {
 	DEB_MEMBER_FUNCT();
 
-	unsigned int all_chips_mask = 0x7F;
-	if (xpci_modLoadFlatConfig(m_modules_mask, all_chips_mask, flat_value) == 0)
+	if (m_snapshot_path.empty())
+		return;
+
+	AutoMutex aLock(m_state_lock);
+	try
 	{
-		DEB_TRACE() << "loadFlatConfig, with value: " <<  flat_value << " -> OK" ;
+		m_state.save(m_snapshot_path);
 	}
-	else
+	catch (Exception& e)
 	{
-		throw LIMA_HW_EXC(Error, "Error in loadFlatConfig!");
+		//- the detector is programmed, only the warm start is lost
+		DEB_WARNING() << "Snapshot not written: " << e.getErrMsg();
 	}
 }
 
 //-----------------------------------------------------
-//
+//		Exposure/specific parameters changed: update the snapshot
 //-----------------------------------------------------
-void Camera::loadAllConfigG(unsigned long modNum, unsigned long chipId , unsigned long* config_values)
+void Camera::_exposureChanged()
 {
 	DEB_MEMBER_FUNCT();
 
-    //- Transform the module number into a module mask on 8 bits
-    //- eg: if modNum = 4, mask_local = 8
-    unsigned long mask_local_module = 0x00;
-    SET(mask_local_module,(modNum-1));// minus 1 because modNum start at 1
-    unsigned long mask_local_chip = 0x00;
-    SET(mask_local_chip,(chipId-1));// minus 1 because chipId start at 1
-
-	if(xpci_modLoadAllConfigG(mask_local_module,mask_local_chip, 
-			                                    config_values[0],//- CMOS_TP
-			                                    config_values[1],//- AMP_TP, 
-			                                    config_values[2],//- ITHH, 
-			                                    config_values[3],//- VADJ, 
-			                                    config_values[4],//- VREF, 
-			                                    config_values[5],//- IMFP, 
-			                                    config_values[6],//- IOTA, 
-			                                    config_values[7],//- IPRE, 
-			                                    config_values[8],//- ITHL, 
-			                                    config_values[9],//- ITUNE, 
-			                                    config_values[10]//- IBUFFER
-		                        ) == 0)
-	{
-		DEB_TRACE() << "loadAllConfigG for module " << modNum  << ", and chip " << chipId << " -> OK" ;
-		DEB_TRACE() << "(loadAllConfigG for mask_local_module " << mask_local_module  << ", and mask_local_chip " << mask_local_chip << " )" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in loadAllConfigG!");
-	}
+	if (_updateExposureState())
+		_saveSnapshot();
 }
 
 //-----------------------------------------------------
-//
+//		Copy the exposure/specific parameters in the state, false if unchanged
 //-----------------------------------------------------
-void Camera::loadConfigG(const vector<unsigned long>& reg_and_value)
+bool Camera::_updateExposureState()
 {
 	DEB_MEMBER_FUNCT();
 
-	if(xpci_modLoadConfigG(m_modules_mask, m_chip_number, reg_and_value[0], reg_and_value[1])==0)
-	{
-		DEB_TRACE() << "loadConfigG: " << reg_and_value[0] << ", with value: " << reg_and_value[1] << " -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in loadConfigG!");
-	}
+	DetectorState::ExposureParams exp;
+	exp.exp_time_usec	= m_exp_time_usec;
+	exp.trigger_mode	= m_imxpad_trigger_mode;
+	exp.format			= m_imxpad_format;
+	exp.deadtime_usec	= m_time_between_images_usec;
+	exp.init_usec		= m_time_before_start_usec;
+	exp.shutter_usec	= m_shutter_time_usec;
+	exp.ovf_usec		= m_ovf_refresh_time_usec;
+	exp.n				= m_specific_param_n;
+	exp.p				= m_specific_param_p;
+	exp.gp[0]			= m_specific_param_GP1;
+	exp.gp[1]			= m_specific_param_GP2;
+	exp.gp[2]			= m_specific_param_GP3;
+	exp.gp[3]			= m_specific_param_GP4;
+
+	AutoMutex aLock(m_state_lock);
+	if (memcmp(&exp, &m_state.exposure, sizeof(exp)) == 0)
+		return false;
+	m_state.exposure = exp;
+	return true;
 }
 
 //-----------------------------------------------------
-//
+//		A calibration was loaded by the xpix library: config G unknown, DACL read back
 //-----------------------------------------------------
-void Camera::loadAutoTest(unsigned known_value)
+void Camera::_calibrationLoaded()
 {
 	DEB_MEMBER_FUNCT();
 
-    unsigned int mode = 0; //- 0 -> flat
-	if(xpci_modLoadAutoTest(m_modules_mask, known_value, mode)==0)
-	{
-        DEB_TRACE() << "loadAutoTest with value: " << known_value << " ; in mode: " << mode << " -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in loadAutoTest!");
-	}
+	AutoMutex aLock(m_state_lock);
+	m_state.invalidateConfigG();
+	m_config_slots.clear();
+	_readBackDacl();
+	aLock.unlock();
+	_saveSnapshot();
 }
 
 //-----------------------------------------------------
-//		Save the config L (DACL) to XPAD RAM
+//		Read the DACL of all the modules in the state (m_state_lock must be held)
 //-----------------------------------------------------
-void Camera::saveConfigL(unsigned long modNum, unsigned long calibId, unsigned long chipId, unsigned long curRow, unsigned long* values)
+void Camera::_readBackDacl()
 {
-    DEB_MEMBER_FUNCT();
-
-    //- Transform the module number into a module mask on 8 bits
-    //- eg: if modNum = 4, mask_local = 8
-    unsigned long mask_local = 0x00;
-    SET(mask_local,(modNum-1));// -1 because modNum start at 1
-    //- because start at 1 at high level and 0 at low level
-    chipId = chipId - 1;
+	DEB_MEMBER_FUNCT();
 
-    //- Call the xpix fonction
-    if(xpci_modSaveConfigL(mask_local,calibId,chipId,curRow,(unsigned int*) values) == 0)
+	if (xpci_getModConfig(m_modules_mask, m_chip_number, m_state.getDacl()) == 0)
 	{
-        DEB_TRACE() << "saveConfigL for module: " << modNum << " | chip: " << chipId << " | row: " << curRow << " -> OK" ;
+		m_state.setDaclValid(true);
+		memcpy(m_dacl, m_state.getDacl(), m_state.getDaclSize() * sizeof(unsigned short));
+		m_dacl_cached = true;
 	}
 	else
 	{
-		throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigL!");
+		DEB_WARNING() << "DACL can not be read back (xpci_getModConfig)";
+		m_state.setDaclValid(false);
+		m_dacl_cached = false;
 	}
 }
 
 //-----------------------------------------------------
-//		Save the config G to XPAD RAM
+//		Mirror of the RAM slot calibId of the modules (m_state_lock must be held)
 //-----------------------------------------------------
-void Camera::saveConfigG(unsigned long modNum, unsigned long calibId, unsigned long reg,unsigned long* values)
+DetectorState& Camera::_getConfigSlot(unsigned long calibId)
 {
-    DEB_MEMBER_FUNCT();
-
-    //- Transform the module number into a module mask on 8 bits
-    //- eg: if modNum = 4, mask_local = 8
-    unsigned long mask_local = 0x00;
-    SET(mask_local,(modNum-1)); // -1 because modNum start at 1
-
-    //- Call the xpix fonction
-    if(xpci_modSaveConfigG(mask_local,calibId,reg,(unsigned int*) values) == 0)
-	{
-        DEB_TRACE() << "saveConfigG for module: " << modNum << " | reg: " << reg << " -> OK" ;
-	}
-	else
+	map<unsigned long, DetectorState>::iterator it = m_config_slots.find(calibId);
+	if (it == m_config_slots.end())
 	{
-		throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigG!");
+		it = m_config_slots.insert(make_pair(calibId, DetectorState())).first;
+		it->second.init(m_modules_mask, m_module_number, m_chip_number);
 	}
+	return it->second;
 }
 
 //-----------------------------------------------------
-//		Load the config to detector chips
+//		Save the snapshot now
 //-----------------------------------------------------
-void Camera::loadConfig(unsigned long modNum, unsigned long calibId)
+void Camera::saveSnapshot()
 {
-    DEB_MEMBER_FUNCT();
-
-    //- Transform the module number into a module mask on 8 bits
-    //- eg: if modNum = 4, mask_local = 8
-    unsigned long mask_local = 0x00;
-    SET(mask_local,(modNum-1));// -1 because modNum start at 1
+	DEB_MEMBER_FUNCT();
 
-    //- Call the xpix fonction
-    if(xpci_modDetLoadConfig(mask_local,calibId) == 0)
-	{
-        DEB_TRACE() << "loadConfig for module: " << modNum << " | calibID: " << calibId << " -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in xpci_modDetLoadConfig!");
-	}
+	if (m_snapshot_path.empty())
+		throw LIMA_HW_EXC(Error, "No snapshot path set");
+	AutoMutex aLock(m_state_lock);
+	m_state.save(m_snapshot_path);
 }
 
 //-----------------------------------------------------
-//		Get the modules config (Local aka DACL)
+//		Warm start: validate what the detector holds against the snapshot
+//		and only program what differs
 //-----------------------------------------------------
-unsigned short*& Camera::getModConfig()
+void Camera::restoreSnapshot()
 {
-    DEB_MEMBER_FUNCT();
+	DEB_MEMBER_FUNCT();
 
-    /*DEB_TRACE() << "Lima::Camera::getModConfig -> xpci_getModConfig -> 1" ;
-    //- Call the xpix fonction
-    if(xpci_getModConfig(m_modules_mask,m_chip_number,m_dacl) == 0)
-	{
-        DEB_TRACE() << "Lima::Camera::getModConfig -> xpci_getModConfig -> OK" ;
-	}
-	else
+	AutoMutex aLock(m_cond.mutex());
+	if (!m_wait_flag)
+		throw LIMA_HW_EXC(Error, "Detector is busy: acquisition or calibration running");
+
+	DetectorState snapshot;
+	if (m_snapshot_path.empty() || !snapshot.load(m_snapshot_path, m_modules_mask, m_module_number, m_chip_number))
 	{
-		throw LIMA_HW_EXC(Error, "Error in xpci_getModConfig!");
+		DEB_WARNING() << "No detector state snapshot to restore (" << m_snapshot_path << ")";
+		return;
 	}
-    DEB_TRACE() << "Lima::Camera::getModConfig -> xpci_getModConfig -> 2" ;
 
-    return m_dacl;*/
+	Timestamp t0 = Timestamp::now();
+	AutoMutex stateLock(m_state_lock);
+
+	//- 1. exposure and specific parameters (programmed at each start)
+	const DetectorState::ExposureParams& exp = snapshot.exposure;
+	m_exp_time_usec				= exp.exp_time_usec;
+	m_imxpad_trigger_mode		= exp.trigger_mode;
+	m_imxpad_format				= exp.format;
+	m_pixel_depth				= (exp.format == 0) ? B2 : B4;
+	m_time_between_images_usec	= exp.deadtime_usec;
+	m_time_before_start_usec	= exp.init_usec;
+	m_shutter_time_usec			= exp.shutter_usec;
+	m_ovf_refresh_time_usec		= exp.ovf_usec;
+	m_specific_param_n			= exp.n;
+	m_specific_param_p			= exp.p;
+	m_specific_param_GP1		= exp.gp[0];
+	m_specific_param_GP2		= exp.gp[1];
+	m_specific_param_GP3		= exp.gp[2];
+	m_specific_param_GP4		= exp.gp[3];
+	m_state.exposure			= exp;
+
+	//- 2. config G and DACL
+	_programState(snapshot);
+
+	DEB_TRACE() << "Snapshot restored in " << (Timestamp::now() - t0) << " s";
 }
 
 //-----------------------------------------------------
-//		Reset the detector
+//		Program the config G registers and the DACL of state (m_state_lock must be held):
+//		config G can not be read back, the valid registers are all reprogrammed; the DACL
+//		are read back, only the modules that differ are reprogrammed. state is then mirrored.
 //-----------------------------------------------------
-void Camera::reset()
+void Camera::_programState(const DetectorState& state)
 {
-    DEB_MEMBER_FUNCT();
-	unsigned int ALL_MODULES = 0xFF;
-    if(xpci_modRebootNIOS(ALL_MODULES) == 0)
+	DEB_MEMBER_FUNCT();
+
+	//- config G
+	for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
 	{
-        DEB_TRACE() << "reset -> xpci_modRebootNIOS -> OK" ;
+		unsigned int mod_mask = 1U << state.getModuleBit(mod_idx);
+		for (unsigned int chip = 0; chip < m_chip_number; chip++)
+		{
+			unsigned long v[DetectorState::NB_CONFIG_G];
+			bool all_valid = true;
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+			{
+				v[index] = state.getConfigG(mod_idx, chip, index);
+				all_valid = all_valid && state.isConfigGValid(mod_idx, chip, index);
+			}
+
+			if (all_valid)
+			{
+				if (xpci_modLoadAllConfigG(mod_mask, 1U << chip, v[0], v[1], v[2], v[3], v[4], v[5],
+											v[6], v[7], v[8], v[9], v[10]) != 0)
+					throw LIMA_HW_EXC(Error, "Error in xpci_modLoadAllConfigG!");
+			}
+			else
+			{
+				for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+					if (state.isConfigGValid(mod_idx, chip, index) &&
+						xpci_modLoadConfigG(mod_mask, 1U << chip, DetectorState::getConfigGReg(index), v[index]) != 0)
+						throw LIMA_HW_EXC(Error, "Error in xpci_modLoadConfigG!");
+			}
+		}
 	}
-	else
+
+	//- DACL
+	_readBackDacl();
+	DetectorState& slot = _getConfigSlot(HOST_CALIB_ID);
+	for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
 	{
-		throw LIMA_HW_EXC(Error, "Error in xpci_modRebootNIOS!");
+		if (!state.isDaclValid(mod_idx))
+			continue;
+
+		bool same = m_state.isDaclValid(mod_idx);
+		for (unsigned int chip = 0; same && chip < m_chip_number; chip++)
+			for (int row = 0; same && row < XPAD_NB_ROWS; row++)
+				same = memcmp(m_state.getDaclRow(mod_idx, chip, row), state.getDaclRow(mod_idx, chip, row),
+							  XPAD_NB_COLUMNS * sizeof(uint16_t)) == 0;
+		if (same)
+			continue;
+
+		unsigned int mod_mask = 1U << state.getModuleBit(mod_idx);
+		unsigned int values[XPAD_NB_COLUMNS];
+		for (unsigned int chip = 0; chip < m_chip_number; chip++)
+		{
+			for (int row = 0; row < XPAD_NB_ROWS; row++)
+			{
+				const uint16_t* dacl_row = state.getDaclRow(mod_idx, chip, row);
+				copy(dacl_row, dacl_row + XPAD_NB_COLUMNS, values);
+				if (xpci_modSaveConfigL(mod_mask, HOST_CALIB_ID, chip, row, values) != 0)
+					throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigL!");
+			}
+		}
+		m_dacl_cached = false;
+		if (xpci_modDetLoadConfig(mod_mask, HOST_CALIB_ID) != 0)
+			throw LIMA_HW_EXC(Error, "Error in xpci_modDetLoadConfig!");
+		slot.copyModule(state, mod_idx);
 	}
+	for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+		m_state.copyModule(state, mod_idx);
 }
 
 //-----------------------------------------------------
-//		calibrate over the noise Slow
+//		Upload only the DACL rows and config G registers of the calibration in
+//		path that differ from what the modules hold. false if path does not hold
+//		a readable text or binary calibration (the xpix library has to upload it)
 //-----------------------------------------------------
-void Camera::calibrateOTNSlow ( string path)
+bool Camera::_uploadCalibrationDiff(const string& path)
 {
-    DEB_MEMBER_FUNCT();
+	DEB_MEMBER_FUNCT();
 
-    m_calibration_path = path;
-    m_calibration_type = Camera::OTN_SLOW;
+	//- binary calibration: read in place from the mapped file
+	if (CalibrationMap::isCalibrationMap(path))
+	{
+		CalibrationMap calib(path);
+		if (calib.getModulesMask() != m_modules_mask || calib.getNbChips() != int(m_chip_number))
+			throw LIMA_HW_EXC(InvalidValue, "Binary calibration of another detector geometry");
+		_uploadCalibrationDiff(calib, path);
+		return true;
+	}
 
-    this->post(new yat::Message(XPAD_DLL_CALIBRATE), kPOST_MSG_TMO);
+	DetectorState calib;
+	calib.init(m_modules_mask, m_module_number, m_chip_number);
+	if (!CalibrationFile::readText(path, calib))
+		return false;
+	_uploadCalibrationDiff(calib, path);
+	return true;
 }
 
 //-----------------------------------------------------
-//		upload a calibration
+//		Differential upload of a calibration (DetectorState or CalibrationMap)
 //-----------------------------------------------------
-void Camera::uploadCalibration(string path)
+template <class Calib>
+void Camera::_uploadCalibrationDiff(const Calib& calib, const string& path)
 {
-    DEB_MEMBER_FUNCT();
+	DEB_MEMBER_FUNCT();
 
-    m_calibration_path = path;
-    m_calibration_type = Camera::UPLOAD;
+	Timestamp t0 = Timestamp::now();
+	UploadStats stats;
+	memset(&stats, 0, sizeof(stats));
 
-    this->post(new yat::Message(XPAD_DLL_CALIBRATE), kPOST_MSG_TMO);
-}
+	AutoMutex aLock(m_state_lock);
+	DetectorState& slot = _getConfigSlot(HOST_CALIB_ID);
+	unsigned int values[XPAD_NB_COLUMNS];
 
-//-----------------------------------------------------
-//		upload the wait times between images
-//-----------------------------------------------------
-void Camera::uploadExpWaitTimes(unsigned long *pWaitTime, unsigned size)
-{
-    DEB_MEMBER_FUNCT();
+	for (int mod_idx = 0; mod_idx < m_module_number; mod_idx++)
+	{
+		unsigned int mod_mask = 1U << calib.getModuleBit(mod_idx);
+		bool module_changed = false;
 
-    //- Check the number of values
-    if (size != m_nb_frames)
-    {
-        throw LIMA_HW_EXC(Error, "Error in uploadExpWaitTimes: number of values does not correspond to number of images");
-    }
+		//- DACL rows: the RAM slot is rewritten where it differs, the slot is loaded
+		//- if the programmed DACL differs
+		for (unsigned int chip = 0; chip < m_chip_number; chip++)
+		{
+			for (int row = 0; row < XPAD_NB_ROWS; row++)
+			{
+				const uint16_t* dacl_row = calib.getDaclRow(mod_idx, chip, row);
+				size_t row_size = XPAD_NB_COLUMNS * sizeof(uint16_t);
 
-    if(imxpad_uploadExpWaitTimes(m_modules_mask,(unsigned int*)pWaitTime,size) == 0)
-	{
-        DEB_TRACE() << "uploadExpWaitTimes -> imxpad_uploadExpWaitTimes -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in imxpad_uploadExpWaitTimes!");
-	}
-}
+				if (!m_state.isDaclRowValid(mod_idx, chip, row) ||
+					memcmp(m_state.getDaclRow(mod_idx, chip, row), dacl_row, row_size) != 0)
+					module_changed = true;
 
-//-----------------------------------------------------
-//		increment the ITHL
-//-----------------------------------------------------
-void Camera::incrementITHL()
-{
-    DEB_MEMBER_FUNCT();
+				if (slot.isDaclRowValid(mod_idx, chip, row) &&
+					memcmp(slot.getDaclRow(mod_idx, chip, row), dacl_row, row_size) == 0)
+				{
+					stats.nb_skipped_calls++;
+					stats.nb_skipped_bytes += sizeof(values);
+					continue;
+				}
 
-    if(imxpad_incrITHL(m_modules_mask) == 0)
-	{
-        DEB_TRACE() << "incrementITHL -> imxpad_incrITHL -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in imxpad_incrITHL!");
+				copy(dacl_row, dacl_row + XPAD_NB_COLUMNS, values);
+				if (xpci_modSaveConfigL(mod_mask, HOST_CALIB_ID, chip, row, values) != 0)
+					throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigL!");
+				copy(dacl_row, dacl_row + XPAD_NB_COLUMNS, slot.getDaclRow(mod_idx, chip, row));
+				slot.setDaclRowValid(mod_idx, chip, row, true);
+				stats.nb_driver_calls++;
+				stats.nb_bytes += sizeof(values);
+			}
+		}
+
+		//- config G registers (one value per chip)
+		for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+		{
+			bool slot_same = true;
+			for (unsigned int chip = 0; chip < m_chip_number; chip++)
+			{
+				values[chip] = calib.getConfigG(mod_idx, chip, index);
+				if (!m_state.isConfigGValid(mod_idx, chip, index) || m_state.getConfigG(mod_idx, chip, index) != values[chip])
+					module_changed = true;
+				slot_same = slot_same && slot.isConfigGValid(mod_idx, chip, index) &&
+							slot.getConfigG(mod_idx, chip, index) == values[chip];
+			}
+			if (slot_same)
+			{
+				stats.nb_skipped_calls++;
+				stats.nb_skipped_bytes += m_chip_number * sizeof(unsigned int);
+				continue;
+			}
+
+			if (xpci_modSaveConfigG(mod_mask, HOST_CALIB_ID, DetectorState::getConfigGReg(index), values) != 0)
+				throw LIMA_HW_EXC(Error, "Error in xpci_modSaveConfigG!");
+			for (unsigned int chip = 0; chip < m_chip_number; chip++)
+				slot.setConfigG(mod_idx, chip, index, values[chip]);
+			stats.nb_driver_calls++;
+			stats.nb_bytes += m_chip_number * sizeof(unsigned int);
+		}
+
+		if (!module_changed)
+		{
+			stats.nb_skipped_calls++;
+			continue;
+		}
+		m_dacl_cached = false;
+		if (xpci_modDetLoadConfig(mod_mask, HOST_CALIB_ID) != 0)
+			throw LIMA_HW_EXC(Error, "Error in xpci_modDetLoadConfig!");
+		stats.nb_driver_calls++;
+		m_state.copyModule(slot, mod_idx);
 	}
+
+	stats.duration = Timestamp::now() - t0;
+	m_upload_stats = stats;
+	aLock.unlock();
+	_saveSnapshot();
+
+	DEB_TRACE() << "Differential upload of " << path << " in " << stats.duration << " s: "
+				<< stats.nb_driver_calls << " calls (" << stats.nb_bytes << " bytes), "
+				<< stats.nb_skipped_calls << " calls skipped (" << stats.nb_skipped_bytes << " bytes)";
 }
 
 //-----------------------------------------------------
-//		decrement the ITHL
+//		Convert the text calibration in path into a binary calibration file
 //-----------------------------------------------------
-void Camera::decrementITHL()
+void Camera::convertCalibrationToBinary(string path, string file_name)
 {
-    DEB_MEMBER_FUNCT();
-
-    if(imxpad_decrITHL(m_modules_mask) == 0)
-	{
-        DEB_TRACE() << "decrementITHL -> imxpad_decrITHL -> OK" ;
-	}
-	else
-	{
-		throw LIMA_HW_EXC(Error, "Error in imxpad_decrITHL!");
-	}
+	DEB_MEMBER_FUNCT();
+	CalibrationFile::textToBinary(path, file_name, m_modules_mask, m_chip_number);
 }
 
 //-----------------------------------------------------
-//		Set the specific parameters
+//		Convert a binary calibration file into the text calibration in path
 //-----------------------------------------------------
-void Camera::setSpecificParameters( unsigned deadtime, unsigned init,
-								    unsigned shutter, unsigned ovf,
-								    unsigned n,       unsigned p,
-								    unsigned GP1,     unsigned GP2,    unsigned GP3,      unsigned GP4)
+void Camera::convertCalibrationToText(string file_name, string path)
 {
-
 	DEB_MEMBER_FUNCT();
-
-	DEB_TRACE() << "Setting Specific Parameters ..." ;
-    
-	m_time_between_images_usec  = deadtime; //- Temps entre chaque image
-    m_time_before_start_usec    = init;     //- Temps initial
-    m_shutter_time_usec         = shutter;
-	m_ovf_refresh_time_usec     = ovf;
-    m_specific_param_n          = n;
-    m_specific_param_p          = p;
-    m_specific_param_GP1		= GP1;
-	m_specific_param_GP2		= GP2;
-	m_specific_param_GP3		= GP3;
-	m_specific_param_GP4		= GP4;
+	CalibrationFile::binaryToText(file_name, path);
 }
@@ -0,0 +1,240 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadDeadTimeCorrection.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int NB_NEWTON_ITERATIONS = 12;
+
+//-----------------------------------------------------
+//		Corrected pixel: floats as is, integers rounded and saturated
+//-----------------------------------------------------
+static inline void storePixel(float& pixel, double true_count)
+{
+	pixel = float(true_count);
+}
+
+template <class D>
+static inline void storePixel(D& pixel, double true_count)
+{
+	const double max_value = double(D(~D(0)));
+	double value = true_count + 0.5;
+	pixel = (value < max_value) ? D(value) : D(~D(0));
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+DeadTimeCorrector::DeadTimeCorrector() :
+m_nb_modules(0),
+m_module_nb_pixels(0),
+m_depth(2),
+m_exp_time(0.),
+m_float_output(false)
+{
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void DeadTimeCorrector::init(int nb_modules, int module_nb_pixels, int depth, double exp_time,
+							 const vector<double>& tau, bool float_output)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(nb_modules, module_nb_pixels, depth, exp_time);
+
+	if (nb_modules < 1 || module_nb_pixels < 1 || (depth != 2 && depth != 4))
+		throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: invalid frame");
+	if (exp_time <= 0.)
+		throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: invalid exposure time");
+	if (int(tau.size()) != nb_modules)
+		throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: one dead time per module is needed");
+	for (int mod_idx = 0; mod_idx < nb_modules; mod_idx++)
+		if (tau[mod_idx] < 0.)
+			throw LIMA_HW_EXC(InvalidValue, "Dead-time correction: invalid dead time");
+
+	bool same_tables = (nb_modules == m_nb_modules && depth == m_depth && exp_time == m_exp_time &&
+						float_output == m_float_output && tau == m_tau);
+	m_module_nb_pixels = module_nb_pixels;
+	if (same_tables)
+		return;
+
+	m_nb_modules	= nb_modules;
+	m_depth			= depth;
+	m_exp_time		= exp_time;
+	m_float_output	= float_output;
+	m_tau			= tau;
+	m_rate_factor.resize(nb_modules);
+	for (int mod_idx = 0; mod_idx < nb_modules; mod_idx++)
+		m_rate_factor[mod_idx] = tau[mod_idx] / exp_time;
+
+	//- tables of the true counts, solved at once for all the tabulated counts
+	vector<double> counts(LUT_SIZE), true_counts(LUT_SIZE);
+	for (int count = 0; count < LUT_SIZE; count++)
+		counts[count] = count;
+
+	vector<float>().swap(m_float_lut);
+	vector<uint32_t>().swap(m_int_lut);
+	if (float_output)
+		m_float_lut.resize(size_t(nb_modules) * LUT_SIZE);
+	else
+		m_int_lut.resize(size_t(nb_modules) * LUT_SIZE);
+
+	for (int mod_idx = 0; mod_idx < nb_modules; mod_idx++)
+	{
+		solve(mod_idx, &counts[0], &true_counts[0], LUT_SIZE);
+		size_t first = size_t(mod_idx) * LUT_SIZE;
+		if (float_output)
+			for (int count = 0; count < LUT_SIZE; count++)
+				storePixel(m_float_lut[first + count], true_counts[count]);
+		else if (depth == 2)
+			for (int count = 0; count < LUT_SIZE; count++)
+			{
+				uint16_t pixel;
+				storePixel(pixel, true_counts[count]);
+				m_int_lut[first + count] = pixel;
+			}
+		else
+			for (int count = 0; count < LUT_SIZE; count++)
+				storePixel(m_int_lut[first + count], true_counts[count]);
+	}
+
+	//- all the 16 bits counts are tabulated
+	int nb_overflows = (depth == 4) ? module_nb_pixels : 0;
+	m_overflow_pos.resize(nb_overflows);
+	m_overflow_counts.resize(nb_overflows);
+	m_overflow_true_counts.resize(nb_overflows);
+}
+
+//-----------------------------------------------------
+//		Module by module, each one with its table
+//-----------------------------------------------------
+void DeadTimeCorrector::correct(const void* src, void* dst, int first_pixel, int nb_pixels)
+{
+	const char* src_ptr = static_cast<const char*>(src);
+	char* dst_ptr = static_cast<char*>(dst);
+	int dst_depth = m_float_output ? int(sizeof(float)) : m_depth;
+
+	while (nb_pixels > 0)
+	{
+		int mod_idx = min(first_pixel / m_module_nb_pixels, m_nb_modules - 1);
+		int nb = min(nb_pixels, (mod_idx + 1) * m_module_nb_pixels - first_pixel);
+		if (nb <= 0)
+			nb = nb_pixels;
+		size_t lut_pos = size_t(mod_idx) * LUT_SIZE;
+
+		if (m_depth == 2 && m_float_output)
+			_correct((const uint16_t*)src_ptr, (float*)dst_ptr, &m_float_lut[lut_pos], mod_idx, nb);
+		else if (m_depth == 2)
+			_correct((const uint16_t*)src_ptr, (uint16_t*)dst_ptr, &m_int_lut[lut_pos], mod_idx, nb);
+		else if (m_float_output)
+			_correct((const uint32_t*)src_ptr, (float*)dst_ptr, &m_float_lut[lut_pos], mod_idx, nb);
+		else
+			_correct((const uint32_t*)src_ptr, (uint32_t*)dst_ptr, &m_int_lut[lut_pos], mod_idx, nb);
+
+		src_ptr		+= size_t(nb) * m_depth;
+		dst_ptr		+= size_t(nb) * dst_depth;
+		first_pixel	+= nb;
+		nb_pixels	-= nb;
+	}
+}
+
+//-----------------------------------------------------
+//		Table look up, the positions of the counts beyond the table being appended
+//		without branch, then these counts solved at once
+//-----------------------------------------------------
+template <class S, class D, class L>
+void DeadTimeCorrector::_correct(const S* src, D* dst, const L* lut, int mod_idx, int nb_pixels)
+{
+	if (sizeof(S) == 2)
+	{
+		for (int i = 0; i < nb_pixels; i++)
+			dst[i] = D(lut[src[i]]);
+		return;
+	}
+
+	int* overflow_pos = &m_overflow_pos[0];
+	int nb_overflows = 0;
+	for (int i = 0; i < nb_pixels; i++)
+	{
+		uint32_t count = src[i];
+		bool tabulated = count < uint32_t(LUT_SIZE);
+		dst[i] = D(lut[tabulated ? count : 0]);
+		overflow_pos[nb_overflows] = i;
+		nb_overflows += !tabulated;
+	}
+	if (!nb_overflows)
+		return;
+
+	double* counts = &m_overflow_counts[0];
+	double* true_counts = &m_overflow_true_counts[0];
+	for (int i = 0; i < nb_overflows; i++)
+		counts[i] = src[overflow_pos[i]];
+	solve(mod_idx, counts, true_counts, nb_overflows);
+	for (int i = 0; i < nb_overflows; i++)
+		storePixel(dst[overflow_pos[i]], true_counts[i]);
+}
+
+//-----------------------------------------------------
+//		f(N) = N exp(-a N) - n (a = tau / t) is increasing and concave up to its
+//		maximum 1 / (e a) at N = 1 / a: Newton from below (the first fixed point step
+//		N = n exp(a n)) stays below the root. Each step runs over all the counts (no
+//		test of convergence) so that the loops vectorize.
+//-----------------------------------------------------
+void DeadTimeCorrector::solve(int mod_idx, const double* counts, double* true_counts, int nb) const
+{
+	double a = m_rate_factor[mod_idx];
+	if (a <= 0.)
+	{
+		for (int i = 0; i < nb; i++)
+			true_counts[i] = counts[i];
+		return;
+	}
+
+	double max_count = 1. / (M_E * a);
+	double peak = 1. / a;
+
+	for (int i = 0; i < nb; i++)
+	{
+		double count = min(counts[i], max_count);
+		true_counts[i] = count * exp(a * count);
+	}
+
+	for (int iter = 0; iter < NB_NEWTON_ITERATIONS; iter++)
+		for (int i = 0; i < nb; i++)
+		{
+			double count = min(counts[i], max_count);
+			double x = true_counts[i];
+			double e = exp(-a * x);
+			double slope = max(e * (1. - a * x), 1e-300);
+			true_counts[i] = x - (x * e - count) / slope;
+		}
+
+	for (int i = 0; i < nb; i++)
+		true_counts[i] = (counts[i] >= max_count) ? peak : min(true_counts[i], peak);
+}
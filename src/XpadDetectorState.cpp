@@ -0,0 +1,394 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadDetectorState.h"
+#include <fstream>
+#include <string.h>
+#include <stdio.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const char		SNAPSHOT_MAGIC[8]	= {'X','P','A','D','S','N','A','P'};
+static const uint32_t	SNAPSHOT_VERSION	= 1;
+
+//- xpix register of each config G index
+static const unsigned long CONFIG_G_REGS[DetectorState::NB_CONFIG_G] = {
+	1,	//- CMOS_TP
+	31,	//- AMP_TP
+	51,	//- ITHH
+	53,	//- VADJ
+	54,	//- VREF
+	59,	//- IMFP
+	60,	//- IOTA
+	61,	//- IPRE
+	62,	//- ITHL
+	63,	//- ITUNE
+	32	//- IBUFFER
+};
+
+//- Snapshot file header
+struct SnapshotHeader {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	modules_mask;
+	uint32_t	nb_modules;
+	uint32_t	nb_chips;
+	uint32_t	payload_size;
+	uint32_t	checksum;
+};
+
+template <class T>
+static void appendVector(vector<char>& payload, const vector<T>& v)
+{
+	const char* data = reinterpret_cast<const char*>(&v[0]);
+	payload.insert(payload.end(), data, data + v.size() * sizeof(T));
+}
+
+template <class T>
+static const char* readVector(const char* p, vector<T>& v)
+{
+	memcpy(&v[0], p, v.size() * sizeof(T));
+	return p + v.size() * sizeof(T);
+}
+
+//---------------------------
+//- Ctor
+//---------------------------
+DetectorState::DetectorState() :
+m_modules_mask(0x00),
+m_nb_modules(0),
+m_nb_chips(0)
+{
+	memset(&exposure, 0, sizeof(exposure));
+}
+
+//-----------------------------------------------------
+//		Allocate the state of nb_modules modules: everything is unknown
+//-----------------------------------------------------
+void DetectorState::init(unsigned int modules_mask, int nb_modules, int nb_chips)
+{
+	m_modules_mask	= modules_mask;
+	m_nb_modules	= nb_modules;
+	m_nb_chips		= nb_chips;
+
+	m_config_g.assign(nb_modules * nb_chips * NB_CONFIG_G, 0);
+	m_config_g_valid.assign(m_config_g.size(), 0);
+	m_dacl.assign((XPAD_NB_ROWS * nb_modules) * (XPAD_NB_COLUMNS * nb_chips), 0);
+	m_dacl_row_valid.assign(nb_modules * nb_chips * XPAD_NB_ROWS, 0);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int DetectorState::getModuleIndex(int module_bit) const
+{
+	if (module_bit < 0 || module_bit >= 32 || !(m_modules_mask & (1U << module_bit)))
+		return -1;
+
+	int mod_idx = 0;
+	for (int bit = 0; bit < module_bit; bit++)
+		if (m_modules_mask & (1U << bit))
+			mod_idx++;
+	return mod_idx;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int DetectorState::getModuleBit(int mod_idx) const
+{
+	for (int bit = 0; bit < 32; bit++)
+		if ((m_modules_mask & (1U << bit)) && mod_idx-- == 0)
+			return bit;
+	return -1;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int DetectorState::getConfigGIndex(unsigned long reg)
+{
+	for (int index = 0; index < NB_CONFIG_G; index++)
+		if (CONFIG_G_REGS[index] == reg)
+			return index;
+	return -1;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+unsigned long DetectorState::getConfigGReg(int index)
+{
+	return CONFIG_G_REGS[index];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int DetectorState::_configGPos(int mod_idx, int chip, int index) const
+{
+	return (mod_idx * m_nb_chips + chip) * NB_CONFIG_G + index;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void DetectorState::setConfigG(int mod_idx, int chip, int index, unsigned long value)
+{
+	int pos = _configGPos(mod_idx, chip, index);
+	m_config_g[pos]			= value;
+	m_config_g_valid[pos]	= 1;
+}
+
+//-----------------------------------------------------
+//		Step a register on every chip (eg: ITHL increment/decrement)
+//-----------------------------------------------------
+void DetectorState::stepConfigG(int index, int step)
+{
+	for (int mod_idx = 0; mod_idx < m_nb_modules; mod_idx++)
+		for (int chip = 0; chip < m_nb_chips; chip++)
+			m_config_g[_configGPos(mod_idx, chip, index)] += step;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void DetectorState::invalidateConfigG()
+{
+	m_config_g_valid.assign(m_config_g_valid.size(), 0);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool DetectorState::isConfigGValid(int mod_idx, int chip, int index) const
+{
+	return m_config_g_valid[_configGPos(mod_idx, chip, index)] != 0;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+uint32_t DetectorState::getConfigG(int mod_idx, int chip, int index) const
+{
+	return m_config_g[_configGPos(mod_idx, chip, index)];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int DetectorState::_rowPos(int mod_idx, int chip, int row) const
+{
+	return (mod_idx * m_nb_chips + chip) * XPAD_NB_ROWS + row;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+uint16_t* DetectorState::getDaclRow(int mod_idx, int chip, int row)
+{
+	int width = XPAD_NB_COLUMNS * m_nb_chips;
+	return &m_dacl[(mod_idx * XPAD_NB_ROWS + row) * width + chip * XPAD_NB_COLUMNS];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+const uint16_t* DetectorState::getDaclRow(int mod_idx, int chip, int row) const
+{
+	int width = XPAD_NB_COLUMNS * m_nb_chips;
+	return &m_dacl[(mod_idx * XPAD_NB_ROWS + row) * width + chip * XPAD_NB_COLUMNS];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void DetectorState::setDaclRowValid(int mod_idx, int chip, int row, bool valid)
+{
+	m_dacl_row_valid[_rowPos(mod_idx, chip, row)] = valid ? 1 : 0;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool DetectorState::isDaclRowValid(int mod_idx, int chip, int row) const
+{
+	return m_dacl_row_valid[_rowPos(mod_idx, chip, row)] != 0;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void DetectorState::setDaclValid(bool valid)
+{
+	m_dacl_row_valid.assign(m_dacl_row_valid.size(), valid ? 1 : 0);
+}
+
+//-----------------------------------------------------
+//		DACL of a module is known if all its rows are known
+//-----------------------------------------------------
+bool DetectorState::isDaclValid(int mod_idx) const
+{
+	for (int chip = 0; chip < m_nb_chips; chip++)
+		for (int row = 0; row < XPAD_NB_ROWS; row++)
+			if (!isDaclRowValid(mod_idx, chip, row))
+				return false;
+	return true;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void DetectorState::copyModule(const DetectorState& from, int mod_idx)
+{
+	for (int chip = 0; chip < m_nb_chips; chip++)
+	{
+		for (int index = 0; index < NB_CONFIG_G; index++)
+		{
+			int pos = _configGPos(mod_idx, chip, index);
+			if (from.m_config_g_valid[pos])
+			{
+				m_config_g[pos]			= from.m_config_g[pos];
+				m_config_g_valid[pos]	= 1;
+			}
+		}
+		for (int row = 0; row < XPAD_NB_ROWS; row++)
+		{
+			if (from.isDaclRowValid(mod_idx, chip, row))
+			{
+				memcpy(getDaclRow(mod_idx, chip, row), from.getDaclRow(mod_idx, chip, row), XPAD_NB_COLUMNS * sizeof(uint16_t));
+				setDaclRowValid(mod_idx, chip, row, true);
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------
+//		FNV-1a checksum (snapshot and calibration file payloads)
+//-----------------------------------------------------
+uint32_t DetectorState::checksum(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+//-----------------------------------------------------
+//		Write the snapshot (written in a temporary file then renamed)
+//-----------------------------------------------------
+void DetectorState::save(const string& path) const
+{
+	DEB_MEMBER_FUNCT();
+
+	vector<char> payload;
+	const char* exp = reinterpret_cast<const char*>(&exposure);
+	payload.insert(payload.end(), exp, exp + sizeof(exposure));
+	appendVector(payload, m_config_g);
+	appendVector(payload, m_config_g_valid);
+	appendVector(payload, m_dacl);
+	appendVector(payload, m_dacl_row_valid);
+
+	SnapshotHeader header;
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version		= SNAPSHOT_VERSION;
+	header.modules_mask	= m_modules_mask;
+	header.nb_modules	= m_nb_modules;
+	header.nb_chips		= m_nb_chips;
+	header.payload_size	= payload.size();
+	header.checksum		= checksum(&payload[0], payload.size());
+
+	string tmp_path = path + ".tmp";
+	ofstream file(tmp_path.c_str(), ios::out | ios::binary | ios::trunc);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(&payload[0], payload.size());
+	file.close();
+	if (!file || rename(tmp_path.c_str(), path.c_str()) != 0)
+		throw LIMA_HW_EXC(Error, "Can not write the detector state snapshot");
+
+	DEB_TRACE() << "Detector state snapshot written in " << path << " (" << payload.size() << " bytes)";
+}
+
+//-----------------------------------------------------
+//		Read a snapshot: false if missing, corrupted or of another geometry. The header
+//		is checked against the expected geometry before anything is allocated.
+//-----------------------------------------------------
+bool DetectorState::load(const string& path, unsigned int modules_mask, int nb_modules, int nb_chips)
+{
+	DEB_MEMBER_FUNCT();
+
+	ifstream file(path.c_str(), ios::in | ios::binary);
+	SnapshotHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION)
+	{
+		DEB_WARNING() << path << " is not a detector state snapshot (version " << SNAPSHOT_VERSION << ")";
+		return false;
+	}
+	if (header.modules_mask != modules_mask || int(header.nb_modules) != nb_modules ||
+		int(header.nb_chips) != nb_chips)
+	{
+		DEB_WARNING() << "Detector state snapshot " << path << " taken with modules mask "
+					  << std::hex << header.modules_mask << ": ignored";
+		return false;
+	}
+
+	size_t nb_config_g = size_t(nb_modules) * nb_chips * NB_CONFIG_G;
+	size_t nb_rows = size_t(nb_modules) * nb_chips * XPAD_NB_ROWS;
+	size_t expected_size = sizeof(exposure)
+							+ nb_config_g * (sizeof(uint32_t) + 1)
+							+ nb_rows * XPAD_NB_COLUMNS * sizeof(uint16_t)
+							+ nb_rows;
+	if (header.payload_size != expected_size)
+	{
+		DEB_WARNING() << "Detector state snapshot " << path << " is corrupted";
+		return false;
+	}
+
+	DetectorState state;
+	state.init(modules_mask, nb_modules, nb_chips);
+	vector<char> payload(header.payload_size);
+	if (!file.read(&payload[0], payload.size()) ||
+		checksum(&payload[0], payload.size()) != header.checksum)
+	{
+		DEB_WARNING() << "Detector state snapshot " << path << " is corrupted";
+		return false;
+	}
+
+	const char* p = &payload[0];
+	memcpy(&state.exposure, p, sizeof(exposure));
+	p += sizeof(exposure);
+	p = readVector(p, state.m_config_g);
+	p = readVector(p, state.m_config_g_valid);
+	p = readVector(p, state.m_dacl);
+	p = readVector(p, state.m_dacl_row_valid);
+
+	*this = state;
+	return true;
+}
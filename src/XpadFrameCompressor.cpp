@@ -0,0 +1,400 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadFrameCompressor.h"
+#include "Timestamp.h"
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <lz4.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const. (layout of the HDF5 bitshuffle filter with LZ4)
+static const int BLOCK_SIZE		= 8192;		//- bytes of a block (bitshuffle default)
+static const int BLOCK_MULT		= 8;		//- elements of a block are a multiple of 8
+static const int HEADER_SIZE	= 12;		//- uint64 raw size + uint32 block size, big endian
+
+static inline void writeUint32BE(char* p, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = char(value >> (24 - 8 * i));
+}
+
+static inline uint32_t readUint32BE(const char* p)
+{
+	const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+	return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+}
+
+//---------------------------
+//- Worker: compresses chunks of each new frame until the compressor stops it
+//---------------------------
+class FrameCompressor::Worker : public Thread
+{
+public:
+	Worker(FrameCompressor& compressor) : m_compressor(compressor) {}
+
+protected:
+	virtual void threadFunction()
+	{
+		AutoMutex aLock(m_compressor.m_cond.mutex());
+		unsigned long generation = m_compressor.m_generation;
+		while (true)
+		{
+			while (!m_compressor.m_quit && m_compressor.m_generation == generation)
+				m_compressor.m_cond.wait();
+			if (m_compressor.m_quit)
+				break;
+			generation = m_compressor.m_generation;
+
+			aLock.unlock();
+			m_compressor._compressChunks(m_scratch);
+			aLock.lock();
+		}
+	}
+
+private:
+	FrameCompressor&	m_compressor;
+	std::vector<char>	m_scratch;
+};
+
+//-----------------------------------------------------
+//		Transpose of the 8x8 bits matrix x (byte k = row k)
+//-----------------------------------------------------
+static inline uint64_t transposeBits(uint64_t x)
+{
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x = x ^ t ^ (t << 28);
+	return x;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+FrameCompressor::FrameCompressor() :
+m_nb_chunks(0),
+m_chunk_size(0),
+m_elem_size(1),
+m_chunk_capacity(0),
+m_quit(false),
+m_generation(0),
+m_image(NULL),
+m_next_chunk(0),
+m_nb_done(0)
+{
+	resetStats();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+FrameCompressor::~FrameCompressor()
+{
+	_stopWorkers();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameCompressor::_stopWorkers()
+{
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_quit = true;
+		m_cond.broadcast();
+	}
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i]->join();
+		delete m_workers[i];
+	}
+	m_workers.clear();
+	m_quit = false;
+}
+
+//-----------------------------------------------------
+//		The pool is only restarted if the geometry or the nb of threads changed
+//-----------------------------------------------------
+void FrameCompressor::init(int nb_chunks, int chunk_size, int elem_size, int nb_threads)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR4(nb_chunks, chunk_size, elem_size, nb_threads);
+
+	if (nb_chunks < 1 || chunk_size < 1 || elem_size < 1 || chunk_size % elem_size)
+		throw LIMA_HW_EXC(InvalidValue, "Frame compressor: invalid chunks");
+
+	if (nb_threads <= 0)
+		nb_threads = max(int(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+	nb_threads = min(nb_threads, nb_chunks);
+
+	resetStats();
+	if (nb_chunks == m_nb_chunks && chunk_size == m_chunk_size && elem_size == m_elem_size &&
+		nb_threads == int(m_workers.size()) + 1)
+		return;
+
+	_stopWorkers();
+	m_nb_chunks			= nb_chunks;
+	m_chunk_size		= chunk_size;
+	m_elem_size			= elem_size;
+	int block_size		= BLOCK_SIZE / elem_size / BLOCK_MULT * BLOCK_MULT * elem_size;
+	int nb_blocks		= (chunk_size + block_size - 1) / block_size;
+	m_chunk_capacity	= HEADER_SIZE + nb_blocks * (4 + LZ4_compressBound(block_size));
+	m_chunks.resize(size_t(nb_chunks) * m_chunk_capacity);
+	m_chunk_sizes.assign(nb_chunks, 0);
+
+	//- the calling thread is one of the nb_threads
+	for (int i = 1; i < nb_threads; i++)
+	{
+		Worker* worker = new Worker(*this);
+		worker->start();
+		m_workers.push_back(worker);
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameCompressor::compress(const void* image)
+{
+	DEB_MEMBER_FUNCT();
+
+	Timestamp t0 = Timestamp::now();
+
+	AutoMutex aLock(m_cond.mutex());
+	m_image		= static_cast<const char*>(image);
+	m_nb_done	= 0;
+	__sync_synchronize();
+	m_next_chunk = 0;
+	m_generation++;
+	m_cond.broadcast();
+	aLock.unlock();
+
+	_compressChunks(m_scratch);
+
+	aLock.lock();
+	while (m_nb_done < m_nb_chunks)
+		m_cond.wait();
+	aLock.unlock();
+
+	int compressed_size = 0;
+	for (int chunk = 0; chunk < m_nb_chunks; chunk++)
+	{
+		if (m_chunk_sizes[chunk] <= 0)
+			throw LIMA_HW_EXC(Error, "Frame compressor: LZ4 compression failed");
+		compressed_size += m_chunk_sizes[chunk];
+	}
+
+	m_stats.nb_frames++;
+	m_stats.raw_mbytes			+= double(m_nb_chunks) * m_chunk_size / 1048576.;
+	m_stats.compressed_mbytes	+= compressed_size / 1048576.;
+	m_stats.duration			+= Timestamp::now() - t0;
+}
+
+//-----------------------------------------------------
+//		Take the chunks of the current frame until none is left
+//-----------------------------------------------------
+void FrameCompressor::_compressChunks(vector<char>& scratch)
+{
+	int nb_done = 0;
+	int chunk;
+	while ((chunk = __sync_fetch_and_add(&m_next_chunk, 1)) < m_nb_chunks)
+	{
+		m_chunk_sizes[chunk] = _compressChunk(m_image + size_t(chunk) * m_chunk_size,
+											  &m_chunks[size_t(chunk) * m_chunk_capacity], scratch);
+		nb_done++;
+	}
+
+	if (nb_done)
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_nb_done += nb_done;
+		m_cond.broadcast();
+	}
+}
+
+//-----------------------------------------------------
+//		Chunk of the HDF5 bitshuffle/LZ4 filter: header, then for each block of 8 KiB
+//		its compressed size (uint32 big endian) and its bitshuffled LZ4 block; the last
+//		block is cut to a multiple of 8 pixels, the pixels left are copied as is.
+//		Size of the chunk, 0 on error.
+//-----------------------------------------------------
+int FrameCompressor::_compressChunk(const char* in, char* out, vector<char>& scratch)
+{
+	int block_size = BLOCK_SIZE / m_elem_size / BLOCK_MULT * BLOCK_MULT * m_elem_size;
+	int bound = LZ4_compressBound(block_size);
+	scratch.resize(block_size);
+
+	uint64_t raw_size = m_chunk_size;
+	writeUint32BE(out, uint32_t(raw_size >> 32));
+	writeUint32BE(out + 4, uint32_t(raw_size));
+	writeUint32BE(out + 8, block_size);
+	int size = HEADER_SIZE;
+
+	int pos = 0;
+	while (m_chunk_size - pos >= BLOCK_MULT * m_elem_size)
+	{
+		int block = min(block_size, (m_chunk_size - pos) / (BLOCK_MULT * m_elem_size) * BLOCK_MULT * m_elem_size);
+		_bitshuffle(in + pos, &scratch[0], block, m_elem_size);
+		int compressed = LZ4_compress_default(&scratch[0], out + size + 4, block, bound);
+		if (compressed <= 0)
+			return 0;
+		writeUint32BE(out + size, compressed);
+		size += 4 + compressed;
+		pos += block;
+	}
+	memcpy(out + size, in + pos, m_chunk_size - pos);
+	return size + m_chunk_size - pos;
+}
+
+//-----------------------------------------------------
+//		Bit planes of each group of 8 pixels, byte j of the 8 pixels being transposed at once
+//-----------------------------------------------------
+void FrameCompressor::_bitshuffle(const char* in, char* out, int size, int elem_size)
+{
+	const uint8_t* src = reinterpret_cast<const uint8_t*>(in);
+	uint8_t* dst = reinterpret_cast<uint8_t*>(out);
+	int nb_groups = size / elem_size / 8;
+
+	for (int group = 0; group < nb_groups; group++)
+	{
+		const uint8_t* pixels = src + size_t(group) * 8 * elem_size;
+		for (int j = 0; j < elem_size; j++)
+		{
+			uint64_t x = 0;
+			for (int k = 0; k < 8; k++)
+				x |= uint64_t(pixels[k * elem_size + j]) << (8 * k);
+			x = transposeBits(x);
+			for (int b = 0; b < 8; b++)
+				dst[size_t(j * 8 + b) * nb_groups + group] = uint8_t(x >> (8 * b));
+		}
+	}
+
+	size_t shuffled = size_t(nb_groups) * 8 * elem_size;
+	memcpy(dst + shuffled, src + shuffled, size - shuffled);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool FrameCompressor::decompress(const char* chunk, int size, void* out, int chunk_size, int elem_size)
+{
+	if (size < HEADER_SIZE || readUint32BE(chunk) != 0 || int(readUint32BE(chunk + 4)) != chunk_size)
+		return false;
+	int block_size = readUint32BE(chunk + 8);
+	if (block_size <= 0 || block_size % (BLOCK_MULT * elem_size))
+		return false;
+
+	vector<char> shuffled(block_size);
+	char* dst = static_cast<char*>(out);
+	int in_pos = HEADER_SIZE;
+	int pos = 0;
+	while (chunk_size - pos >= BLOCK_MULT * elem_size)
+	{
+		int block = min(block_size, (chunk_size - pos) / (BLOCK_MULT * elem_size) * BLOCK_MULT * elem_size);
+		if (size - in_pos < 4)
+			return false;
+		int compressed = readUint32BE(chunk + in_pos);
+		in_pos += 4;
+		if (compressed <= 0 || compressed > size - in_pos ||
+			LZ4_decompress_safe(chunk + in_pos, &shuffled[0], compressed, block) != block)
+			return false;
+		_bitunshuffle(&shuffled[0], dst + pos, block, elem_size);
+		in_pos += compressed;
+		pos += block;
+	}
+	if (size - in_pos != chunk_size - pos)
+		return false;
+	memcpy(dst + pos, chunk + in_pos, chunk_size - pos);
+	return true;
+}
+
+//-----------------------------------------------------
+//		Inverse of _bitshuffle (the transpose is its own inverse)
+//-----------------------------------------------------
+void FrameCompressor::_bitunshuffle(const char* in, char* out, int size, int elem_size)
+{
+	const uint8_t* src = reinterpret_cast<const uint8_t*>(in);
+	uint8_t* dst = reinterpret_cast<uint8_t*>(out);
+	int nb_groups = size / elem_size / 8;
+
+	for (int group = 0; group < nb_groups; group++)
+	{
+		uint8_t* pixels = dst + size_t(group) * 8 * elem_size;
+		for (int j = 0; j < elem_size; j++)
+		{
+			uint64_t x = 0;
+			for (int b = 0; b < 8; b++)
+				x |= uint64_t(src[size_t(j * 8 + b) * nb_groups + group]) << (8 * b);
+			x = transposeBits(x);
+			for (int k = 0; k < 8; k++)
+				pixels[k * elem_size + j] = uint8_t(x >> (8 * k));
+		}
+	}
+
+	size_t shuffled_size = size_t(nb_groups) * 8 * elem_size;
+	memcpy(dst + shuffled_size, src + shuffled_size, size - shuffled_size);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+const char* FrameCompressor::getChunk(int chunk, int& size) const
+{
+	if (chunk < 0 || chunk >= m_nb_chunks)
+		throw LIMA_HW_EXC(InvalidValue, "Frame compressor: invalid chunk");
+	size = m_chunk_sizes[chunk];
+	return &m_chunks[size_t(chunk) * m_chunk_capacity];
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int FrameCompressor::getCompressedSize() const
+{
+	int size = 0;
+	for (int chunk = 0; chunk < m_nb_chunks; chunk++)
+		size += m_chunk_sizes[chunk];
+	return size;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameCompressor::resetStats()
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameCompressor::getStats(Stats& stats) const
+{
+	stats = m_stats;
+}
@@ -0,0 +1,242 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadFrameRing.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const char		RING_MAGIC[8]	= {'X','P','A','D','R','I','N','G'};
+static const uint32_t	RING_VERSION	= 1;
+static const size_t		RING_ALIGN		= 64;
+
+static size_t alignSize(size_t size)
+{
+	return (size + RING_ALIGN - 1) / RING_ALIGN * RING_ALIGN;
+}
+
+static string shmName(const string& name)
+{
+	return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+//-----------------------------------------------------
+//		Create (or replace) the shared memory ring
+//-----------------------------------------------------
+FrameRing::FrameRing(const string& name, int nb_slots, int width, int height, int depth) :
+m_name(shmName(name)),
+m_size(0),
+m_header(NULL)
+{
+	DEB_CONSTRUCTOR();
+	DEB_PARAM() << DEB_VAR4(name, nb_slots, width, height);
+
+	if (nb_slots < 1)
+		throw LIMA_HW_EXC(InvalidValue, "Frame ring: invalid nb of slots");
+
+	size_t frame_size	= size_t(width) * height * depth;
+	size_t header_size	= alignSize(sizeof(FrameRingHeader));
+	size_t slot_size	= alignSize(sizeof(FrameRingSlot)) + alignSize(frame_size);
+	m_size = header_size + slot_size * nb_slots;
+
+	shm_unlink(m_name.c_str());
+	int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0)
+		throw LIMA_HW_EXC(Error, "Frame ring: can not create the shared memory");
+	void* base = MAP_FAILED;
+	if (ftruncate(fd, m_size) == 0)
+		base = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		shm_unlink(m_name.c_str());
+		throw LIMA_HW_EXC(Error, "Frame ring: can not map the shared memory");
+	}
+
+	m_header = static_cast<FrameRingHeader*>(base);
+	memset(m_header, 0, header_size);
+	m_header->version		= RING_VERSION;
+	m_header->header_size	= header_size;
+	m_header->nb_slots		= nb_slots;
+	m_header->slot_size		= slot_size;
+	m_header->frame_size	= frame_size;
+	m_header->width			= width;
+	m_header->height		= height;
+	m_header->depth			= depth;
+	//- readers check the magic last
+	__sync_synchronize();
+	memcpy(m_header->magic, RING_MAGIC, sizeof(m_header->magic));
+
+	DEB_TRACE() << "Frame ring " << m_name << ": " << nb_slots << " slots of " << slot_size << " bytes";
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+FrameRing::~FrameRing()
+{
+	munmap(m_header, m_size);
+	shm_unlink(m_name.c_str());
+}
+
+//-----------------------------------------------------
+//		Write frame n in slot n % nb_slots: the writer never waits for the readers
+//-----------------------------------------------------
+void FrameRing::write(int frame_nb, double timestamp, const void* image)
+{
+	uint64_t seq = m_header->write_seq;
+	FrameRingSlot* slot = reinterpret_cast<FrameRingSlot*>(reinterpret_cast<char*>(m_header)
+							+ m_header->header_size + (seq % m_header->nb_slots) * m_header->slot_size);
+
+	slot->seq = 2 * seq + 1;
+	__sync_synchronize();
+	slot->frame_nb	= frame_nb;
+	slot->timestamp	= timestamp;
+	memcpy(reinterpret_cast<char*>(slot) + alignSize(sizeof(FrameRingSlot)), image, m_header->frame_size);
+	__sync_synchronize();
+	slot->seq = 2 * seq + 2;
+	__sync_synchronize();
+	m_header->write_seq = seq + 1;
+
+	//- the acknowledging reader has not used the frame that was in the slot
+	uint64_t reader_seq = m_header->reader_seq;
+	if (reader_seq > 0 && seq >= reader_seq + m_header->nb_slots)
+		m_header->nb_overruns++;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameRing::getStats(uint64_t& nb_written, uint64_t& nb_overruns, uint64_t& lag) const
+{
+	nb_written	= m_header->write_seq;
+	nb_overruns	= m_header->nb_overruns;
+	uint64_t reader_seq = m_header->reader_seq;
+	lag			= (reader_seq > 0 && reader_seq < nb_written) ? nb_written - reader_seq : 0;
+}
+
+//-----------------------------------------------------
+//		Map an existing ring, the reader starts at the next written frame
+//-----------------------------------------------------
+FrameRingReader::FrameRingReader(const string& name, bool acknowledge) :
+m_size(0),
+m_header(NULL),
+m_acknowledge(acknowledge),
+m_seq(0),
+m_nb_overruns(0)
+{
+	DEB_CONSTRUCTOR();
+	DEB_PARAM() << DEB_VAR2(name, acknowledge);
+
+	int fd = shm_open(shmName(name).c_str(), acknowledge ? O_RDWR : O_RDONLY, 0);
+	struct stat shm_stat;
+	if (fd < 0 || fstat(fd, &shm_stat) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		throw LIMA_HW_EXC(Error, "Frame ring: can not open the shared memory");
+	}
+	m_size = shm_stat.st_size;
+	void* base = MAP_FAILED;
+	if (m_size >= sizeof(FrameRingHeader))
+		base = mmap(NULL, m_size, acknowledge ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		throw LIMA_HW_EXC(Error, "Frame ring: can not map the shared memory");
+
+	m_header = static_cast<FrameRingHeader*>(base);
+	__sync_synchronize();
+	if (memcmp(m_header->magic, RING_MAGIC, sizeof(RING_MAGIC)) != 0 || m_header->version != RING_VERSION ||
+		m_header->header_size + size_t(m_header->slot_size) * m_header->nb_slots > m_size)
+	{
+		munmap(base, m_size);
+		throw LIMA_HW_EXC(Error, "Frame ring: invalid shared memory");
+	}
+	m_seq = m_header->write_seq;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+FrameRingReader::~FrameRingReader()
+{
+	munmap(m_header, m_size);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+const FrameRingSlot* FrameRingReader::_getSlot(uint64_t seq) const
+{
+	return reinterpret_cast<const FrameRingSlot*>(reinterpret_cast<const char*>(m_header)
+			+ m_header->header_size + (seq % m_header->nb_slots) * m_header->slot_size);
+}
+
+//-----------------------------------------------------
+//		Frames overwritten before being read are counted as overruns and skipped
+//-----------------------------------------------------
+const void* FrameRingReader::getNextFrame(int& frame_nb, double& timestamp)
+{
+	uint64_t write_seq = m_header->write_seq;
+	__sync_synchronize();
+	if (write_seq <= m_seq)
+		return NULL;
+	if (write_seq - m_seq > m_header->nb_slots)
+	{
+		m_nb_overruns += write_seq - m_header->nb_slots - m_seq;
+		m_seq = write_seq - m_header->nb_slots;
+	}
+
+	const FrameRingSlot* slot = _getSlot(m_seq);
+	if (slot->seq != 2 * m_seq + 2)
+	{
+		//- being overwritten: the oldest frame is lost
+		m_nb_overruns++;
+		m_seq++;
+		return getNextFrame(frame_nb, timestamp);
+	}
+	__sync_synchronize();
+	frame_nb	= slot->frame_nb;
+	timestamp	= slot->timestamp;
+	return reinterpret_cast<const char*>(slot) + alignSize(sizeof(FrameRingSlot));
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool FrameRingReader::releaseFrame()
+{
+	__sync_synchronize();
+	bool valid = (_getSlot(m_seq)->seq == 2 * m_seq + 2);
+	if (!valid)
+		m_nb_overruns++;
+	m_seq++;
+	if (m_acknowledge)
+		m_header->reader_seq = m_seq;
+	return valid;
+}
@@ -0,0 +1,543 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadFrameStreamer.h"
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int ACCEPT_POLL_MSEC	= 200;		//- accept thread checks the quit flag at this period
+static const int POLICY_WAIT_MSEC	= 100;		//- time given to a new client to send its policy byte
+static const int SEND_TIMEOUT_MSEC	= 2000;		//- a client that reads nothing for this time is disconnected
+
+//- Image shared by the queues of the non blocking clients
+struct FrameStreamer::Frame {
+	FrameHeader	header;
+	char*		data;
+	int			ref_count;
+};
+
+/*******************************************************************
+* \class FrameStreamer::Client
+* \brief connected client: the non blocking ones are served by their thread
+*******************************************************************/
+class FrameStreamer::Client : public Thread
+{
+	DEB_CLASS_NAMESPC(DebModCamera, "FrameStreamer", "Client");
+
+public:
+	Client(FrameStreamer& streamer, int fd, Policy policy) :
+		fd(fd), policy(policy), dead(false), started(false), sending(false), m_streamer(streamer) {}
+
+	int						fd;
+	Policy					policy;
+	bool					dead;
+	bool					started;
+	bool					sending;		//- blocking client: data being sent by the publication path
+	std::deque<Frame*>		queue;
+
+protected:
+	virtual void threadFunction();
+
+private:
+	FrameStreamer& m_streamer;
+};
+
+/*******************************************************************
+* \class FrameStreamer::AcceptThread
+*******************************************************************/
+class FrameStreamer::AcceptThread : public Thread
+{
+	DEB_CLASS_NAMESPC(DebModCamera, "FrameStreamer", "AcceptThread");
+
+public:
+	AcceptThread(FrameStreamer& streamer) : m_streamer(streamer) {}
+
+protected:
+	virtual void threadFunction()	{m_streamer._accept();}
+
+private:
+	FrameStreamer& m_streamer;
+};
+
+//-----------------------------------------------------
+//		Listen on the local address
+//-----------------------------------------------------
+FrameStreamer::FrameStreamer(const string& address, Policy default_policy, int queue_depth) :
+m_address(address),
+m_default_policy(default_policy),
+m_queue_depth(queue_depth),
+m_listen_fd(-1),
+m_quit(false),
+m_accept_thread(NULL),
+m_nb_sent(0),
+m_nb_dropped(0)
+{
+	DEB_CONSTRUCTOR();
+	DEB_PARAM() << DEB_VAR3(address, default_policy, queue_depth);
+
+	if (queue_depth < 1)
+		throw LIMA_HW_EXC(InvalidValue, "Frame streamer: invalid queue depth");
+
+	int ret;
+	if (address.compare(0, 4, "tcp:") == 0)
+	{
+		int port = atoi(address.c_str() + 4);
+		if (port <= 0 || port > 65535)
+			throw LIMA_HW_EXC(InvalidValue, "Frame streamer: invalid tcp port");
+		m_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (m_listen_fd < 0)
+			throw LIMA_HW_EXC(Error, "Frame streamer: can not create the socket");
+		int on = 1;
+		setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family			= AF_INET;
+		addr.sin_port			= htons(port);
+		addr.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+		ret = bind(m_listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+	}
+	else
+	{
+		m_unix_path = (address.compare(0, 5, "unix:") == 0) ? address.substr(5) : address;
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		if (m_unix_path.empty() || m_unix_path.size() >= sizeof(addr.sun_path))
+			throw LIMA_HW_EXC(InvalidValue, "Frame streamer: invalid unix socket path");
+		m_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (m_listen_fd < 0)
+			throw LIMA_HW_EXC(Error, "Frame streamer: can not create the socket");
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, m_unix_path.c_str());
+		unlink(m_unix_path.c_str());
+		ret = bind(m_listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+	}
+	if (ret != 0 || listen(m_listen_fd, 8) != 0)
+	{
+		close(m_listen_fd);
+		throw LIMA_HW_EXC(Error, "Frame streamer: can not listen on the address");
+	}
+
+	m_accept_thread = new AcceptThread(*this);
+	m_accept_thread->start();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+FrameStreamer::~FrameStreamer()
+{
+	DEB_DESTRUCTOR();
+
+	//- the clients blocked in a send are disconnected so that their thread can be joined
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_quit = true;
+		for (list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+			shutdown((*it)->fd, SHUT_RDWR);
+		m_cond.broadcast();
+	}
+	m_accept_thread->join();
+	delete m_accept_thread;
+
+	for (list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		Client* client = *it;
+		if (client->started)
+			client->join();
+		close(client->fd);
+		for (size_t i = 0; i < client->queue.size(); i++)
+			_releaseFrame(client->queue[i]);
+		delete client;
+	}
+
+	close(m_listen_fd);
+	if (!m_unix_path.empty())
+		unlink(m_unix_path.c_str());
+}
+
+//-----------------------------------------------------
+//		Accept the clients until the streamer is deleted
+//-----------------------------------------------------
+void FrameStreamer::_accept()
+{
+	DEB_MEMBER_FUNCT();
+
+	while (true)
+	{
+		{
+			AutoMutex aLock(m_cond.mutex());
+			if (m_quit)
+				break;
+		}
+
+		struct pollfd listen_poll = {m_listen_fd, POLLIN, 0};
+		if (poll(&listen_poll, 1, ACCEPT_POLL_MSEC) <= 0)
+			continue;
+		int fd = accept(m_listen_fd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		//- optional policy byte
+		Policy policy = m_default_policy;
+		struct pollfd client_poll = {fd, POLLIN, 0};
+		char request;
+		if (poll(&client_poll, 1, POLICY_WAIT_MSEC) > 0 && recv(fd, &request, 1, 0) == 1)
+		{
+			if		(request == 'B')	policy = BLOCK;
+			else if	(request == 'D')	policy = DROP_OLDEST;
+			else if	(request == 'S')	policy = SKIP_TO_LATEST;
+		}
+		DEB_TRACE() << "New client with policy " << policy;
+
+		struct timeval send_timeout = {SEND_TIMEOUT_MSEC / 1000, (SEND_TIMEOUT_MSEC % 1000) * 1000};
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+		Client* client = new Client(*this, fd, policy);
+		AutoMutex aLock(m_cond.mutex());
+		if (m_quit)
+		{
+			close(fd);
+			delete client;
+			break;
+		}
+		if (policy != BLOCK)
+		{
+			client->start();
+			client->started = true;
+		}
+		m_clients.push_back(client);
+	}
+}
+
+//-----------------------------------------------------
+//		Send the frames of the queue until the client is gone
+//-----------------------------------------------------
+void FrameStreamer::Client::threadFunction()
+{
+	AutoMutex aLock(m_streamer.m_cond.mutex());
+	while (!m_streamer.m_quit && !dead)
+	{
+		if (queue.empty())
+		{
+			m_streamer.m_cond.wait();
+			continue;
+		}
+		Frame* frame = queue.front();
+		queue.pop_front();
+
+		aLock.unlock();
+		struct iovec data = {frame->data, frame->header.data_size};
+		bool sent = FrameStreamer::_send(fd, frame->header, &data, 1);
+		aLock.lock();
+
+		m_streamer._releaseFrame(frame);
+		if (sent)
+			m_streamer.m_nb_sent++;
+		else
+			dead = true;
+	}
+}
+
+//-----------------------------------------------------
+//		Header and data parts with one sendmsg (continued after a partial send),
+//		false if the client is gone or did not read for SEND_TIMEOUT_MSEC
+//-----------------------------------------------------
+bool FrameStreamer::_send(int fd, const FrameHeader& header, const struct iovec* parts, int nb_parts)
+{
+	struct iovec iov[MAX_PARTS + 1];
+	iov[0].iov_base	= const_cast<FrameHeader*>(&header);
+	iov[0].iov_len	= sizeof(header);
+	for (int i = 0; i < nb_parts; i++)
+		iov[i + 1] = parts[i];
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov		= iov;
+	msg.msg_iovlen	= nb_parts + 1;
+
+	while (msg.msg_iovlen > 0)
+	{
+		ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		while (msg.msg_iovlen > 0 && size_t(sent) >= msg.msg_iov->iov_len)
+		{
+			sent -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen > 0)
+		{
+			msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + sent;
+			msg.msg_iov->iov_len -= sent;
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------------------
+//		Called with the lock
+//-----------------------------------------------------
+void FrameStreamer::_releaseFrame(Frame* frame)
+{
+	if (--frame->ref_count == 0)
+	{
+		delete[] frame->data;
+		delete frame;
+	}
+}
+
+//-----------------------------------------------------
+//		Called by the publication path
+//-----------------------------------------------------
+void FrameStreamer::sendFrame(int frame_nb, double timestamp, const void* image,
+							  int width, int height, int depth)
+{
+	DEB_MEMBER_FUNCT();
+
+	FrameHeader header;
+	header.frame_nb		= frame_nb;
+	header.timestamp	= timestamp;
+	header.dtype		= (depth == 2) ? UINT16 : UINT32;
+	header.width		= width;
+	header.height		= height;
+
+	struct iovec data = {const_cast<void*>(image), size_t(width) * height * depth};
+	_sendFrame(header, &data, 1);
+}
+
+//-----------------------------------------------------
+//		Called by the publication path
+//-----------------------------------------------------
+void FrameStreamer::sendSparseFrame(int frame_nb, double timestamp, const uint32_t* indices,
+									const uint32_t* counts, int nb_hits, int width, int height)
+{
+	DEB_MEMBER_FUNCT();
+
+	FrameHeader header;
+	header.frame_nb		= frame_nb;
+	header.timestamp	= timestamp;
+	header.dtype		= SPARSE_UINT32;
+	header.width		= width;
+	header.height		= height;
+
+	struct iovec data[2];
+	data[0].iov_base	= const_cast<uint32_t*>(indices);
+	data[0].iov_len		= nb_hits * sizeof(uint32_t);
+	data[1].iov_base	= const_cast<uint32_t*>(counts);
+	data[1].iov_len		= nb_hits * sizeof(uint32_t);
+	_sendFrame(header, data, 2);
+}
+
+//-----------------------------------------------------
+//		Called by the publication path
+//-----------------------------------------------------
+void FrameStreamer::sendCompressedFrame(int frame_nb, double timestamp, const char* const* chunks,
+										const int* chunk_sizes, int nb_chunks, int width, int height, int depth)
+{
+	DEB_MEMBER_FUNCT();
+
+	if (nb_chunks < 1 || nb_chunks > MAX_CHUNKS)
+		throw LIMA_HW_EXC(InvalidValue, "Frame streamer: invalid nb of compressed chunks");
+
+	FrameHeader header;
+	header.frame_nb		= frame_nb;
+	header.timestamp	= timestamp;
+	header.dtype		= (depth == 2) ? BSLZ4_UINT16 : BSLZ4_UINT32;
+	header.width		= width;
+	header.height		= height;
+
+	uint32_t sizes[MAX_CHUNKS + 1];
+	struct iovec data[MAX_PARTS];
+	sizes[0] = nb_chunks;
+	for (int i = 0; i < nb_chunks; i++)
+	{
+		sizes[i + 1]			= chunk_sizes[i];
+		data[i + 1].iov_base	= const_cast<char*>(chunks[i]);
+		data[i + 1].iov_len		= chunk_sizes[i];
+	}
+	data[0].iov_base	= sizes;
+	data[0].iov_len		= (nb_chunks + 1) * sizeof(uint32_t);
+	_sendFrame(header, data, nb_chunks + 1);
+}
+
+//-----------------------------------------------------
+//		Called by the publication path
+//-----------------------------------------------------
+void FrameStreamer::sendProfile(int frame_nb, double timestamp, const float* profile, int nb_bins)
+{
+	DEB_MEMBER_FUNCT();
+
+	FrameHeader header;
+	header.frame_nb		= frame_nb;
+	header.timestamp	= timestamp;
+	header.dtype		= FLOAT32;
+	header.width		= nb_bins;
+	header.height		= 1;
+
+	struct iovec data = {const_cast<float*>(profile), nb_bins * sizeof(float)};
+	_sendFrame(header, &data, 1);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameStreamer::_sendFrame(FrameHeader& header, const struct iovec* parts, int nb_parts)
+{
+	header.magic		= FRAME_MAGIC;
+	header.header_size	= sizeof(header);
+	header.data_size	= 0;
+	for (int i = 0; i < nb_parts; i++)
+		header.data_size += parts[i].iov_len;
+
+	AutoMutex aLock(m_cond.mutex());
+
+	//- remove the clients that are gone
+	list<Client*> dead_clients;
+	for (list<Client*>::iterator it = m_clients.begin(); it != m_clients.end();)
+	{
+		if ((*it)->dead)
+		{
+			Client* client = *it;
+			for (size_t i = 0; i < client->queue.size(); i++)
+				_releaseFrame(client->queue[i]);
+			client->queue.clear();
+			dead_clients.push_back(client);
+			it = m_clients.erase(it);
+		}
+		else
+			++it;
+	}
+
+	//- queue the image for the non blocking clients
+	list<Client*> block_clients;
+	Frame* frame = NULL;
+	for (list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		Client* client = *it;
+		if (client->policy == BLOCK)
+		{
+			block_clients.push_back(client);
+			continue;
+		}
+		if (!frame)
+		{
+			frame = new Frame;
+			frame->header		= header;
+			frame->data			= new char[header.data_size];
+			frame->ref_count	= 0;
+			char* dst = frame->data;
+			for (int i = 0; i < nb_parts; i++)
+			{
+				memcpy(dst, parts[i].iov_base, parts[i].iov_len);
+				dst += parts[i].iov_len;
+			}
+		}
+		if (int(client->queue.size()) >= m_queue_depth)
+		{
+			size_t nb_dropped = (client->policy == DROP_OLDEST) ? 1 : client->queue.size();
+			for (size_t i = 0; i < nb_dropped; i++)
+			{
+				_releaseFrame(client->queue.front());
+				client->queue.pop_front();
+			}
+			m_nb_dropped += nb_dropped;
+		}
+		frame->ref_count++;
+		client->queue.push_back(frame);
+	}
+	if (frame)
+		m_cond.broadcast();
+
+	aLock.unlock();
+
+	for (list<Client*>::iterator it = dead_clients.begin(); it != dead_clients.end(); ++it)
+	{
+		if ((*it)->started)
+			(*it)->join();
+		close((*it)->fd);
+		delete *it;
+	}
+
+	//- blocking clients: straight from the data, the publication waits for them
+	for (list<Client*>::iterator it = block_clients.begin(); it != block_clients.end(); ++it)
+	{
+		{
+			AutoMutex sendLock(m_cond.mutex());
+			if ((*it)->dead)
+				continue;
+			(*it)->sending = true;
+		}
+		bool sent = _send((*it)->fd, header, parts, nb_parts);
+		AutoMutex sentLock(m_cond.mutex());
+		(*it)->sending = false;
+		if (sent)
+			m_nb_sent++;
+		else
+			(*it)->dead = true;
+	}
+}
+
+//-----------------------------------------------------
+//		Called on stop: the blocking clients being sent a frame are disconnected
+//-----------------------------------------------------
+void FrameStreamer::interruptBlockingSends()
+{
+	DEB_MEMBER_FUNCT();
+
+	AutoMutex aLock(m_cond.mutex());
+	for (list<Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		if ((*it)->policy == BLOCK && (*it)->sending)
+		{
+			DEB_TRACE() << "Blocking client disconnected by the stop";
+			shutdown((*it)->fd, SHUT_RDWR);
+			(*it)->dead = true;
+		}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void FrameStreamer::getStats(Stats& stats)
+{
+	AutoMutex aLock(m_cond.mutex());
+	stats.nb_clients	= m_clients.size();
+	stats.nb_sent		= m_nb_sent;
+	stats.nb_dropped	= m_nb_dropped;
+}
@@ -342,6 +342,22 @@ void SyncCtrlObj::getExpTime(double& exp_time)
 	m_cam.getExpTime(exp_time);
 }
 
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SyncCtrlObj::setLatTime(double lat_time)
+{
+	m_cam.setLatTime(lat_time);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SyncCtrlObj::getLatTime(double& lat_time)
+{
+	m_cam.getLatTime(lat_time);
+}
+
 //-----------------------------------------------------
 //
 //-----------------------------------------------------
@@ -363,12 +379,8 @@ void SyncCtrlObj::getNbHwFrames(int& nb_frames)
 //-----------------------------------------------------
 void SyncCtrlObj::getValidRanges(ValidRangesType& valid_ranges)
 {
-	double min_time = 10e-9;;
-	double max_time = 10e6;
-	valid_ranges.min_exp_time = min_time;
-	valid_ranges.max_exp_time = max_time;
-	valid_ranges.min_lat_time = min_time;
-	valid_ranges.max_lat_time = max_time;
+	m_cam.getValidRanges(valid_ranges.min_exp_time, valid_ranges.max_exp_time,
+						 valid_ranges.min_lat_time, valid_ranges.max_lat_time);
 }
 
 
@@ -480,10 +492,10 @@ void Interface::getStatus(StatusType& status)
 		  	status.det = DetFault;
 		  	status.acq = AcqFault;
 			break;
-        /*case Camera::Calibrating:
+        case Camera::Calibrating:
 		  	status.det = DetExposure;
 		  	status.acq = AcqConfig;
-			break;*/
+			break;
 	}
 	status.det_mask = DetExposure | DetReadout ;
 }
@@ -0,0 +1,111 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadPhaseBinning.h"
+#include <string.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+PhaseAccumulator::PhaseAccumulator() :
+m_nb_pixels(0),
+m_nb_phases(0)
+{
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void PhaseAccumulator::init(int nb_pixels, int nb_phases)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR2(nb_pixels, nb_phases);
+
+	if (nb_pixels < 1 || nb_phases < 1)
+		throw LIMA_HW_EXC(InvalidValue, "Phase accumulator: invalid nb of pixels or phases");
+
+	m_nb_pixels = nb_pixels;
+	m_nb_phases = nb_phases;
+	m_sums.assign(size_t(nb_phases) * nb_pixels, 0);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void PhaseAccumulator::reset()
+{
+	m_sums.assign(m_sums.size(), 0);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void PhaseAccumulator::addFrame(int phase, const void* frame, bool is_32_bits)
+{
+	DEB_MEMBER_FUNCT();
+
+	if (phase < 0 || phase >= m_nb_phases)
+		throw LIMA_HW_EXC(InvalidValue, "Invalid phase");
+
+	uint32_t* sums = &m_sums[size_t(phase) * m_nb_pixels];
+	if (is_32_bits)
+		_add(sums, static_cast<const uint32_t*>(frame));
+	else
+		_add(sums, static_cast<const uint16_t*>(frame));
+}
+
+//-----------------------------------------------------
+//		Widening add, saturated at the 32 bits max
+//-----------------------------------------------------
+template <class T>
+void PhaseAccumulator::_add(uint32_t* sums, const T* pixels)
+{
+	for (int pix = 0; pix < m_nb_pixels; pix++)
+	{
+		uint64_t sum = uint64_t(sums[pix]) + pixels[pix];
+		sums[pix] = (sum > 0xFFFFFFFFULL) ? 0xFFFFFFFFU : uint32_t(sum);
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void PhaseAccumulator::getFrame(int phase, void* frame, bool is_32_bits) const
+{
+	DEB_MEMBER_FUNCT();
+
+	if (phase < 0 || phase >= m_nb_phases)
+		throw LIMA_HW_EXC(InvalidValue, "Invalid phase");
+
+	const uint32_t* sums = getSums(phase);
+	if (is_32_bits)
+		memcpy(frame, sums, size_t(m_nb_pixels) * sizeof(uint32_t));
+	else
+	{
+		uint16_t* pixels = static_cast<uint16_t*>(frame);
+		for (int pix = 0; pix < m_nb_pixels; pix++)
+			pixels[pix] = uint16_t((sums[pix] > 0xFFFF) ? 0xFFFF : sums[pix]);
+	}
+}
@@ -0,0 +1,70 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadRawFrame.h"
+#include "XpadDetectorState.h"
+#include <string.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+int lima::Xpad::getRawLineWords(int nb_chips)
+{
+	return RAW_LINE_HEADER + XPAD_NB_COLUMNS * nb_chips + RAW_LINE_FOOTER;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+size_t lima::Xpad::getRawFrameSize(int nb_modules, int nb_chips)
+{
+	return size_t(XPAD_NB_ROWS) * nb_modules * getRawLineWords(nb_chips) * sizeof(uint16_t);
+}
+
+//-----------------------------------------------------
+//		Placed by the line headers, not by the position in the raw frame
+//-----------------------------------------------------
+int lima::Xpad::reassembleRawFrame(const uint16_t* raw, uint16_t* image, int nb_modules, int nb_chips)
+{
+	int line_words = getRawLineWords(nb_chips);
+	int line_pixels = XPAD_NB_COLUMNS * nb_chips;
+	int nb_lines = XPAD_NB_ROWS * nb_modules;
+
+	memset(image, 0, size_t(nb_lines) * line_pixels * sizeof(uint16_t));
+
+	int nb_placed = 0;
+	for (int line = 0; line < nb_lines; line++)
+	{
+		const uint16_t* words = raw + size_t(line) * line_words;
+		int module = words[RAW_MODULE_WORD];
+		int row = words[RAW_ROW_WORD];
+		if (module >= nb_modules || row < 1 || row > XPAD_NB_ROWS)
+			continue;
+
+		memcpy(image + (size_t(module) * XPAD_NB_ROWS + row - 1) * line_pixels,
+			   words + RAW_LINE_HEADER, line_pixels * sizeof(uint16_t));
+		nb_placed++;
+	}
+	return nb_placed;
+}
@@ -0,0 +1,258 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadSCurve.h"
+#include "ThreadUtils.h"
+#include "Timestamp.h"
+#include <unistd.h>
+#include <algorithm>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int MIN_PIXELS_PER_THREAD = 4096;	//- also the size of the blocks taken by the threads
+
+//---------------------------
+//- Worker: runs blocks of each new job of the analyzer until the analyzer stops it
+//---------------------------
+class SCurveAnalyzer::Worker : public Thread
+{
+public:
+	Worker(SCurveAnalyzer& analyzer) : m_analyzer(analyzer) {}
+
+protected:
+	virtual void threadFunction()
+	{
+		AutoMutex aLock(m_analyzer.m_cond.mutex());
+		unsigned long generation = m_analyzer.m_generation;
+		while (true)
+		{
+			while (!m_analyzer.m_quit && m_analyzer.m_generation == generation)
+				m_analyzer.m_cond.wait();
+			if (m_analyzer.m_quit)
+				break;
+			generation = m_analyzer.m_generation;
+
+			aLock.unlock();
+			m_analyzer._runBlocks();
+			aLock.lock();
+		}
+	}
+
+private:
+	SCurveAnalyzer&		m_analyzer;
+};
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+SCurveAnalyzer::SCurveAnalyzer() :
+m_nb_pixels(0),
+m_nb_steps(0),
+m_nb_threads(1),
+m_analysis_duration(0.),
+m_quit(false),
+m_generation(0),
+m_job(ADD_FRAME_16),
+m_nb_blocks(0),
+m_next_block(0),
+m_nb_done(0),
+m_step(0),
+m_frame(NULL),
+m_noise_counts(0),
+m_edges(NULL)
+{
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+SCurveAnalyzer::~SCurveAnalyzer()
+{
+	_stopWorkers();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SCurveAnalyzer::_stopWorkers()
+{
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_quit = true;
+		m_cond.broadcast();
+	}
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i]->join();
+		delete m_workers[i];
+	}
+	m_workers.clear();
+	m_quit = false;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SCurveAnalyzer::init(int nb_pixels, int nb_steps, int nb_threads)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(nb_pixels, nb_steps, nb_threads);
+
+	if (nb_threads <= 0)
+		nb_threads = max(int(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+	nb_threads = max(min(nb_threads, nb_pixels / MIN_PIXELS_PER_THREAD), 1);
+
+	m_nb_pixels			= nb_pixels;
+	m_nb_steps			= nb_steps;
+	m_analysis_duration	= 0.;
+	m_counts.assign(size_t(nb_pixels) * nb_steps, 0);
+	if (nb_threads == m_nb_threads && nb_threads == int(m_workers.size()) + 1)
+		return;
+
+	_stopWorkers();
+	m_nb_threads = nb_threads;
+
+	//- the calling thread is one of the nb_threads
+	for (int i = 1; i < nb_threads; i++)
+	{
+		Worker* worker = new Worker(*this);
+		worker->start();
+		m_workers.push_back(worker);
+	}
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SCurveAnalyzer::addFrame(int step, const void* frame, bool is_32_bits)
+{
+	DEB_MEMBER_FUNCT();
+
+	if (step < 0 || step >= m_nb_steps)
+		throw LIMA_HW_EXC(InvalidValue, "Invalid scan step");
+
+	m_step	= step;
+	m_frame	= frame;
+	_run(is_32_bits ? ADD_FRAME_32 : ADD_FRAME_16);
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SCurveAnalyzer::findEdges(uint32_t noise_counts, vector<int32_t>& edges)
+{
+	DEB_MEMBER_FUNCT();
+
+	edges.assign(m_nb_pixels, -1);
+	m_noise_counts	= noise_counts;
+	m_edges			= &edges[0];
+	_run(FIND_EDGES);
+}
+
+//-----------------------------------------------------
+//		Wake up the pool on the job, the calling thread takes blocks too
+//-----------------------------------------------------
+void SCurveAnalyzer::_run(Job job)
+{
+	Timestamp t0 = Timestamp::now();
+
+	AutoMutex aLock(m_cond.mutex());
+	m_job		= job;
+	m_nb_blocks	= (m_nb_pixels + MIN_PIXELS_PER_THREAD - 1) / MIN_PIXELS_PER_THREAD;
+	m_nb_done	= 0;
+	__sync_synchronize();
+	m_next_block = 0;
+	m_generation++;
+	m_cond.broadcast();
+	aLock.unlock();
+
+	_runBlocks();
+
+	aLock.lock();
+	while (m_nb_done < m_nb_blocks)
+		m_cond.wait();
+	aLock.unlock();
+
+	m_analysis_duration += Timestamp::now() - t0;
+}
+
+//-----------------------------------------------------
+//		Take the blocks of the current job until none is left
+//-----------------------------------------------------
+void SCurveAnalyzer::_runBlocks()
+{
+	int nb_done = 0;
+	int block;
+	while ((block = __sync_fetch_and_add(&m_next_block, 1)) < m_nb_blocks)
+	{
+		int begin = block * MIN_PIXELS_PER_THREAD;
+		_runBlock(m_job, begin, min(begin + MIN_PIXELS_PER_THREAD, m_nb_pixels));
+		nb_done++;
+	}
+
+	if (nb_done)
+	{
+		AutoMutex aLock(m_cond.mutex());
+		m_nb_done += nb_done;
+		m_cond.broadcast();
+	}
+}
+
+//-----------------------------------------------------
+//		Loops are kept branch free on contiguous pixels so that they are vectorized
+//-----------------------------------------------------
+void SCurveAnalyzer::_runBlock(Job job, int begin, int end)
+{
+	uint32_t* counts = &m_counts[size_t(m_step) * m_nb_pixels];
+
+	switch (job)
+	{
+	case ADD_FRAME_16:
+	{
+		const uint16_t* frame = (const uint16_t*)m_frame;
+		for (int pix = begin; pix < end; pix++)
+			counts[pix] += frame[pix];
+		break;
+	}
+	case ADD_FRAME_32:
+	{
+		const uint32_t* frame = (const uint32_t*)m_frame;
+		for (int pix = begin; pix < end; pix++)
+			counts[pix] += frame[pix];
+		break;
+	}
+	case FIND_EDGES:
+	{
+		int32_t* edges = m_edges;
+		uint32_t noise_counts = m_noise_counts;
+		for (int step = 0; step < m_nb_steps; step++)
+		{
+			const uint32_t* step_counts = &m_counts[size_t(step) * m_nb_pixels];
+			for (int pix = begin; pix < end; pix++)
+				edges[pix] = (edges[pix] < 0 && step_counts[pix] >= noise_counts) ? step : edges[pix];
+		}
+		break;
+	}
+	}
+}
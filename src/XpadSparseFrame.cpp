@@ -0,0 +1,164 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadSparseFrame.h"
+#include <string.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int SCAN_BLOCK = 16;		//- pixels tested at once for a hit
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+SparseEncoder::SparseEncoder() :
+m_nb_pixels(0),
+m_depth(2),
+m_max_hits(0),
+m_nb_hits(0)
+{
+	resetStats();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SparseEncoder::init(int nb_pixels, int depth, double max_occupancy)
+{
+	DEB_MEMBER_FUNCT();
+	DEB_PARAM() << DEB_VAR3(nb_pixels, depth, max_occupancy);
+
+	if (nb_pixels < 1 || (depth != 2 && depth != 4))
+		throw LIMA_HW_EXC(InvalidValue, "Sparse encoder: invalid frame");
+	if (max_occupancy < 0. || max_occupancy > 1.)
+		throw LIMA_HW_EXC(InvalidValue, "Sparse encoder: invalid occupancy threshold");
+
+	m_nb_pixels	= nb_pixels;
+	m_depth		= depth;
+	m_max_hits	= int(max_occupancy * nb_pixels);
+	m_nb_hits	= 0;
+	//- a block is written without test: room for one more block
+	m_indices.resize(m_max_hits + SCAN_BLOCK);
+	m_counts.resize(m_max_hits + SCAN_BLOCK);
+	resetStats();
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+bool SparseEncoder::encode(const void* image)
+{
+	bool sparse = (m_depth == 2) ? _encode(static_cast<const uint16_t*>(image))
+								 : _encode(static_cast<const uint32_t*>(image));
+	m_stats.nb_frames++;
+	if (sparse)
+	{
+		m_stats.nb_sparse++;
+		m_stats.hit_bytes	+= 2. * m_nb_hits * sizeof(uint32_t);
+		m_stats.dense_bytes	+= double(m_nb_pixels) * m_depth;
+	}
+	return sparse;
+}
+
+//-----------------------------------------------------
+//		Blocks without hit are skipped with one vectorized OR, the pixels of the
+//		others are appended without branch (the index only moves on a hit)
+//-----------------------------------------------------
+template <class T>
+bool SparseEncoder::_encode(const T* image)
+{
+	uint32_t* indices = &m_indices[0];
+	uint32_t* counts = &m_counts[0];
+	int nb_hits = 0;
+	int nb_blocks = m_nb_pixels / SCAN_BLOCK;
+
+	for (int block = 0; block < nb_blocks; block++)
+	{
+		const T* pixels = image + block * SCAN_BLOCK;
+		T any = 0;
+		for (int i = 0; i < SCAN_BLOCK; i++)
+			any |= pixels[i];
+		if (!any)
+			continue;
+
+		uint32_t first = block * SCAN_BLOCK;
+		for (int i = 0; i < SCAN_BLOCK; i++)
+		{
+			indices[nb_hits]	= first + i;
+			counts[nb_hits]		= pixels[i];
+			nb_hits				+= (pixels[i] != 0);
+		}
+		if (nb_hits > m_max_hits)
+		{
+			m_nb_hits = 0;
+			return false;
+		}
+	}
+
+	for (int pix = nb_blocks * SCAN_BLOCK; pix < m_nb_pixels; pix++)
+	{
+		indices[nb_hits]	= pix;
+		counts[nb_hits]		= image[pix];
+		nb_hits				+= (image[pix] != 0);
+	}
+	if (nb_hits > m_max_hits)
+	{
+		m_nb_hits = 0;
+		return false;
+	}
+
+	m_nb_hits = nb_hits;
+	return true;
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+void SparseEncoder::resetStats()
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+//-----------------------------------------------------
+//		Pairs out of the frame are ignored
+//-----------------------------------------------------
+void SparseEncoder::decode(const uint32_t* indices, const uint32_t* counts, int nb_hits,
+						   void* image, int nb_pixels, int depth)
+{
+	memset(image, 0, size_t(nb_pixels) * depth);
+	if (depth == 2)
+	{
+		uint16_t* pixels = static_cast<uint16_t*>(image);
+		for (int i = 0; i < nb_hits; i++)
+			if (indices[i] < uint32_t(nb_pixels))
+				pixels[indices[i]] = counts[i];
+	}
+	else
+	{
+		uint32_t* pixels = static_cast<uint32_t*>(image);
+		for (int i = 0; i < nb_hits; i++)
+			if (indices[i] < uint32_t(nb_pixels))
+				pixels[indices[i]] = counts[i];
+	}
+}
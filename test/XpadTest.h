@@ -0,0 +1,78 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#ifndef XPADTEST_H
+#define XPADTEST_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <iostream>
+
+#include "Exceptions.h"
+
+//- Checks of the unit tests: a failed check is reported and the test goes on,
+//- the test program exits with the nb of failed checks
+static int xpad_test_nb_failures = 0;
+
+#define XPAD_CHECK(cond)																\
+	do {																				\
+		if (!(cond)) {																	\
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl;	\
+			xpad_test_nb_failures++;													\
+		}																				\
+	} while (0)
+
+#define XPAD_CHECK_THROW(expr)															\
+	do {																				\
+		bool thrown = false;															\
+		try { expr; } catch (lima::Exception&) { thrown = true; }						\
+		if (!thrown) {																	\
+			std::cerr << __FILE__ << ":" << __LINE__ << ": no exception: " #expr << std::endl;	\
+			xpad_test_nb_failures++;													\
+		}																				\
+	} while (0)
+
+#define XPAD_TEST_RESULT(name)															\
+	(std::cout << name << ": " << (xpad_test_nb_failures ? "FAILED" : "OK") << std::endl,	\
+	 xpad_test_nb_failures)
+
+//- Temporary directory of a test, removed with its files by the destructor
+class XpadTestDir
+{
+public:
+	XpadTestDir()
+	{
+		char name[] = "/tmp/xpad_test_XXXXXX";
+		m_path = mkdtemp(name) ? name : "";
+	}
+	~XpadTestDir()
+	{
+		if (!m_path.empty())
+			system(("rm -rf " + m_path).c_str());
+	}
+	const std::string& path() const		{return m_path;}
+
+private:
+	std::string m_path;
+};
+
+#endif // XPADTEST_H
@@ -0,0 +1,156 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadCalibrationFile.h"
+#include "XpadTest.h"
+
+#include <fstream>
+#include <string.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Two modules (bits 0 and 2) of 7 chips, every value distinct
+static void fillCalibration(DetectorState& calib)
+{
+	calib.init(0x5, 2, 7);
+	for (int mod_idx = 0; mod_idx < calib.getNbModules(); mod_idx++)
+		for (int chip = 0; chip < calib.getNbChips(); chip++)
+		{
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+				calib.setConfigG(mod_idx, chip, index, (mod_idx * 7 + chip) * 11 + index);
+			for (int row = 0; row < XPAD_NB_ROWS; row++)
+			{
+				uint16_t* dacl_row = calib.getDaclRow(mod_idx, chip, row);
+				for (int col = 0; col < XPAD_NB_COLUMNS; col++)
+					dacl_row[col] = (mod_idx * 1000 + chip * 100 + row + col) % 512;
+			}
+		}
+	calib.setDaclValid(true);
+}
+
+static bool sameCalibration(const DetectorState& a, const DetectorState& b)
+{
+	if (a.getDaclSize() != b.getDaclSize() ||
+		memcmp(a.getDacl(), b.getDacl(), a.getDaclSize() * sizeof(uint16_t)) != 0)
+		return false;
+	for (int mod_idx = 0; mod_idx < a.getNbModules(); mod_idx++)
+		for (int chip = 0; chip < a.getNbChips(); chip++)
+			for (int index = 0; index < DetectorState::NB_CONFIG_G; index++)
+				if (a.getConfigG(mod_idx, chip, index) != b.getConfigG(mod_idx, chip, index))
+					return false;
+	return true;
+}
+
+//-----------------------------------------------------
+//		Text layout: round trip, index and geometry checks
+//-----------------------------------------------------
+static void testText()
+{
+	XpadTestDir dir;
+	DetectorState calib;
+	fillCalibration(calib);
+	CalibrationFile::writeText(dir.path(), calib);
+
+	//- module files named after the module bit + 1
+	XPAD_CHECK(ifstream((dir.path() + "/dacl_mod3.txt").c_str()).good());
+	XPAD_CHECK(ifstream((dir.path() + "/configg_mod1.txt").c_str()).good());
+
+	DetectorState read;
+	read.init(0x5, 2, 7);
+	XPAD_CHECK(CalibrationFile::readText(dir.path(), read));
+	XPAD_CHECK(sameCalibration(calib, read));
+	XPAD_CHECK(read.isDaclValid(0) && read.isDaclValid(1));
+
+	//- another geometry
+	DetectorState other;
+	other.init(0x3, 2, 7);
+	XPAD_CHECK(!CalibrationFile::readText(dir.path(), other));
+
+	//- a directory without the index (e.g. an xpix calibration) is not read
+	XpadTestDir empty_dir;
+	XPAD_CHECK(!CalibrationFile::readText(empty_dir.path(), read));
+	unlink((dir.path() + "/xpad_calibration.txt").c_str());
+	XPAD_CHECK(!CalibrationFile::readText(dir.path(), read));
+
+	//- truncated DACL file
+	CalibrationFile::writeText(dir.path(), calib);
+	ofstream((dir.path() + "/dacl_mod1.txt").c_str()) << "1 2 3\n";
+	XPAD_CHECK(!CalibrationFile::readText(dir.path(), read));
+}
+
+//-----------------------------------------------------
+//		Binary layout: mapped in place, converters, checksum
+//-----------------------------------------------------
+static void testBinary()
+{
+	XpadTestDir dir;
+	string file_name = dir.path() + "/calib.bin";
+	DetectorState calib;
+	fillCalibration(calib);
+	CalibrationFile::writeBinary(file_name, calib, "test calibration");
+	XPAD_CHECK(CalibrationMap::isCalibrationMap(file_name));
+	XPAD_CHECK(!CalibrationMap::isCalibrationMap(dir.path()));
+
+	{
+		CalibrationMap map(file_name);
+		XPAD_CHECK(map.getModulesMask() == 0x5);
+		XPAD_CHECK(map.getNbModules() == 2 && map.getNbChips() == 7);
+		XPAD_CHECK(map.getModuleBit(1) == 2);
+		XPAD_CHECK(map.getDescription() == "test calibration");
+		XPAD_CHECK(map.getConfigG(1, 6, 10) == calib.getConfigG(1, 6, 10));
+		XPAD_CHECK(memcmp(map.getDaclRow(1, 3, 119), calib.getDaclRow(1, 3, 119),
+						  XPAD_NB_COLUMNS * sizeof(uint16_t)) == 0);
+
+		DetectorState copy;
+		copy.init(0x5, 2, 7);
+		map.copyTo(copy);
+		XPAD_CHECK(sameCalibration(calib, copy));
+	}
+
+	//- binary -> text -> binary
+	XpadTestDir text_dir;
+	CalibrationFile::binaryToText(file_name, text_dir.path());
+	string file_name2 = dir.path() + "/calib2.bin";
+	CalibrationFile::textToBinary(text_dir.path(), file_name2, 0x5, 7);
+	{
+		DetectorState copy;
+		copy.init(0x5, 2, 7);
+		CalibrationMap(file_name2).copyTo(copy);
+		XPAD_CHECK(sameCalibration(calib, copy));
+	}
+
+	//- a corrupted DACL fails the checksum
+	{
+		fstream file(file_name.c_str(), ios::in | ios::out | ios::binary);
+		file.seekp(-2, ios::end);
+		file.put(char(0x55));
+	}
+	XPAD_CHECK_THROW(CalibrationMap map(file_name));
+}
+
+int main()
+{
+	testText();
+	testBinary();
+	return XPAD_TEST_RESULT("test_calibration_file");
+}
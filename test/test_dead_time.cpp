@@ -0,0 +1,132 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadDeadTimeCorrection.h"
+#include "XpadTest.h"
+
+#include <math.h>
+#include <vector>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const. (a = tau / t = 1e-4: the measured counts peak at 1 / (e a) ~ 3679)
+static const double EXP_TIME = 1e-3;
+static const double TAU = 100e-9;
+static const double RATE_FACTOR = TAU / EXP_TIME;
+
+static void initCorrector(DeadTimeCorrector& corrector, int depth, bool float_output)
+{
+	vector<double> tau(2);
+	tau[0] = TAU;
+	tau[1] = 0.;		//- second module not corrected
+	corrector.init(2, 100, depth, EXP_TIME, tau, float_output);
+}
+
+//-----------------------------------------------------
+//		Measured counts of the model solved back to their true counts
+//-----------------------------------------------------
+static void testSolve()
+{
+	DeadTimeCorrector corrector;
+	initCorrector(corrector, 4, true);
+
+	//- true counts up to 0.9 of the peak of the model
+	int nb = 1000;
+	vector<double> true_counts(nb), counts(nb), solved(nb);
+	for (int i = 0; i < nb; i++)
+	{
+		true_counts[i] = 0.9 / RATE_FACTOR * i / (nb - 1);
+		counts[i] = true_counts[i] * exp(-RATE_FACTOR * true_counts[i]);
+	}
+	corrector.solve(0, &counts[0], &solved[0], nb);
+
+	double max_error = 0.;
+	for (int i = 0; i < nb; i++)
+		max_error = max(max_error, fabs(solved[i] - true_counts[i]) / max(true_counts[i], 1.));
+	XPAD_CHECK(max_error < 1e-6);
+
+	//- at and beyond the maximum of the model: the true counts of the peak
+	double beyond[2] = {1. / (M_E * RATE_FACTOR), 1e6};
+	double beyond_solved[2];
+	corrector.solve(0, beyond, beyond_solved, 2);
+	XPAD_CHECK(beyond_solved[0] == 1. / RATE_FACTOR && beyond_solved[1] == 1. / RATE_FACTOR);
+
+	//- no dead time: counts as is
+	corrector.solve(1, &counts[0], &solved[0], nb);
+	XPAD_CHECK(solved == counts);
+}
+
+//-----------------------------------------------------
+//		Copies of the tables (16 bits) and of the counts beyond them (32 bits)
+//-----------------------------------------------------
+static void testCorrect()
+{
+	DeadTimeCorrector corrector;
+	double count = 3000., expected;
+	initCorrector(corrector, 2, false);
+	corrector.solve(0, &count, &expected, 1);
+	XPAD_CHECK(expected > count);
+
+	//- 16 bits: rounded, the second module as is
+	vector<uint16_t> src16(200, uint16_t(count)), dst16(200);
+	corrector.correct(&src16[0], &dst16[0], 0, 200);
+	XPAD_CHECK(dst16[0] == uint16_t(expected + 0.5) && dst16[99] == dst16[0]);
+	XPAD_CHECK(dst16[100] == uint16_t(count) && dst16[199] == uint16_t(count));
+
+	//- 32 bits: a count beyond the tables gives the peak, from a pixel in the middle of the frame
+	initCorrector(corrector, 4, false);
+	vector<uint32_t> src32(200, uint32_t(count)), dst32(200);
+	src32[50] = 100000;
+	corrector.correct(&src32[10], &dst32[10], 10, 190);
+	XPAD_CHECK(dst32[10] == uint32_t(expected + 0.5) && dst32[0] == 0);
+	XPAD_CHECK(dst32[50] == uint32_t(1. / RATE_FACTOR + 0.5));
+	XPAD_CHECK(dst32[150] == uint32_t(count));
+
+	//- floats
+	initCorrector(corrector, 4, true);
+	vector<float> dst_float(200);
+	corrector.correct(&src32[0], &dst_float[0], 0, 200);
+	XPAD_CHECK(fabs(dst_float[0] - expected) < 1e-3 * expected && dst_float[150] == float(count));
+}
+
+//-----------------------------------------------------
+//
+//-----------------------------------------------------
+static void testInvalid()
+{
+	DeadTimeCorrector corrector;
+	vector<double> tau(1, TAU);
+	XPAD_CHECK_THROW(corrector.init(2, 100, 2, EXP_TIME, tau, false));
+	XPAD_CHECK_THROW(corrector.init(1, 100, 3, EXP_TIME, tau, false));
+	XPAD_CHECK_THROW(corrector.init(1, 100, 2, 0., tau, false));
+	tau[0] = -1.;
+	XPAD_CHECK_THROW(corrector.init(1, 100, 2, EXP_TIME, tau, false));
+}
+
+int main()
+{
+	testSolve();
+	testCorrect();
+	testInvalid();
+	return XPAD_TEST_RESULT("test_dead_time");
+}
@@ -0,0 +1,160 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadFrameCompressor.h"
+#include "XpadTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const. (S540 modules: 7 chips of 80 x 120 pixels)
+static const int NB_MODULES = 2;
+static const int MODULE_PIXELS = 560 * 120;
+
+static uint32_t readUint32BE(const char* p)
+{
+	const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+	return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+}
+
+//- Low counts with a few hot pixels, as after a short exposure
+template <class T>
+static void fillImage(vector<T>& image, int nb_pixels)
+{
+	image.resize(nb_pixels);
+	srand(1);
+	for (int pix = 0; pix < nb_pixels; pix++)
+		image[pix] = T((rand() % 100 == 0) ? rand() : rand() % 4);
+}
+
+//-----------------------------------------------------
+//		Every chunk decompressed back to its module, on 1 and 2 threads
+//-----------------------------------------------------
+template <class T>
+static void testRoundTrip(int module_pixels, int nb_threads)
+{
+	vector<T> image;
+	fillImage(image, NB_MODULES * module_pixels);
+	int chunk_size = module_pixels * sizeof(T);
+
+	FrameCompressor compressor;
+	compressor.init(NB_MODULES, chunk_size, sizeof(T), nb_threads);
+	compressor.compress(&image[0]);
+	if (module_pixels >= MODULE_PIXELS)
+		XPAD_CHECK(compressor.getCompressedSize() < NB_MODULES * chunk_size);
+
+	for (int chunk = 0; chunk < NB_MODULES; chunk++)
+	{
+		int size;
+		const char* data = compressor.getChunk(chunk, size);
+		vector<T> module(module_pixels);
+		XPAD_CHECK(FrameCompressor::decompress(data, size, &module[0], chunk_size, sizeof(T)));
+		XPAD_CHECK(memcmp(&module[0], &image[chunk * module_pixels], chunk_size) == 0);
+	}
+}
+
+//-----------------------------------------------------
+//		Header of the HDF5 filter: uint64 module size, uint32 block size (8 KiB), big endian
+//-----------------------------------------------------
+static void testHeader()
+{
+	vector<uint16_t> image;
+	fillImage(image, NB_MODULES * MODULE_PIXELS);
+
+	FrameCompressor compressor;
+	compressor.init(NB_MODULES, MODULE_PIXELS * 2, 2, 1);
+	compressor.compress(&image[0]);
+
+	int size;
+	const char* data = compressor.getChunk(1, size);
+	XPAD_CHECK(readUint32BE(data) == 0);
+	XPAD_CHECK(readUint32BE(data + 4) == uint32_t(MODULE_PIXELS * 2));
+	XPAD_CHECK(readUint32BE(data + 8) == 8192);
+	XPAD_CHECK(int(readUint32BE(data + 12)) < size);
+}
+
+//-----------------------------------------------------
+//		Bit planes: pixel k = 1 << k gives byte 1 << b in plane b
+//-----------------------------------------------------
+static void testBitPlanes()
+{
+	vector<uint8_t> image(8);
+	for (int k = 0; k < 8; k++)
+		image[k] = uint8_t(1 << k);
+
+	FrameCompressor compressor;
+	compressor.init(1, 8, 1, 1);
+	compressor.compress(&image[0]);
+
+	int size;
+	const char* data = compressor.getChunk(0, size);
+	int compressed = readUint32BE(data + 12);
+	XPAD_CHECK(size == 16 + compressed);
+
+	//- the LZ4 literals of 8 bytes: token 0x80 then the planes
+	XPAD_CHECK(compressed == 9 && uint8_t(data[16]) == 0x80);
+	for (int b = 0; b < 8 && compressed == 9; b++)
+		XPAD_CHECK(uint8_t(data[17 + b]) == uint8_t(1 << b));
+}
+
+//-----------------------------------------------------
+//		A corrupted or truncated chunk is refused
+//-----------------------------------------------------
+static void testCorrupted()
+{
+	vector<uint32_t> image;
+	fillImage(image, MODULE_PIXELS);
+	int chunk_size = MODULE_PIXELS * 4;
+
+	FrameCompressor compressor;
+	compressor.init(1, chunk_size, 4, 1);
+	compressor.compress(&image[0]);
+
+	int size;
+	const char* data = compressor.getChunk(0, size);
+	vector<char> chunk(data, data + size);
+	vector<uint32_t> module(MODULE_PIXELS);
+
+	XPAD_CHECK(!FrameCompressor::decompress(&chunk[0], size - 1, &module[0], chunk_size, 4));
+	XPAD_CHECK(!FrameCompressor::decompress(&chunk[0], 8, &module[0], chunk_size, 4));
+	XPAD_CHECK(!FrameCompressor::decompress(&chunk[0], size, &module[0], chunk_size - 4, 4));
+
+	chunk[12] = char(0x7F);		//- compressed size of the first block past the end
+	XPAD_CHECK(!FrameCompressor::decompress(&chunk[0], size, &module[0], chunk_size, 4));
+}
+
+int main()
+{
+	testRoundTrip<uint16_t>(MODULE_PIXELS, 1);
+	testRoundTrip<uint32_t>(MODULE_PIXELS, 2);
+	//- last block not a multiple of 8 pixels: 5 pixels copied as is
+	testRoundTrip<uint16_t>(MODULE_PIXELS + 13, 2);
+	testRoundTrip<uint32_t>(5, 1);
+	testHeader();
+	testBitPlanes();
+	testCorrupted();
+	return XPAD_TEST_RESULT("test_frame_compressor");
+}
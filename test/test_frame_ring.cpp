@@ -0,0 +1,177 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadFrameRing.h"
+#include "XpadTest.h"
+#include "ThreadUtils.h"
+
+#include <sstream>
+#include <vector>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int WIDTH = 64;
+static const int HEIGHT = 16;
+static const int NB_SLOTS = 4;
+
+static string ringName()
+{
+	ostringstream os;
+	os << "xpad_test_ring_" << getpid();
+	return os.str();
+}
+
+//- Frame n: every pixel is n
+static void fillFrame(vector<uint32_t>& frame, int frame_nb)
+{
+	frame.assign(WIDTH * HEIGHT, uint32_t(frame_nb));
+}
+
+static bool checkFrame(const void* image, int frame_nb)
+{
+	const uint32_t* pixels = static_cast<const uint32_t*>(image);
+	for (int pix = 0; pix < WIDTH * HEIGHT; pix++)
+		if (pixels[pix] != uint32_t(frame_nb))
+			return false;
+	return true;
+}
+
+//-----------------------------------------------------
+//		Frames read in order, overruns of a slow reader counted and skipped
+//-----------------------------------------------------
+static void testSequence()
+{
+	FrameRing ring(ringName(), NB_SLOTS, WIDTH, HEIGHT, sizeof(uint32_t));
+	FrameRingReader reader(ringName(), true);
+	XPAD_CHECK(reader.getHeader().nb_slots == uint32_t(NB_SLOTS));
+
+	int frame_nb;
+	double timestamp;
+	XPAD_CHECK(reader.getNextFrame(frame_nb, timestamp) == NULL);
+
+	vector<uint32_t> frame;
+	for (int n = 0; n < 2; n++)
+	{
+		fillFrame(frame, n);
+		ring.write(n, 10. + n, &frame[0]);
+	}
+	for (int n = 0; n < 2; n++)
+	{
+		const void* image = reader.getNextFrame(frame_nb, timestamp);
+		XPAD_CHECK(image && frame_nb == n && timestamp == 10. + n && checkFrame(image, n));
+		XPAD_CHECK(reader.releaseFrame());
+	}
+
+	//- the reader lags by nb_slots + 2 frames: the 2 oldest are lost
+	for (int n = 2; n < 2 + NB_SLOTS + 2; n++)
+	{
+		fillFrame(frame, n);
+		ring.write(n, 10. + n, &frame[0]);
+	}
+	uint64_t nb_written, nb_overruns, lag;
+	ring.getStats(nb_written, nb_overruns, lag);
+	XPAD_CHECK(nb_written == uint64_t(NB_SLOTS + 4) && nb_overruns == 2 && lag == uint64_t(NB_SLOTS + 2));
+
+	const void* image = reader.getNextFrame(frame_nb, timestamp);
+	XPAD_CHECK(image && frame_nb == 4 && checkFrame(image, 4));
+	XPAD_CHECK(reader.getNbOverruns() == 2);
+
+	//- the frame in use is overwritten: released as invalid
+	fillFrame(frame, 8);
+	ring.write(8, 18., &frame[0]);
+	XPAD_CHECK(!reader.releaseFrame());
+	XPAD_CHECK(reader.getNbOverruns() == 3);
+}
+
+//---------------------------
+//- Writer thread: nb_frames frames as fast as possible
+//---------------------------
+class RingWriter : public Thread
+{
+public:
+	RingWriter(FrameRing& ring, int nb_frames) : m_ring(ring), m_nb_frames(nb_frames) {}
+
+protected:
+	virtual void threadFunction()
+	{
+		vector<uint32_t> frame;
+		for (int n = 0; n < m_nb_frames; n++)
+		{
+			fillFrame(frame, n);
+			m_ring.write(n, n, &frame[0]);
+		}
+	}
+
+private:
+	FrameRing&	m_ring;
+	int			m_nb_frames;
+};
+
+//-----------------------------------------------------
+//		Seqlock: a frame released as valid was never torn by the writer
+//-----------------------------------------------------
+static void testConcurrent()
+{
+	const int nb_frames = 20000;
+	FrameRing ring(ringName(), NB_SLOTS, WIDTH, HEIGHT, sizeof(uint32_t));
+	FrameRingReader reader(ringName());
+	RingWriter writer(ring, nb_frames);
+	writer.start();
+
+	int nb_valid = 0, nb_torn = 0, last_frame_nb = -1;
+	bool in_order = true;
+	while (last_frame_nb < nb_frames - 1)
+	{
+		int frame_nb;
+		double timestamp;
+		const void* image = reader.getNextFrame(frame_nb, timestamp);
+		if (!image)
+		{
+			if (reader.getHeader().write_seq == uint64_t(nb_frames) &&
+				reader.getLag() == 0)
+				break;
+			continue;
+		}
+		bool consistent = checkFrame(image, frame_nb);
+		in_order = in_order && frame_nb > last_frame_nb;
+		last_frame_nb = frame_nb;
+		if (reader.releaseFrame())
+		{
+			nb_valid++;
+			nb_torn += !consistent;
+		}
+	}
+	writer.join();
+
+	XPAD_CHECK(in_order);
+	XPAD_CHECK(nb_torn == 0);
+	XPAD_CHECK(nb_valid + int(reader.getNbOverruns()) >= nb_frames);
+}
+
+int main()
+{
+	testSequence();
+	testConcurrent();
+	return XPAD_TEST_RESULT("test_frame_ring");
+}
@@ -0,0 +1,104 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadPhaseBinning.h"
+#include "XpadTest.h"
+
+#include <vector>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int NB_PIXELS = 1000;
+static const int NB_PHASES = 3;
+static const int NB_CYCLES = 4;
+
+//-----------------------------------------------------
+//		Frame i of a block summed in phase i % nb_phases
+//-----------------------------------------------------
+template <class T>
+static void testSums()
+{
+	bool is_32_bits = (sizeof(T) == 4);
+	PhaseAccumulator accumulator;
+	accumulator.init(NB_PIXELS, NB_PHASES);
+
+	//- frame i: pixel p is i + p
+	vector<T> frame(NB_PIXELS);
+	for (int i = 0; i < NB_PHASES * NB_CYCLES; i++)
+	{
+		for (int pix = 0; pix < NB_PIXELS; pix++)
+			frame[pix] = T(i + pix);
+		accumulator.addFrame(i % NB_PHASES, &frame[0], is_32_bits);
+	}
+
+	bool ok = true;
+	vector<T> sum_frame(NB_PIXELS);
+	for (int phase = 0; phase < NB_PHASES; phase++)
+	{
+		accumulator.getFrame(phase, &sum_frame[0], is_32_bits);
+		for (int pix = 0; pix < NB_PIXELS; pix++)
+		{
+			//- sum over the cycles of phase + cycle * nb_phases + pix
+			uint32_t expected = NB_CYCLES * (phase + pix) + NB_PHASES * NB_CYCLES * (NB_CYCLES - 1) / 2;
+			ok = ok && accumulator.getSums(phase)[pix] == expected && sum_frame[pix] == T(expected);
+		}
+	}
+	XPAD_CHECK(ok);
+
+	accumulator.reset();
+	XPAD_CHECK(accumulator.getSums(NB_PHASES - 1)[NB_PIXELS - 1] == 0);
+}
+
+//-----------------------------------------------------
+//		Sums saturated: at 32 bits, and at 16 bits in the 16 bits frames
+//-----------------------------------------------------
+static void testSaturation()
+{
+	PhaseAccumulator accumulator;
+	accumulator.init(NB_PIXELS, 1);
+
+	vector<uint16_t> frame16(NB_PIXELS, 40000);
+	accumulator.addFrame(0, &frame16[0], false);
+	accumulator.addFrame(0, &frame16[0], false);
+	vector<uint16_t> sum16(NB_PIXELS);
+	accumulator.getFrame(0, &sum16[0], false);
+	XPAD_CHECK(accumulator.getSums(0)[0] == 80000 && sum16[0] == 0xFFFF);
+
+	vector<uint32_t> frame32(NB_PIXELS, 0xF0000000U);
+	accumulator.reset();
+	accumulator.addFrame(0, &frame32[0], true);
+	accumulator.addFrame(0, &frame32[0], true);
+	XPAD_CHECK(accumulator.getSums(0)[NB_PIXELS - 1] == 0xFFFFFFFFU);
+
+	XPAD_CHECK_THROW(accumulator.addFrame(1, &frame32[0], true));
+	XPAD_CHECK_THROW(accumulator.init(NB_PIXELS, 0));
+}
+
+int main()
+{
+	testSums<uint16_t>();
+	testSums<uint32_t>();
+	testSaturation();
+	return XPAD_TEST_RESULT("test_phase_binning");
+}
@@ -0,0 +1,113 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadRawFrame.h"
+#include "XpadDetectorState.h"
+#include "XpadTest.h"
+
+#include <vector>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int NB_MODULES = 2;
+static const int NB_CHIPS = 7;
+static const int LINE_PIXELS = XPAD_NB_COLUMNS * NB_CHIPS;
+
+//- Pixel (col) of image line y
+static uint16_t pixelValue(int y, int col)
+{
+	return uint16_t(y * 7 + col);
+}
+
+//- Raw frame of the driver: line 1 of each module, then line 2...
+static void fillRawFrame(vector<uint16_t>& raw)
+{
+	int line_words = getRawLineWords(NB_CHIPS);
+	raw.assign(getRawFrameSize(NB_MODULES, NB_CHIPS) / sizeof(uint16_t), 0xFFFF);
+	for (int row = 1; row <= XPAD_NB_ROWS; row++)
+		for (int module = 0; module < NB_MODULES; module++)
+		{
+			uint16_t* words = &raw[size_t((row - 1) * NB_MODULES + module) * line_words];
+			words[RAW_MODULE_WORD]	= module;
+			words[RAW_ROW_WORD]		= row;
+			int y = module * XPAD_NB_ROWS + row - 1;
+			for (int col = 0; col < LINE_PIXELS; col++)
+				words[RAW_LINE_HEADER + col] = pixelValue(y, col);
+		}
+}
+
+static bool checkLine(const vector<uint16_t>& image, int y, bool placed)
+{
+	for (int col = 0; col < LINE_PIXELS; col++)
+		if (image[size_t(y) * LINE_PIXELS + col] != (placed ? pixelValue(y, col) : 0))
+			return false;
+	return true;
+}
+
+//-----------------------------------------------------
+//		Interleaved module lines stacked by module in the image
+//-----------------------------------------------------
+static void testReassembly()
+{
+	vector<uint16_t> raw;
+	fillRawFrame(raw);
+	XPAD_CHECK(raw.size() * sizeof(uint16_t) == size_t(XPAD_NB_ROWS) * NB_MODULES * (5 + LINE_PIXELS + 1) * 2);
+
+	vector<uint16_t> image(size_t(NB_MODULES) * XPAD_NB_ROWS * LINE_PIXELS, 1);
+	XPAD_CHECK(reassembleRawFrame(&raw[0], &image[0], NB_MODULES, NB_CHIPS) == NB_MODULES * XPAD_NB_ROWS);
+
+	bool ok = true;
+	for (int y = 0; y < NB_MODULES * XPAD_NB_ROWS; y++)
+		ok = ok && checkLine(image, y, true);
+	XPAD_CHECK(ok);
+}
+
+//-----------------------------------------------------
+//		Lines with an invalid header skipped, their pixels left at 0
+//-----------------------------------------------------
+static void testInvalidHeaders()
+{
+	vector<uint16_t> raw;
+	fillRawFrame(raw);
+	int line_words = getRawLineWords(NB_CHIPS);
+	raw[0 * line_words + RAW_MODULE_WORD]	= NB_MODULES;		//- module 0, row 1
+	raw[1 * line_words + RAW_ROW_WORD]		= 0;				//- module 1, row 1
+	raw[3 * line_words + RAW_ROW_WORD]		= XPAD_NB_ROWS + 1;	//- module 1, row 2
+
+	vector<uint16_t> image(size_t(NB_MODULES) * XPAD_NB_ROWS * LINE_PIXELS, 1);
+	XPAD_CHECK(reassembleRawFrame(&raw[0], &image[0], NB_MODULES, NB_CHIPS) == NB_MODULES * XPAD_NB_ROWS - 3);
+
+	XPAD_CHECK(checkLine(image, 0, false));
+	XPAD_CHECK(checkLine(image, XPAD_NB_ROWS, false));
+	XPAD_CHECK(checkLine(image, XPAD_NB_ROWS + 1, false));
+	XPAD_CHECK(checkLine(image, 1, true));
+	XPAD_CHECK(checkLine(image, XPAD_NB_ROWS + 2, true));
+}
+
+int main()
+{
+	testReassembly();
+	testInvalidHeaders();
+	return XPAD_TEST_RESULT("test_raw_frame");
+}
@@ -0,0 +1,127 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadSCurve.h"
+#include "XpadTest.h"
+#include "Timestamp.h"
+
+#include <string.h>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const.
+static const int NB_STEPS = 10;
+static const int NB_PIXELS = 3 * 4096 + 100;	//- last block not full
+static const int S540_NB_PIXELS = 560 * 960;
+
+//- Expected edge of a pixel: step pix % (NB_STEPS + 1), never reached for NB_STEPS
+static int expectedEdge(int pix)
+{
+	int edge = pix % (NB_STEPS + 1);
+	return (edge == NB_STEPS) ? -1 : edge;
+}
+
+template <class T>
+static void fillStep(vector<T>& frame, int step)
+{
+	for (size_t pix = 0; pix < frame.size(); pix++)
+	{
+		int edge = expectedEdge(pix);
+		frame[pix] = (edge >= 0 && step >= edge) ? 30 : 1;
+	}
+}
+
+//-----------------------------------------------------
+//		Noise edges of 16 and 32 bits frames, on 1 and several threads
+//-----------------------------------------------------
+template <class T>
+static void testEdges(SCurveAnalyzer& analyzer, int nb_threads)
+{
+	analyzer.init(NB_PIXELS, NB_STEPS, nb_threads);
+	XPAD_CHECK(analyzer.getNbThreads() == min(nb_threads, NB_PIXELS / 4096));
+
+	vector<T> frame(NB_PIXELS);
+	for (int step = 0; step < NB_STEPS; step++)
+	{
+		fillStep(frame, step);
+		//- 2 images per step: the counts reach 60 from the edge on
+		analyzer.addFrame(step, &frame[0], sizeof(T) == 4);
+		analyzer.addFrame(step, &frame[0], sizeof(T) == 4);
+	}
+	XPAD_CHECK(analyzer.getCounts(NB_STEPS - 1)[0] == 60);
+	XPAD_CHECK(analyzer.getCounts(0)[1] == 2);
+
+	vector<int32_t> edges;
+	analyzer.findEdges(50, edges);
+	XPAD_CHECK(int(edges.size()) == NB_PIXELS);
+	int nb_errors = 0;
+	for (int pix = 0; pix < NB_PIXELS; pix++)
+		nb_errors += (edges[pix] != expectedEdge(pix));
+	XPAD_CHECK(nb_errors == 0);
+
+	XPAD_CHECK_THROW(analyzer.addFrame(NB_STEPS, &frame[0], sizeof(T) == 4));
+}
+
+//-----------------------------------------------------
+//		Analysis time of the ITHL + DACL scans of an S540 calibration (synthetic frames)
+//-----------------------------------------------------
+static void benchS540(int nb_threads, int nb_ithl_steps, int nb_images)
+{
+	vector<uint16_t> frame(S540_NB_PIXELS, 1);
+	vector<int32_t> edges;
+	SCurveAnalyzer analyzer;
+
+	Timestamp t0 = Timestamp::now();
+	double analysis = 0.;
+	int steps[2] = {nb_ithl_steps, 64};
+	for (int scan = 0; scan < 2; scan++)
+	{
+		analyzer.init(S540_NB_PIXELS, steps[scan], nb_threads);
+		for (int step = 0; step < steps[scan]; step++)
+			for (int i = 0; i < nb_images; i++)
+				analyzer.addFrame(step, &frame[0], false);
+		analyzer.findEdges(1000, edges);
+		analysis += analyzer.getAnalysisDuration();
+	}
+	cout << "S540 scans (" << nb_ithl_steps << " ITHL + 64 DACL steps of " << nb_images << " images) on "
+		 << analyzer.getNbThreads() << " threads: analysis " << analysis << " s, total "
+		 << (Timestamp::now() - t0) << " s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+	{
+		benchS540(1, 64, 10);
+		benchS540(0, 64, 10);
+		return 0;
+	}
+
+	SCurveAnalyzer analyzer;
+	testEdges<uint16_t>(analyzer, 1);
+	testEdges<uint16_t>(analyzer, 3);
+	//- same pool
+	testEdges<uint32_t>(analyzer, 3);
+	testEdges<uint32_t>(analyzer, 2);
+	return XPAD_TEST_RESULT("test_scurve");
+}
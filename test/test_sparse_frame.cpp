@@ -0,0 +1,120 @@
+//###########################################################################
+// This file is part of LImA, a Library for Image Acquisition
+//
+// Copyright (C) : 2009-2011
+// European Synchrotron Radiation Facility
+// BP 220, Grenoble 38043
+// FRANCE
+//
+// This is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, see <http://www.gnu.org/licenses/>.
+//###########################################################################
+#include "XpadSparseFrame.h"
+#include "XpadTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace lima;
+using namespace lima::Xpad;
+using namespace std;
+
+//- Const. (not a multiple of the scan block: the last pixels are tested one by one)
+static const int NB_PIXELS = 560 * 120 + 7;
+
+//- nb_hits random pixels hit, the last pixel always
+template <class T>
+static void fillImage(vector<T>& image, int nb_hits)
+{
+	image.assign(NB_PIXELS, 0);
+	srand(nb_hits);
+	for (int i = 0; i < nb_hits - 1; i++)
+		image[rand() % NB_PIXELS] = T(1 + rand() % 1000);
+	image[NB_PIXELS - 1] = T(~0);
+}
+
+//-----------------------------------------------------
+//		Pairs decoded back to the frame, in pixel order
+//-----------------------------------------------------
+template <class T>
+static void testRoundTrip()
+{
+	vector<T> image;
+	fillImage(image, 500);
+
+	SparseEncoder encoder;
+	encoder.init(NB_PIXELS, sizeof(T), 0.05);
+	XPAD_CHECK(encoder.encode(&image[0]));
+
+	int nb_hits = 0;
+	for (int pix = 0; pix < NB_PIXELS; pix++)
+		nb_hits += (image[pix] != 0);
+	XPAD_CHECK(encoder.getNbHits() == nb_hits);
+
+	bool in_order = true;
+	for (int i = 1; i < encoder.getNbHits(); i++)
+		in_order = in_order && encoder.getIndices()[i - 1] < encoder.getIndices()[i];
+	XPAD_CHECK(in_order);
+
+	vector<T> decoded(NB_PIXELS, T(1));
+	SparseEncoder::decode(encoder.getIndices(), encoder.getCounts(), encoder.getNbHits(),
+						  &decoded[0], NB_PIXELS, sizeof(T));
+	XPAD_CHECK(decoded == image);
+}
+
+//-----------------------------------------------------
+//		Dense above the occupancy threshold, empty frame sparse with no pair
+//-----------------------------------------------------
+static void testOccupancy()
+{
+	SparseEncoder encoder;
+	encoder.init(NB_PIXELS, 2, 0.01);
+
+	vector<uint16_t> image;
+	fillImage(image, NB_PIXELS / 10);
+	XPAD_CHECK(!encoder.encode(&image[0]));
+	XPAD_CHECK(encoder.getNbHits() == 0);
+
+	image.assign(NB_PIXELS, 0);
+	XPAD_CHECK(encoder.encode(&image[0]));
+	XPAD_CHECK(encoder.getNbHits() == 0);
+
+	SparseEncoder::Stats stats;
+	encoder.getStats(stats);
+	XPAD_CHECK(stats.nb_frames == 2 && stats.nb_sparse == 1);
+
+	XPAD_CHECK_THROW(encoder.init(NB_PIXELS, 3, 0.01));
+	XPAD_CHECK_THROW(encoder.init(NB_PIXELS, 2, 1.5));
+}
+
+//-----------------------------------------------------
+//		Pairs out of the frame are ignored by the decoding
+//-----------------------------------------------------
+static void testDecodeOutOfFrame()
+{
+	uint32_t indices[2] = {3, NB_PIXELS};
+	uint32_t counts[2] = {7, 9};
+	vector<uint32_t> image(NB_PIXELS);
+	SparseEncoder::decode(indices, counts, 2, &image[0], NB_PIXELS, 4);
+	XPAD_CHECK(image[3] == 7 && image[NB_PIXELS - 1] == 0);
+}
+
+int main()
+{
+	testRoundTrip<uint16_t>();
+	testRoundTrip<uint32_t>();
+	testOccupancy();
+	testDecodeOutOfFrame();
+	return XPAD_TEST_RESULT("test_sparse_frame");
+}